@@ -96,8 +96,13 @@ DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs depr
 
 # Input
 HEADERS += \
+	inc/afexpr.h \
 	inc/arpfloat.h \
+	inc/arpint.h \
+	inc/batch.h \
 	inc/commands.h \
+	inc/limbpool.h \
+	inc/program.h \
 	inc/stack.h \
 	inc/strutils.h \
 	qtinc/calcwindow.h \
@@ -105,13 +110,19 @@ HEADERS += \
 	qtinc/clickablelabel.h
 SOURCES += \
 	src/arpfloat.cpp \
+	src/arpint.cpp \
+	src/batch.cpp \
 	src/changeset.cpp \
 	src/commands.cpp \
 	src/conversion.cpp \
 	src/grids.cpp \
 	src/keys.cpp \
+	src/limbpool.cpp \
+	src/macros.cpp \
 	src/ops.cpp \
+	src/program.cpp \
 	src/si.cpp \
+	src/stats.cpp \
 	src/stack.cpp \
 	src/strutils.cpp \
 	qtsrc/main.cpp \
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Builds the command line version (no Qt needed), e.g. for servers:
+#   printf '3 4 +\n' | output/cli/arpcalc-cli
+mkdir -p output/cli
+
+${CXX:-g++} -O2 --std=c++20 $CXXFLAGS \
+	-o output/cli/arpcalc-cli \
+	-Iinc \
+	cli/main.cpp \
+	src/arpfloat.cpp \
+	src/arpint.cpp \
+	src/batch.cpp \
+	src/commands.cpp \
+	src/conversion.cpp \
+	src/grids.cpp \
+	src/keys.cpp \
+	src/limbpool.cpp \
+	src/macros.cpp \
+	src/ops.cpp \
+	src/program.cpp \
+	src/si.cpp \
+	src/stack.cpp \
+	src/stats.cpp \
+	src/strutils.cpp \
+	$LDFLAGS -lmpfr -lgmp -pthread
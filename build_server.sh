@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds the calculation server (no Qt needed), its client library and
+# the load generator.  Unix only.
+mkdir -p output/server
+
+CXX=${CXX:-g++}
+FLAGS="-O2 --std=c++20 -pthread $CXXFLAGS -Iinc -Iserver"
+
+echo "Compiling the server"
+$CXX $FLAGS \
+	-o output/server/arpcalc-server \
+	server/main.cpp \
+	server/calcserver.cpp \
+	src/arpfloat.cpp \
+	src/arpint.cpp \
+	src/batch.cpp \
+	src/commands.cpp \
+	src/conversion.cpp \
+	src/grids.cpp \
+	src/keys.cpp \
+	src/limbpool.cpp \
+	src/macros.cpp \
+	src/ops.cpp \
+	src/program.cpp \
+	src/si.cpp \
+	src/stack.cpp \
+	src/stats.cpp \
+	src/strutils.cpp \
+	$LDFLAGS -lmpfr -lgmp || exit 1
+
+echo "Compiling the client library"
+$CXX $FLAGS -c -o output/server/calcclient.o server/calcclient.cpp && \
+	ar rcs output/server/libarpcalc-client.a output/server/calcclient.o || exit 1
+
+echo "Compiling the load generator"
+$CXX $FLAGS \
+	-o output/server/arpcalc-bench \
+	server/bench.cpp \
+	-Loutput/server -larpcalc-client
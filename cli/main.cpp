@@ -0,0 +1,520 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* A command line version of the calculator without any Qt, for use in
+ * pipelines.  Each line of input is a list of keys separated by white
+ * space, which are pressed in turn on one calculator that lasts for the
+ * whole run (so the stack carries on from one line to the next unless
+ * --reset is given).  After each line, X is written out, either on its
+ * own or as a JSON object.
+ *
+ * Input is read a line at a time and output is written in batches, so
+ * any amount of input can be streamed through without using more
+ * memory (as long as the stack doesn't keep growing).
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "arpfloat.h"
+#include "commands.h"
+#include "stack.h"
+#include "strutils.h"
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct _Settings {
+	bool json = false;
+	bool stats = false;
+	bool display = false;
+	bool reset = false;
+	bool undo = false;
+	bool radians = false;
+	int precision = 0;
+	size_t flushLines = 0; // 0 for the default
+	std::vector<std::string> files;
+} Settings;
+
+/* Key timings, in buckets that are a quarter of a power of two wide
+ * (so about 19% apart) so that there's no need to keep them all to
+ * find the percentiles.
+ */
+class Latency
+{
+	public:
+		void add(uint64_t ns)
+		{
+			buckets[bucket(ns)]++;
+			count++;
+			total += ns;
+			if (ns > longest) {
+				longest = ns;
+			}
+		}
+
+		uint64_t getCount() const { return count; }
+		double mean() const { return (count == 0) ? 0.0 : ((double) total / count); }
+		uint64_t max() const { return longest; }
+
+		// The top of the bucket that the p'th percentile is in
+		uint64_t percentile(double p) const
+		{
+			uint64_t rank = (uint64_t) std::ceil(p / 100.0 * count);
+			if (rank == 0) {
+				rank = 1;
+			}
+			uint64_t seen = 0;
+			for (int b = 0; b < BUCKETS; b++) {
+				seen += buckets[b];
+				if (seen >= rank) {
+					return std::min(top(b), longest);
+				}
+			}
+			return longest;
+		}
+
+	private:
+		static const int SUB_BUCKETS = 4;
+		static const int BUCKETS = 64 * SUB_BUCKETS;
+
+		static int bucket(uint64_t ns)
+		{
+			if (ns < SUB_BUCKETS) {
+				return (int) ns;
+			}
+			int octave = 63 - __builtin_clzll(ns);
+			int sub = (int) ((ns >> (octave - 2)) & (SUB_BUCKETS - 1));
+			return (octave - 1) * SUB_BUCKETS + sub;
+		}
+
+		static uint64_t top(int b)
+		{
+			if (b < SUB_BUCKETS) {
+				return b;
+			}
+			int octave = b / SUB_BUCKETS + 1;
+			uint64_t sub = b % SUB_BUCKETS;
+			return ((SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+		}
+
+		uint64_t buckets[BUCKETS] = {};
+		uint64_t count = 0;
+		uint64_t total = 0;
+		uint64_t longest = 0;
+};
+
+class Session
+{
+	public:
+		Session(const Settings & s);
+		// Returns false if the file couldn't be read
+		bool process(const std::string & file);
+		void finish();
+		bool hadErrors() const { return errors > 0; }
+
+	private:
+		void writeLine(const std::string & file, size_t lineNumber,
+				const std::string & errorToken, ErrorCode ec);
+		void flush();
+		Latency & latencyFor(const std::string & token);
+		void writeStats();
+
+		const Settings & settings;
+		CommandHandler calc;
+
+		std::string out;
+		size_t pendingLines = 0;
+		size_t flushLines;
+
+		uint64_t errors = 0;
+		uint64_t lines = 0;
+		Clock::time_point started;
+		std::vector<Latency> opLatency;
+		std::vector<std::string> opName;
+		std::map<std::string, Latency> otherLatency;
+};
+
+// Buffered output is written out once it gets this big, whatever
+// --flush-lines says
+static const size_t FLUSH_BYTES = 64 * 1024;
+
+static std::string jsonString(const std::string & s)
+{
+	std::string r = "\"";
+	for (unsigned char c : s) {
+		switch (c) {
+			case '"': r += "\\\""; break;
+			case '\\': r += "\\\\"; break;
+			case '\n': r += "\\n"; break;
+			case '\r': r += "\\r"; break;
+			case '\t': r += "\\t"; break;
+			default:
+				if (c < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					r += escaped;
+				}
+				else {
+					r += (char) c;
+				}
+				break;
+		}
+	}
+	return r + "\"";
+}
+
+static const char * errorName(ErrorCode ec)
+{
+	switch (ec) {
+		case NoError: return "NoError";
+		case DivideByZero: return "DivideByZero";
+		case InvalidRoot: return "InvalidRoot";
+		case InvalidLog: return "InvalidLog";
+		case InvalidTan: return "InvalidTan";
+		case InvalidInverseTrig: return "InvalidInverseTrig";
+		case InvalidInverseHypTrig: return "InvalidInverseHypTrig";
+		case UnknownConstant: return "UnknownConstant";
+		case UnknownConversion: return "UnknownConversion";
+		case InvalidConversion: return "InvalidConversion";
+		case UnknownSI: return "UnknownSI";
+		case NoFunction: return "NoFunction";
+		case NoHistorySaved: return "NoHistorySaved";
+		case InvalidShift: return "InvalidShift";
+		case InvalidStackCount: return "InvalidStackCount";
+		case InvalidPercentile: return "InvalidPercentile";
+		case UnknownMacro: return "UnknownMacro";
+		default:
+		case NotImplemented: return "NotImplemented";
+	}
+}
+
+Session::Session(const Settings & s) :
+	settings(s),
+	opLatency(opCount),
+	opName(opCount)
+{
+	calc.setDefaultOptions();
+	calc.setOption(SaveHistory, s.undo);
+	calc.setOption(Radians, s.radians);
+	if (s.precision > 0) {
+		calc.setPrecision(s.precision);
+	}
+
+	flushLines = s.flushLines;
+	if (flushLines == 0) {
+		// Someone's watching, so answer each line straight away
+		flushLines = isatty(fileno(stdout)) ? 1 : 4096;
+	}
+	started = Clock::now();
+}
+
+bool Session::process(const std::string & file)
+{
+	std::ifstream in;
+	bool useStdin = (file == "-");
+	if ( ! useStdin) {
+		in.open(file);
+		if ( ! in) {
+			flush();
+			std::cerr << file << ": can't open" << std::endl;
+			errors++;
+			return false;
+		}
+	}
+	std::istream & input = useStdin ? std::cin : in;
+	std::string name = useStdin ? "<stdin>" : file;
+
+	std::string line;
+	std::string token;
+	size_t lineNumber = 0;
+	while (std::getline(input, line)) {
+		lineNumber++;
+		size_t i = line.find_first_not_of(" \t\r");
+		if ((i == std::string::npos) || (line[i] == '#')) {
+			continue;
+		}
+		if (settings.reset) {
+			calc.completeEntering(false);
+			calc.st.clear();
+		}
+
+		ErrorCode firstError = NoError;
+		std::string errorToken;
+		while (i < line.length()) {
+			size_t end = line.find_first_of(" \t\r", i);
+			if (end == std::string::npos) {
+				end = line.length();
+			}
+			token.assign(line, i, end - i);
+			i = line.find_first_not_of(" \t\r", end);
+			if (i == std::string::npos) {
+				i = line.length();
+			}
+
+			ErrorCode ec;
+			if (settings.stats) {
+				Clock::time_point t0 = Clock::now();
+				ec = calc.keypressWord(token);
+				uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+				latencyFor(token).add(ns);
+			}
+			else {
+				ec = calc.keypressWord(token);
+			}
+
+			if (ec != NoError) {
+				errors++;
+				if (firstError == NoError) {
+					firstError = ec;
+					errorToken = token;
+				}
+				if ( ! settings.json) {
+					flush();
+					std::cerr << name << ":" << lineNumber << ": " << token << ": " << errorName(ec) << std::endl;
+				}
+			}
+		}
+		lines++;
+		writeLine(useStdin ? "" : file, lineNumber, errorToken, firstError);
+	}
+	flush();
+	return true;
+}
+
+void Session::writeLine(const std::string & file, size_t lineNumber,
+		const std::string & errorToken, ErrorCode ec)
+{
+	std::string x = settings.display ? calc.getXDisplay() : calc.getParseableX();
+	if (settings.json) {
+		out += "{";
+		if (file != "") {
+			out += "\"file\":" + jsonString(file) + ",";
+		}
+		out += "\"line\":" + std::to_string(lineNumber);
+		out += ",\"x\":" + jsonString(x);
+		out += ",\"depth\":" + std::to_string(calc.getStackView().size());
+		if (ec != NoError) {
+			out += ",\"error\":" + jsonString(errorName(ec));
+			out += ",\"token\":" + jsonString(errorToken);
+		}
+		out += "}\n";
+	}
+	else {
+		out += x;
+		out += "\n";
+	}
+	pendingLines++;
+	if ((pendingLines >= flushLines) || (out.length() >= FLUSH_BYTES)) {
+		flush();
+	}
+}
+
+void Session::flush()
+{
+	if (out.length() > 0) {
+		fwrite(out.data(), 1, out.length(), stdout);
+		fflush(stdout);
+		out.clear();
+	}
+	pendingLines = 0;
+}
+
+/* Keys are grouped by command (so "+" and "plus" are counted together),
+ * by prefix for those like "Const-Pi" and "Convert_..." and all numbers
+ * together.
+ */
+Latency & Session::latencyFor(const std::string & token)
+{
+	if (CommandHandler::isNumberWord(token)) {
+		return otherLatency["<number>"];
+	}
+	OpCode op = CommandHandler::lookupOpCode(token);
+	if (op != opNone) {
+		if (opName[op] == "") {
+			opName[op] = token;
+		}
+		return opLatency[op];
+	}
+	size_t prefix = token.find_first_of("-_");
+	if ((prefix != std::string::npos) && (prefix > 0)) {
+		return otherLatency[token.substr(0, prefix + 1)];
+	}
+	return otherLatency["<unknown>"];
+}
+
+void Session::finish()
+{
+	flush();
+	if (settings.stats) {
+		writeStats();
+	}
+}
+
+void Session::writeStats()
+{
+	double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+	std::vector<std::pair<std::string, const Latency *> > keys;
+	uint64_t ops = 0;
+	for (int op = 0; op < opCount; op++) {
+		if (opLatency[op].getCount() > 0) {
+			keys.push_back({opName[op], &opLatency[op]});
+			ops += opLatency[op].getCount();
+		}
+	}
+	for (auto & o : otherLatency) {
+		keys.push_back({o.first, &o.second});
+		ops += o.second.getCount();
+	}
+	std::sort(keys.begin(), keys.end(), [](const auto & a, const auto & b) {
+		return a.second->getCount() > b.second->getCount();
+	});
+	double rate = (elapsed > 0.0) ? (ops / elapsed) : 0.0;
+
+	char buffer[256];
+	if (settings.json) {
+		snprintf(buffer, sizeof(buffer),
+				"{\"stats\":{\"lines\":%llu,\"ops\":%llu,\"errors\":%llu,\"seconds\":%.6f,\"ops_per_second\":%.1f,\"keys\":[",
+				(unsigned long long) lines, (unsigned long long) ops, (unsigned long long) errors, elapsed, rate);
+		std::string s = buffer;
+		for (size_t k = 0; k < keys.size(); k++) {
+			const Latency & l = *keys[k].second;
+			snprintf(buffer, sizeof(buffer),
+					"%s{\"key\":%s,\"count\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}",
+					(k == 0) ? "" : ",", jsonString(keys[k].first).c_str(),
+					(unsigned long long) l.getCount(), l.mean(),
+					(unsigned long long) l.percentile(50), (unsigned long long) l.percentile(99),
+					(unsigned long long) l.max());
+			s += buffer;
+		}
+		s += "]}}";
+		std::cerr << s << std::endl;
+		return;
+	}
+
+	snprintf(buffer, sizeof(buffer), "%llu ops on %llu lines in %.3f s: %.0f ops/s, %llu errors",
+			(unsigned long long) ops, (unsigned long long) lines, elapsed, rate, (unsigned long long) errors);
+	std::cerr << buffer << std::endl;
+	snprintf(buffer, sizeof(buffer), "%-20s %12s %10s %10s %10s %10s", "key", "count", "mean us", "p50 us", "p99 us", "max us");
+	std::cerr << buffer << std::endl;
+	for (auto & k : keys) {
+		const Latency & l = *k.second;
+		snprintf(buffer, sizeof(buffer), "%-20s %12llu %10.2f %10.2f %10.2f %10.2f",
+				k.first.c_str(), (unsigned long long) l.getCount(), l.mean() / 1000.0,
+				l.percentile(50) / 1000.0, l.percentile(99) / 1000.0, l.max() / 1000.0);
+		std::cerr << buffer << std::endl;
+	}
+}
+
+static void usage(const char * name)
+{
+	std::cerr << "Usage: " << name << " [options] [file...]" << std::endl
+		<< std::endl
+		<< "Presses the keys on each line of the files (or standard input, or" << std::endl
+		<< "for a file called -) and writes out X after each line." << std::endl
+		<< std::endl
+		<< "  --json            One JSON object per line, with the stack depth and any error" << std::endl
+		<< "  --display         X as the calculator would show it, rather than in full" << std::endl
+		<< "  --reset           Clear the stack before each line" << std::endl
+		<< "  --radians         Use radians rather than degrees" << std::endl
+		<< "  --precision D     Work to D significant digits" << std::endl
+		<< "  --undo            Keep undo history (for the undo key)" << std::endl
+		<< "  --flush-lines N   Write output every N lines (default 1 on a terminal," << std::endl
+		<< "                    otherwise 4096)" << std::endl
+		<< "  --stats           Write the rate and the time taken by each key to stderr" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	Settings settings;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--json") {
+			settings.json = true;
+		}
+		else if (arg == "--stats") {
+			settings.stats = true;
+		}
+		else if (arg == "--display") {
+			settings.display = true;
+		}
+		else if (arg == "--reset") {
+			settings.reset = true;
+		}
+		else if (arg == "--radians") {
+			settings.radians = true;
+		}
+		else if (arg == "--undo") {
+			settings.undo = true;
+		}
+		else if (((arg == "--precision") || (arg == "--flush-lines")) && (i + 1 < argc)) {
+			long v = atol(argv[++i]);
+			if (v <= 0) {
+				usage(argv[0]);
+				return 2;
+			}
+			if (arg == "--precision") {
+				settings.precision = (int) v;
+			}
+			else {
+				settings.flushLines = (size_t) v;
+			}
+		}
+		else if ((arg == "-h") || (arg == "--help")) {
+			usage(argv[0]);
+			return 0;
+		}
+		else if (startsWith(arg, "--")) {
+			usage(argv[0]);
+			return 2;
+		}
+		else {
+			settings.files.push_back(arg);
+		}
+	}
+	if (settings.files.empty()) {
+		settings.files.push_back("-");
+	}
+
+	std::ios::sync_with_stdio(false);
+
+	Session session(settings);
+	for (auto & file : settings.files) {
+		session.process(file);
+	}
+	session.finish();
+
+	return session.hadErrors() ? 1 : 0;
+}
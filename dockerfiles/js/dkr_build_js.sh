@@ -10,13 +10,19 @@ emcc --bind -O3 --std=c++20 -x c++ \
 	/opt/lib/lib/libgmp.a \
 	js/jsinterface.cpp \
 	src/arpfloat.cpp \
+	src/arpint.cpp \
+	src/batch.cpp \
 	src/commands.cpp \
 	src/conversion.cpp \
 	src/grids.cpp \
 	src/keys.cpp \
+	src/limbpool.cpp \
+	src/macros.cpp \
 	src/ops.cpp \
+	src/program.cpp \
 	src/si.cpp \
 	src/stack.cpp \
+	src/stats.cpp \
 	src/strutils.cpp
 
 changeset=$(hg id -i)
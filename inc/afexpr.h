@@ -0,0 +1,238 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef AFEXPR_H
+#define AFEXPR_H
+
+#include <algorithm>
+#include <type_traits>
+#include "arpfloat.h"
+
+/* Expression templates for AF.
+ *
+ * Wrapping one operand in afx() makes the arithmetic operators build an
+ * expression tree instead of computing a temporary AF per operator.  The
+ * tree is evaluated when converted to AF, into a single destination:
+ *
+ *     push((afx(x) - y) / y * 100);
+ *
+ * Double and integer operands use the mpfr_*_d and mpfr_*_si variants
+ * (which are exact on the scalar, so give the same results as converting
+ * it to AF first) and a*b+c / a*b-c of three AFs becomes one mpfr_fma or
+ * mpfr_fms, which rounds once instead of twice.  A temporary is only
+ * needed when both sides of an operator are themselves expressions.
+ *
+ * Expressions hold references to their operands, so they must be used
+ * within the statement that creates them rather than stored.
+ */
+
+typedef enum _AFExprOp {
+	afxAdd,
+	afxSub,
+	afxMul,
+	afxDiv,
+} AFExprOp;
+
+// Non-template helpers (in arpfloat.cpp) that need access to AF internals
+class AFExprEval
+{
+	public:
+		static AF result(mpfr_prec_t prec);
+		static void set(mpfr_ptr d, const AF & a, mpfr_rnd_t rnd);
+		// d = x op a (or a op x if aOnLeft)
+		static void apply(mpfr_ptr d, AFExprOp op, mpfr_srcptr x, const AF & a, bool aOnLeft, mpfr_rnd_t rnd);
+		// d = a*b + c (subtract: a*b - c, negate: the negative of that)
+		static void fma(mpfr_ptr d, const AF & a, const AF & b, const AF & c, bool subtract, bool negate, mpfr_rnd_t rnd);
+};
+
+class AFExprLeaf
+{
+	public:
+		static const bool isAFExpr = true;
+		static const bool isTerminal = true;
+
+		explicit AFExprLeaf(const AF & a) : v(a) {}
+
+		mpfr_prec_t precision() const { return v.precision; }
+		void eval(mpfr_ptr d, mpfr_rnd_t rnd) const { AFExprEval::set(d, v, rnd); }
+		void apply(mpfr_ptr d, AFExprOp op, mpfr_srcptr x, bool onLeft, mpfr_rnd_t rnd) const
+		{
+			AFExprEval::apply(d, op, x, v, onLeft, rnd);
+		}
+
+		const AF & v;
+};
+
+class AFExprDouble
+{
+	public:
+		static const bool isAFExpr = true;
+		static const bool isTerminal = true;
+
+		explicit AFExprDouble(double a) : v(a) {}
+
+		mpfr_prec_t precision() const { return 0; }
+		void eval(mpfr_ptr d, mpfr_rnd_t rnd) const { mpfr_set_d(d, v, rnd); }
+		void apply(mpfr_ptr d, AFExprOp op, mpfr_srcptr x, bool onLeft, mpfr_rnd_t rnd) const
+		{
+			switch (op) {
+				case afxAdd: mpfr_add_d(d, x, v, rnd); break;
+				case afxMul: mpfr_mul_d(d, x, v, rnd); break;
+				case afxSub: onLeft ? mpfr_d_sub(d, v, x, rnd) : mpfr_sub_d(d, x, v, rnd); break;
+				case afxDiv: onLeft ? mpfr_d_div(d, v, x, rnd) : mpfr_div_d(d, x, v, rnd); break;
+			}
+		}
+
+		double v;
+};
+
+class AFExprInt
+{
+	public:
+		static const bool isAFExpr = true;
+		static const bool isTerminal = true;
+
+		explicit AFExprInt(long a) : v(a) {}
+
+		mpfr_prec_t precision() const { return 0; }
+		void eval(mpfr_ptr d, mpfr_rnd_t rnd) const { mpfr_set_si(d, v, rnd); }
+		void apply(mpfr_ptr d, AFExprOp op, mpfr_srcptr x, bool onLeft, mpfr_rnd_t rnd) const
+		{
+			switch (op) {
+				case afxAdd: mpfr_add_si(d, x, v, rnd); break;
+				case afxMul: mpfr_mul_si(d, x, v, rnd); break;
+				case afxSub: onLeft ? mpfr_si_sub(d, v, x, rnd) : mpfr_sub_si(d, x, v, rnd); break;
+				case afxDiv: onLeft ? mpfr_si_div(d, v, x, rnd) : mpfr_div_si(d, x, v, rnd); break;
+			}
+		}
+
+		long v;
+};
+
+template <AFExprOp Op, typename L, typename R>
+class AFExprBinary
+{
+	public:
+		static const bool isAFExpr = true;
+		static const bool isTerminal = false;
+		static const AFExprOp op = Op;
+
+		AFExprBinary(const L & a, const R & b) : l(a), r(b) {}
+
+		mpfr_prec_t precision() const { return std::max(l.precision(), r.precision()); }
+
+		void eval(mpfr_ptr d, mpfr_rnd_t rnd) const
+		{
+			if constexpr (isProduct<L>() && std::is_same_v<R, AFExprLeaf> && ((Op == afxAdd) || (Op == afxSub))) {
+				AFExprEval::fma(d, l.l.v, l.r.v, r.v, Op == afxSub, false, rnd);
+			}
+			else if constexpr (std::is_same_v<L, AFExprLeaf> && isProduct<R>() && ((Op == afxAdd) || (Op == afxSub))) {
+				// c + a*b, or c - a*b = -(a*b - c), done as (-a)*b + c
+				AFExprEval::fma(d, r.l.v, r.r.v, l.v, Op == afxSub, Op == afxSub, rnd);
+			}
+			else if constexpr (R::isTerminal) {
+				l.eval(d, rnd);
+				r.apply(d, Op, d, false, rnd);
+			}
+			else if constexpr (L::isTerminal) {
+				r.eval(d, rnd);
+				l.apply(d, Op, d, true, rnd);
+			}
+			else {
+				AF tmp = AFExprEval::result(mpfr_get_prec(d));
+				r.eval(tmp.vptr, rnd);
+				l.eval(d, rnd);
+				switch (Op) {
+					case afxAdd: mpfr_add(d, d, tmp.vptr, rnd); break;
+					case afxSub: mpfr_sub(d, d, tmp.vptr, rnd); break;
+					case afxMul: mpfr_mul(d, d, tmp.vptr, rnd); break;
+					case afxDiv: mpfr_div(d, d, tmp.vptr, rnd); break;
+				}
+			}
+		}
+
+		operator AF() const
+		{
+			// Every tree has at least one AF leaf, so this is never zero
+			AF result = AFExprEval::result(precision());
+			eval(result.vptr, result.rounding_mode);
+			return result;
+		}
+
+		const L l;
+		const R r;
+
+	private:
+		template <typename T>
+		static constexpr bool isProduct()
+		{
+			if constexpr (T::isTerminal) {
+				return false;
+			}
+			else {
+				return (T::op == afxMul) && std::is_same_v<typename T::Left, AFExprLeaf> && std::is_same_v<typename T::Right, AFExprLeaf>;
+			}
+		}
+
+	public:
+		typedef L Left;
+		typedef R Right;
+};
+
+inline AFExprLeaf afx(const AF & a)
+{
+	return AFExprLeaf(a);
+}
+
+// Turn an operand into an expression node
+inline AFExprLeaf afxOperand(const AF & a) { return AFExprLeaf(a); }
+inline AFExprDouble afxOperand(double a) { return AFExprDouble(a); }
+inline AFExprInt afxOperand(int a) { return AFExprInt(a); }
+inline AFExprInt afxOperand(long a) { return AFExprInt(a); }
+template <typename E> requires E::isAFExpr
+inline const E & afxOperand(const E & e) { return e; }
+
+template <typename T>
+concept AFExpression = std::remove_cvref_t<T>::isAFExpr;
+
+template <typename T>
+concept AFExprOperand = AFExpression<T>
+	|| std::is_same_v<std::remove_cvref_t<T>, AF>
+	|| std::is_same_v<std::remove_cvref_t<T>, double>
+	|| std::is_same_v<std::remove_cvref_t<T>, int>
+	|| std::is_same_v<std::remove_cvref_t<T>, long>;
+
+#define AFEXPR_OPERATOR(sym, opcode) \
+	template <AFExpression L, AFExprOperand R> \
+	inline auto operator sym(const L & l, const R & r) \
+	{ \
+		return AFExprBinary<opcode, std::remove_cvref_t<decltype(afxOperand(l))>, std::remove_cvref_t<decltype(afxOperand(r))> >(afxOperand(l), afxOperand(r)); \
+	} \
+	template <AFExprOperand L, AFExpression R> requires ( ! AFExpression<L>) \
+	inline auto operator sym(const L & l, const R & r) \
+	{ \
+		return AFExprBinary<opcode, std::remove_cvref_t<decltype(afxOperand(l))>, std::remove_cvref_t<decltype(afxOperand(r))> >(afxOperand(l), afxOperand(r)); \
+	}
+
+AFEXPR_OPERATOR(+, afxAdd)
+AFEXPR_OPERATOR(-, afxSub)
+AFEXPR_OPERATOR(*, afxMul)
+AFEXPR_OPERATOR(/, afxDiv)
+
+#undef AFEXPR_OPERATOR
+
+#endif
@@ -19,108 +19,279 @@
 #define ARPFLOAT_H
 
 #include <string>
+#include <stdint.h>
+#include <stdio.h> // Before gmp.h and mpfr.h for their FILE functions
+#include <gmp.h>
 #include <mpfr.h>
 
+/* Arbitrary precision float.
+ *
+ * Small values (integers that fit in an int64_t and values that are
+ * exactly representable as a double) are held inline without an mpfr_t.
+ * Arithmetic and comparisons between small values are done natively as
+ * long as the result is exact.  Other exact values (such as 0.1, 1/3 or
+ * the result of a unit conversion) are held as a GMP rational, which
+ * addition, subtraction, multiplication and division keep exact for as
+ * long as it fits in the precision.  Anything else, and any
+ * transcendental function, promotes to MPFR at the full precision.
+ * Rationals are rounded once, when they're displayed or promoted, so
+ * the results are always at least as accurate as doing everything in
+ * MPFR.
+ *
+ * New values take their precision from the working precision of the
+ * calling thread (see setWorkingDigits).  When two values of different
+ * precision are combined, the result has the larger of the two.
+ */
 class AF
 {
 	public:
 		~AF();
 		AF();
 		AF(const AF& v);
+		AF(AF&& v) noexcept;
 		AF(double v);
 		AF(long double v);
 		AF(int v);
 		AF(intmax_t v);
 		AF(std::string v);
 
+		// Takes its argument by value so that it acts as both copy and
+		// move assignment: a temporary on the right hand side is moved in
+		// rather than copied.
 		AF& operator=(AF other);
 
 		bool equals(const int other) const;
-		bool equals(const int64_t other) const;
+		bool equals(const intmax_t other) const;
 		bool equals(const double other) const;
 		bool equals(const std::string other) const;
-		bool equals(const AF other) const;
+		bool equals(const AF & other) const;
 
 		int compareTo(const int other) const;
-		int compareTo(const int64_t other) const;
+		int compareTo(const intmax_t other) const;
 		int compareTo(const double other) const;
 		int compareTo(const std::string other) const;
-		int compareTo(const AF other) const;
+		int compareTo(const AF & other) const;
+
+		bool isZero() const;
+		// False for NaN and infinity
+		bool isFinite() const;
+		int sign() const;
 
-		AF unaryMinus();
+		/* Each arithmetic function has a const & version that creates a
+		 * new value for the result and a && version that is used when
+		 * the object is a temporary: this reuses the temporary's storage
+		 * for the result instead of allocating another mpfr_t.  Where
+		 * the argument is an AF, an rvalue argument is reused in the
+		 * same way.
+		 */
+		AF unaryMinus() const &;
+		AF unaryMinus() &&;
 
-		AF minus(AF b);
-		AF minus(double b);
+		AF minus(const AF & b) const &;
+		AF minus(const AF & b) &&;
+		AF minus(AF && b) const &;
+		AF minus(AF && b) &&;
+		AF minus(double b) const &;
+		AF minus(double b) &&;
+		AF minus(int b) const &;
+		AF minus(int b) &&;
+		AF minus(intmax_t b) const &;
+		AF minus(intmax_t b) &&;
 
-		AF times(AF b);
-		AF times(double b);
+		AF times(const AF & b) const &;
+		AF times(const AF & b) &&;
+		AF times(AF && b) const &;
+		AF times(AF && b) &&;
+		AF times(double b) const &;
+		AF times(double b) &&;
+		AF times(int b) const &;
+		AF times(int b) &&;
+		AF times(intmax_t b) const &;
+		AF times(intmax_t b) &&;
 
-		AF plus(AF b);
-		AF plus(double b);
+		AF plus(const AF & b) const &;
+		AF plus(const AF & b) &&;
+		AF plus(AF && b) const &;
+		AF plus(AF && b) &&;
+		AF plus(double b) const &;
+		AF plus(double b) &&;
+		AF plus(int b) const &;
+		AF plus(int b) &&;
+		AF plus(intmax_t b) const &;
+		AF plus(intmax_t b) &&;
 
-		AF div(AF b);
-		AF div(double b);
+		AF div(const AF & b) const &;
+		AF div(const AF & b) &&;
+		AF div(AF && b) const &;
+		AF div(AF && b) &&;
+		AF div(double b) const &;
+		AF div(double b) &&;
+		AF div(int b) const &;
+		AF div(int b) &&;
+		AF div(intmax_t b) const &;
+		AF div(intmax_t b) &&;
 
-		AF rem(AF b);
-		AF rem(double b);
+		AF rem(const AF & b) const &;
+		AF rem(const AF & b) &&;
+		AF rem(double b) const &;
+		AF rem(double b) &&;
 
-		AF remainder(AF b);
-		AF remainder(double b);
+		AF remainder(const AF & b) const &;
+		AF remainder(const AF & b) &&;
+		AF remainder(double b) const &;
+		AF remainder(double b) &&;
 
-		AF round();
-		AF floor();
-		AF ceil();
-		AF pow(AF x);
+		AF round() const &;
+		AF round() &&;
+		AF floor() const &;
+		AF floor() &&;
+		AF ceil() const &;
+		AF ceil() &&;
 
-		AF sqrt();
-		AF cbrt();
-		AF root(AF p);
-		AF root(double p);
+		AF pow(const AF & x) const &;
+		AF pow(const AF & x) &&;
+		AF pow(AF && x) const &;
+		AF pow(AF && x) &&;
 
-		AF cos();
-		AF sin();
-		AF tan();
-		AF acos();
-		AF asin();
-		AF atan();
+		AF sqrt() const &;
+		AF sqrt() &&;
+		AF cbrt() const &;
+		AF cbrt() &&;
+		AF root(const AF & p) const &;
+		AF root(const AF & p) &&;
+		AF root(double p) const &;
+		AF root(double p) &&;
 
-		AF cosh();
-		AF sinh();
-		AF tanh();
-		AF acosh();
-		AF asinh();
-		AF atanh();
+		AF cos() const &;
+		AF cos() &&;
+		AF sin() const &;
+		AF sin() &&;
+		AF tan() const &;
+		AF tan() &&;
+		AF acos() const &;
+		AF acos() &&;
+		AF asin() const &;
+		AF asin() &&;
+		AF atan() const &;
+		AF atan() &&;
 
-		AF abs();
+		AF cosh() const &;
+		AF cosh() &&;
+		AF sinh() const &;
+		AF sinh() &&;
+		AF tanh() const &;
+		AF tanh() &&;
+		AF acosh() const &;
+		AF acosh() &&;
+		AF asinh() const &;
+		AF asinh() &&;
+		AF atanh() const &;
+		AF atanh() &&;
 
-		AF log();
-		AF log10();
+		AF abs() const &;
+		AF abs() &&;
 
-		double toDouble();
-		intmax_t toLong();
-		int toInt();
+		AF log() const &;
+		AF log() &&;
+		AF log10() const &;
+		AF log10() &&;
 
-		std::string toString();
+		double toDouble() const;
+		intmax_t toLong() const;
+		int toInt() const;
 
-		void debugPrint();
+		// Formats as printf's %g would with the given number of
+		// significant digits (0 for all of this value's digits).  With
+		// shortest, uses the fewest digits that read back as exactly
+		// this value.  format() works like snprintf, returning the full
+		// length even if the buffer was too small.
+		std::string toString() const;
+		std::string toString(int digits, bool shortest = false) const;
+		size_t format(char *buffer, size_t size, int digits = 0, bool shortest = false) const;
+
+		void debugPrint() const;
+
+		// Exact binary form (including the precision) for saving values
+		// in a file on this machine.  Return false on an I/O error.
+		bool write(FILE *f) const;
+		static bool read(FILE *f, AF & v);
+		// Approximate memory used by this value, in bytes
+		size_t memoryUsed() const;
 
 		static AF from(int64_t v);
 		static AF from(int v);
 		static AF from(double v);
 		static AF from(std::string v);
-		static AF pi();
-		static AF e();
+		// Constants at the working precision.  These are computed once per
+		// precision and shared between threads, so the references remain
+		// valid for the life of the program.
+		static const AF & pi();
+		static const AF & e();
+		static const AF & ln2();
+		static const AF & ln10();
+		static const AF & degreesToRadians(); // pi/180
+		static const AF & radiansToDegrees(); // 180/pi
+		// Powers up to 256 are cached (and copied out) too
+		static AF powerOfTen(int n);
+		static AF powerOfTwo(int n);
 		static bool isValidString(std::string s);
 
+		// Conversion to and from GMP integers.  toInteger rounds in the
+		// same way as toLong() but isn't limited to 64 bits; fromInteger
+		// widens the precision if necessary to hold the value exactly.
+		void toInteger(mpz_ptr z) const;
+		static AF fromInteger(mpz_srcptr z);
+
+		/* Sum of count values with a single rounding (mpfr_sum), to the
+		 * working precision.  exactSum() doesn't round at all, so that
+		 * partial sums can be added up later without losing that; it
+		 * returns false if the result would need an unreasonable
+		 * precision (because the exponents are too far apart).
+		 */
+		static AF sum(const AF * const * values, size_t count);
+		static bool exactSum(const AF * const * values, size_t count, AF & result);
+
+		// Working precision (in decimal digits) for new values created
+		// on this thread.  Clamped to MIN_DIGITS..MAX_DIGITS.
+		static constexpr int DEFAULT_DIGITS = 256;
+		static constexpr int MIN_DIGITS = 20;
+		static constexpr int MAX_DIGITS = 4096;
+		static void setWorkingDigits(int digits);
+		static int getWorkingDigits();
+		// Rounding mode for new values created on this thread
+		static void setWorkingRounding(mpfr_rnd_t rounding);
+		static mpfr_rnd_t getWorkingRounding();
+
+		// Round this value to the given number of decimal digits
+		void setDigits(int digits);
+		int getDigits() const;
+
+		// Only allocated (and only valid) once the value has been
+		// promoted to MPFR: use isSmall() to check.
 		mpfr_t vptr;
 
-		mp_rnd_t rounding_mode = mpfr_get_default_rounding_mode();
-		mp_prec_t precision = mpfr_get_default_prec();
+		bool isSmall() const;
 
-		AF operator+(const AF & b);
-		AF operator-(const AF & b);
-		AF operator/(const AF & b);
-		AF operator*(const AF & b);
+		// Taken from the working rounding and precision when created
+		mp_rnd_t rounding_mode = MPFR_RNDN;
+		mp_prec_t precision = MPFR_PREC_MIN;
+
+		AF operator+(const AF & b) const &;
+		AF operator+(const AF & b) &&;
+		AF operator+(AF && b) const &;
+		AF operator+(AF && b) &&;
+		AF operator-(const AF & b) const &;
+		AF operator-(const AF & b) &&;
+		AF operator-(AF && b) const &;
+		AF operator-(AF && b) &&;
+		AF operator/(const AF & b) const &;
+		AF operator/(const AF & b) &&;
+		AF operator/(AF && b) const &;
+		AF operator/(AF && b) &&;
+		AF operator*(const AF & b) const &;
+		AF operator*(const AF & b) &&;
+		AF operator*(AF && b) const &;
+		AF operator*(AF && b) &&;
 		bool operator==(const AF & b) const;
 		bool operator!=(const AF & b) const;
 		bool operator<(const AF & b) const;
@@ -128,22 +299,143 @@ class AF
 		bool operator<=(const AF & b) const;
 		bool operator>=(const AF & b) const;
 
-		AF operator+(double & b);
-		AF operator-(double & b);
-		AF operator/(double & b);
-		AF operator*(double & b);
-		bool operator==(double & b) const;
-		bool operator!=(double & b) const;
-		bool operator<(double & b) const;
-		bool operator>(double & b) const;
-		bool operator<=(double & b) const;
-		bool operator>=(double & b) const;
+		AF operator+(double b) const &;
+		AF operator+(double b) &&;
+		AF operator-(double b) const &;
+		AF operator-(double b) &&;
+		AF operator/(double b) const &;
+		AF operator/(double b) &&;
+		AF operator*(double b) const &;
+		AF operator*(double b) &&;
+		bool operator==(double b) const;
+		bool operator!=(double b) const;
+		bool operator<(double b) const;
+		bool operator>(double b) const;
+		bool operator<=(double b) const;
+		bool operator>=(double b) const;
+
+		// Integer operands are used directly rather than via double
+		AF operator+(int b) const &;
+		AF operator+(int b) &&;
+		AF operator-(int b) const &;
+		AF operator-(int b) &&;
+		AF operator/(int b) const &;
+		AF operator/(int b) &&;
+		AF operator*(int b) const &;
+		AF operator*(int b) &&;
+		bool operator==(int b) const;
+		bool operator!=(int b) const;
+		bool operator<(int b) const;
+		bool operator>(int b) const;
+		bool operator<=(int b) const;
+		bool operator>=(int b) const;
+		AF operator+(intmax_t b) const &;
+		AF operator+(intmax_t b) &&;
+		AF operator-(intmax_t b) const &;
+		AF operator-(intmax_t b) &&;
+		AF operator/(intmax_t b) const &;
+		AF operator/(intmax_t b) &&;
+		AF operator*(intmax_t b) const &;
+		AF operator*(intmax_t b) &&;
+		bool operator==(intmax_t b) const;
+		bool operator!=(intmax_t b) const;
+		bool operator<(intmax_t b) const;
+		bool operator>(intmax_t b) const;
+		bool operator<=(intmax_t b) const;
+		bool operator>=(intmax_t b) const;
+
+		AF& operator+=(const AF & b);
+		AF& operator-=(const AF & b);
+		AF& operator*=(const AF & b);
+		AF& operator/=(const AF & b);
+		AF& operator+=(double b);
+		AF& operator-=(double b);
+		AF& operator*=(double b);
+		AF& operator/=(double b);
+		AF& operator+=(int b);
+		AF& operator-=(int b);
+		AF& operator*=(int b);
+		AF& operator/=(int b);
+		AF& operator+=(intmax_t b);
+		AF& operator-=(intmax_t b);
+		AF& operator*=(intmax_t b);
+		AF& operator/=(intmax_t b);
 
 		void reduce_precision();
 
 	private:
+		friend class AFExprEval;
+
+		typedef enum _Repr {
+			reprInt,      // Exact integer in small.i
+			reprDouble,   // Exact value in small.d (never integral unless -0.0)
+			reprRational, // Exact value in *small.q (never a small value)
+			reprMpfr,     // Value in vptr
+		} Repr;
+
+		class MpfrArg;
+
 		void init_mpfr();
+		void init_small();
 		void set_precision(int digits);
+		void promote(mpfr_prec_t minPrec = 0);
+		static AF with_precision(mpfr_prec_t prec);
+		static mpfr_prec_t digits_to_bits(int digits);
+		static const struct _ConstantSet & constant_set();
+		static AF integer_power(int base, int n);
+		void demote();
+		void set_small(int64_t v);
+		void set_small(double v);
+		void set_rational(mpq_ptr q, mpfr_prec_t prec);
+		void release();
+		bool small_as_double(double & d) const;
+		mpq_srcptr as_rational(mpq_ptr tmp) const;
+		bool set_decimal(uint64_t mantissa, long exponent, bool negative);
+		void round_rational(int direction);
+
+		static bool fast_add(const AF & a, const AF & b, AF & r);
+		static bool fast_sub(const AF & a, const AF & b, AF & r);
+		static bool fast_mul(const AF & a, const AF & b, AF & r);
+		static bool fast_div(const AF & a, const AF & b, AF & r);
+		static bool exact_op(const AF & a, const AF & b, AF & r, void (*op)(mpq_ptr, mpq_srcptr, mpq_srcptr));
+
+		size_t format_to_scratch(int digits, bool shortest) const;
+
+		AF scalar(double v) const;
+		AF scalar(intmax_t v) const;
+
+		Repr repr = reprInt;
+		union {
+			int64_t i;
+			double d;
+			__mpq_struct *q;
+		} small;
+};
+
+/* Sets the working precision for the lifetime of the object and
+ * restores the previous one afterwards.
+ */
+class AFWorkingDigits
+{
+	public:
+		AFWorkingDigits(int digits) : saved(AF::getWorkingDigits()) { AF::setWorkingDigits(digits); }
+		~AFWorkingDigits() { AF::setWorkingDigits(saved); }
+		AFWorkingDigits(const AFWorkingDigits &) = delete;
+		AFWorkingDigits & operator=(const AFWorkingDigits &) = delete;
+	private:
+		int saved;
+};
+
+// The same for the working rounding mode
+class AFWorkingRounding
+{
+	public:
+		AFWorkingRounding(mpfr_rnd_t rounding) : saved(AF::getWorkingRounding()) { AF::setWorkingRounding(rounding); }
+		~AFWorkingRounding() { AF::setWorkingRounding(saved); }
+		AFWorkingRounding(const AFWorkingRounding &) = delete;
+		AFWorkingRounding & operator=(const AFWorkingRounding &) = delete;
+	private:
+		mpfr_rnd_t saved;
 };
 
 #endif
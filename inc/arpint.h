@@ -0,0 +1,77 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ARPINT_H
+#define ARPINT_H
+
+#include <string>
+#include <gmp.h>
+#include "arpfloat.h"
+
+/* Arbitrary size integer for the bitwise operations.
+ *
+ * Wraps a GMP mpz_t, so all of the operations work directly on the
+ * limbs.  Operations that depend on the register size take a width in
+ * bits; a width of zero means an unlimited width, in which case negative
+ * values behave as though they had an infinite number of leading ones
+ * (as in GMP's own bitwise functions).  With a fixed width, results are
+ * always reduced to 0 .. 2^width-1.
+ */
+class AI
+{
+	public:
+		~AI();
+		AI();
+		AI(const AI& v);
+		AI(AI&& v) noexcept;
+		// Rounds as AF::toLong() does
+		explicit AI(const AF & v);
+		explicit AI(long v);
+		// Digits in the given base; anything invalid gives zero
+		AI(const std::string & digits, int base);
+
+		AI& operator=(AI other);
+
+		AF toAF() const;
+		long toLong() const;
+		// In the given base (2 to 36), lower case, with a leading - if negative
+		std::string toString(int base = 10) const;
+
+		bool isNegative() const;
+		bool fitsLong() const;
+		size_t bitLength() const;
+
+		// Reduce to the width (does nothing for a width of zero)
+		AI wrapped(int width) const;
+
+		AI operator&(const AI & b) const;
+		AI operator|(const AI & b) const;
+		AI operator^(const AI & b) const;
+
+		AI complement(int width) const;    // ~x
+		AI twosComplement(int width) const; // -x
+		AI shiftLeft(unsigned long n, int width) const;
+		// Logical shift with a fixed width, arithmetic with width 0
+		AI shiftRight(unsigned long n, int width) const;
+		// Only meaningful with a fixed width
+		AI rotateLeft(unsigned long n, int width) const;
+		AI rotateRight(unsigned long n, int width) const;
+
+		mpz_t z;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "arpfloat.h"
+#include "program.h"
+#include "stack.h"
+
+/* Runs one Program over a table of inputs on a pool of threads.
+ *
+ * Each worker has its own Stack (without history) that it reuses for
+ * every row it evaluates.  The rows are split evenly between the
+ * workers to start with, and a worker that runs out takes half of
+ * what's left from whichever worker has most, so slow rows don't hold
+ * up the whole batch.  The calling thread is one of the workers.
+ */
+class BatchEvaluator
+{
+	public:
+		// threads includes the calling thread; 0 for one per core
+		BatchEvaluator(size_t threads = 0);
+		~BatchEvaluator();
+		BatchEvaluator(const BatchEvaluator &) = delete;
+		BatchEvaluator & operator=(const BatchEvaluator &) = delete;
+
+		// For every worker's stack (apart from SaveHistory, which is
+		// always off).  Not while evaluate() is running.
+		void setOption(CalcOpt o, bool v);
+
+		size_t threadCount() const;
+
+		/* inputs holds the rows one after the other, width values each,
+		 * which are pushed in order (so the last one is X) before the
+		 * program is run.  results and errors are resized to the number
+		 * of rows, and then results[i] is X after running row i and
+		 * errors[i] is the error from running it, if any.  Values are
+		 * created with the calling thread's working precision and
+		 * rounding.  Only one evaluate() can run at a time.
+		 */
+		void evaluate(const Program & program, const std::vector<AF> & inputs, size_t width,
+				std::vector<AF> & results, std::vector<ErrorCode> & errors);
+
+	private:
+		// Rows [next, end) still to be done by one worker
+		typedef struct alignas(64) _Range {
+			std::mutex lock;
+			size_t next;
+			size_t end;
+		} Range;
+
+		void workerLoop(size_t w);
+		void work(size_t w);
+		bool take(size_t w, size_t & first, size_t & last);
+		bool steal(size_t w);
+
+		std::vector<std::thread> threads;
+		std::deque<Stack> stacks;
+		std::deque<Range> ranges;
+
+		std::mutex jobLock;
+		std::condition_variable jobStarted;
+		std::condition_variable jobFinished;
+		uint64_t generation = 0;
+		size_t busy = 0;
+		bool stopping = false;
+
+		// The current job
+		const Program * program = NULL;
+		const AF * inputs = NULL;
+		size_t width = 0;
+		AF * results = NULL;
+		ErrorCode * errors = NULL;
+		int digits = AF::DEFAULT_DIGITS;
+		mpfr_rnd_t rounding = MPFR_RNDN;
+};
+
+#endif
@@ -22,9 +22,11 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 #include <stddef.h>
 
 #include "arpfloat.h"
+#include "program.h"
 #include "stack.h"
 
 typedef enum _DisplayBase {
@@ -171,6 +173,146 @@ typedef struct _chkeymap {
 	bool ctrlAltHidden = false;
 } KeyMap;
 
+/* Commands that keypress() recognises by name, as numbers.  Embedders
+ * can call keypress(OpCode) to skip looking the name up each time.
+ * Commands that take a parameter in their name (such as "Const-Pi" or
+ * conversions) only go through keypress(std::string).
+ */
+typedef enum _OpCode {
+	opNone,
+	// Entering values (these don't finish the entry)
+	opDigit0, opDigit1, opDigit2, opDigit3, opDigit4,
+	opDigit5, opDigit6, opDigit7, opDigit8, opDigit9,
+	opHexA, opHexB, opHexC, opHexD, opHexE, opHexF, // E is the exponent in decimal
+	opDot,
+	opBackspace,
+	opPlusMinus,
+	opClear,
+	opEnter,
+	opExponent,
+	opDisplay,
+	opEngL,
+	opEngR,
+	opShowAll,
+	opBase,
+	opDebugHistory,
+	// Operations
+	opAbsolute,
+	opBitwiseAnd,
+	opBitwiseNot,
+	opBitwiseOr,
+	opBitwiseXor,
+	opTwosComp,
+	opShiftLeft,
+	opShiftRight,
+	opRotateLeft,
+	opRotateRight,
+	opCeiling,
+	opPi,
+	opCos,
+	opCosh,
+	opCube,
+	opCubeRoot,
+	opDivide,
+	opDrop,
+	opEToX,
+	opFloatingPart,
+	opFloor,
+	opIntegerDivide,
+	opIntegerPart,
+	opInverseCos,
+	opInverseSin,
+	opInverseTan,
+	opInverseTan2,
+	opInverseCosh,
+	opInverseSinh,
+	opInverseTanh,
+	opInverseTanh2,
+	opLog10,
+	opLog2,
+	opLogE,
+	opMinus,
+	opPercent,
+	opPercentChange,
+	opPlus,
+	opPower,
+	opRandom,
+	opReciprocal,
+	opRemainder,
+	opRollDown,
+	opRollUp,
+	opPickN,
+	opRollN,
+	opRollDN,
+	opDropN,
+	opDupN,
+	opReverseN,
+	opDepth,
+	opRound,
+	opSin,
+	opSinh,
+	opSquare,
+	opSquareRoot,
+	opSwap,
+	opTan,
+	opTanh,
+	opTenToX,
+	opTwoToX,
+	opTimes,
+	opUndo,
+	opXRootY,
+	opSum,
+	opProduct,
+	opMean,
+	opVariance,
+	opStdDev,
+	opMinimum,
+	opMaximum,
+	opMedian,
+	opPercentile,
+	opCount
+} OpCode;
+
+typedef struct _OpEntry {
+	// Stack operations finish any entry first (pushing the entered
+	// value, or zero if takesValue and nothing has been typed) and save
+	// the history afterwards.  If there's a handler, keypress() calls
+	// that instead.
+	bool takesValue;
+	StackOp stackOp;
+	ErrorCode (*handler)(CommandHandler *c);
+} OpEntry;
+
+// A key in a recorded macro: op, or key for those only keypress(std::string)
+// knows (such as "Const-Pi")
+typedef struct _MacroKey {
+	OpCode op;
+	std::string key;
+} MacroKey;
+
+/* A recorded macro is compiled into a Program when it's played: typed
+ * numbers become values, anything worked out from those alone is done
+ * once while compiling, and there's one history checkpoint for the
+ * lot.  The plan depends on the entry state and settings it starts
+ * with, so it's kept along with those and compiled again if they've
+ * changed.  Keys that the compiler doesn't handle (such as undo or
+ * changing base) make the macro play a key at a time instead.
+ */
+typedef struct _Macro {
+	std::vector<MacroKey> keys;
+
+	bool compiled = false;
+	bool playKeys = false;
+	Program plan;
+	DisplayState start;  // Entry state the plan was compiled for
+	DisplayState end;    // and the one it leaves
+	int digits = 0;
+	bool radians = false;
+	bool binaryPrefixes = false;
+	DisplayBase base = baseDecimal;
+	bool replicate = false;
+} Macro;
+
 class CommandHandler
 {
 	public:
@@ -200,9 +342,11 @@ class CommandHandler
 		void exponent();
 		void backspace();
 		void plusMinus();
-		AF getXValue();
+		const AF & getXValue();
 		std::string getXDisplay();
 		std::string getStackDisplay();
+		// Includes the value being entered (as X) if there is one
+		StackView getStackView();
 		std::string getStatusAngularUnits();
 		std::string getStatusBase();
 		void setStatusBase(std::string b);
@@ -216,6 +360,8 @@ class CommandHandler
 		void nextPlaces();
 		void setBitCount(BitCount v);
 		BitCount getBitCount();
+		void setPrecision(int digits);
+		int getPrecision();
 		void nextBitCount();
 		std::map<std::string, std::string> getDisplayContents();
 		void optionsChanged();
@@ -224,17 +370,38 @@ class CommandHandler
 		bool isHexadecimal();
 		void store(std::string name);
 		void recall(std::string name);
+		void storeStack(std::string name);
+		void recallStack(std::string name);
 		ErrorCode keypresses(std::string charKeys);
 		ErrorCode keypresses(std::list<std::string> commands);
 		ErrorCode keypress(std::string key);
+		// A number (such as "-2.5e-3") is typed a key at a time, after
+		// pressing enter if a number is already being typed, so "3 4 +"
+		// works; anything else is one key as keypress() takes it
+		ErrorCode keypressWord(const std::string & word);
+		static bool isNumberWord(const std::string & word);
+		ErrorCode keypress(OpCode op);
+		/* The keys pressed between startRecording() and stopRecording()
+		 * are kept as the macro name (replacing any already recorded)
+		 * for playMacro() to press again.  The "RecordMacro-<name>" key
+		 * starts or stops recording and "PlayMacro-<name>" plays it.
+		 */
+		void startRecording(std::string name);
+		void stopRecording();
+		bool isRecording();
+		ErrorCode playMacro(std::string name);
+		// opNone if name isn't a command
+		static OpCode lookupOpCode(const std::string & name);
+		// NULL if op isn't just a stack operation
+		static StackOp getStackOp(OpCode op);
 		std::string addPeriodic(std::string source, int spacing, std::string insertion);
 		std::string addThinSpaces(std::string source, int spacing = 4);
 		std::string addThousandsSeparator(std::string source, int spacing = 3);
 		std::string europeanDecimal(std::string source);
-		std::string formatBase(AF value, DisplayBase base, bool isX = false);
-		ValueAndExp getValueAndExponent(AF value, bool isX);
+		std::string formatBase(const AF & value, DisplayBase base, bool isX = false);
+		ValueAndExp getValueAndExponent(const AF & value, bool isX);
 		std::string formatEnteredText(std::string value);
-		std::string formatDecimal(AF value, bool isX, bool constHelpMode = false);
+		std::string formatDecimal(const AF & value, bool isX, bool constHelpMode = false);
 		std::string powerExponent(std::string preformatted, bool isX);
 		void engRotate(int direction);
 		AF RoundToDecimalPlaces(AF d, int c);
@@ -271,6 +438,8 @@ class CommandHandler
 		std::string last_currency_date = "";
 
 	private:
+		static const OpEntry opTable[opCount];
+
 		void populateKeyMaps();
 		keyHandlerResult runHandler(std::string modifiers, KeyMap map, ErrorCode &ec);
 		std::map<std::string, KeyMap> keyMap;
@@ -278,6 +447,15 @@ class CommandHandler
 		void hex_key(std::string key);
 		void shift_hex_key(std::string key);
 
+		// Macros
+		bool macroPlanIsCurrent(const Macro & m);
+		bool compileMacro(Macro & m);
+		std::map<std::string, Macro> macros;
+		std::string recordingName;
+		std::vector<MacroKey> recordedKeys;
+		bool recording = false;
+		bool playingMacro = false;
+
 		DisplayOptions dspOptions;
 		DisplayState dspState;
 		DisplayBase dspBase = baseDecimal;
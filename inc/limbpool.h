@@ -0,0 +1,59 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LIMBPOOL_H
+#define LIMBPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A per-thread cache of limb buffers for GMP and MPFR.
+ *
+ * Every AF allocates its limbs when it is created and frees them when it
+ * is destroyed, and almost all of them are the same size.  The pool is
+ * installed with mp_set_memory_functions and keeps freed blocks on a
+ * free list per size class (one class per limb count) so that the next
+ * value of the same precision can reuse them without going through
+ * malloc.  Blocks that are too big for any class go straight to malloc.
+ *
+ * Each thread has its own pool so no locking is needed.  A block freed
+ * on a different thread to the one that allocated it simply joins the
+ * freeing thread's pool.
+ */
+
+typedef struct _LimbPoolStats {
+	uint64_t allocations;   // Calls to the allocate function
+	uint64_t poolHits;      // Allocations satisfied from the pool
+	uint64_t poolMisses;    // Allocations that had to call malloc
+	uint64_t frees;         // Calls to the free function
+	uint64_t released;      // Blocks handed back to free() (full pool or trim)
+	uint64_t cachedBlocks;  // Blocks currently held in the pool
+	uint64_t cachedBytes;   // Bytes currently held in the pool
+} LimbPoolStats;
+
+// Install the pool as the GMP memory functions.  Safe to call more than
+// once; only the first call has any effect.
+void limbPoolInstall();
+
+// Release cached blocks held by the calling thread until no more than
+// keepBytes remain.  Intended to be called when the application is idle.
+void limbPoolTrim(size_t keepBytes = 0);
+
+// Statistics for the calling thread's pool.
+LimbPoolStats limbPoolGetStats();
+
+#endif
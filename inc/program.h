@@ -0,0 +1,93 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "arpfloat.h"
+#include "stack.h"
+
+/* An RPN program compiled to bytecode, which runs directly on a Stack
+ * rather than going through CommandHandler::keypress() for each word.
+ *
+ * Words are separated by white space.  Each is a number (parsed once,
+ * when compiling), the name of a stack operation as keypress() knows it
+ * (such as "plus", "*" or "sqrt"), "enter" or "dup" to duplicate X,
+ * "pi", "Const-<name>" or "Convert_<category>_<from>_<to>".  Keys that
+ * edit the number being typed (plusMinus, backspace and so on) aren't
+ * words, and a number is always pushed, so "3 enter 4" leaves three
+ * entries where typing it would leave two.
+ *
+ * A compiled program doesn't change when it's run, so one program can
+ * be run on several stacks at once.
+ */
+class Program
+{
+	public:
+		// Returns NoFunction if a word isn't recognised, with
+		// errorPosition set to its offset in source.  Numbers are
+		// parsed at the working precision.
+		ErrorCode compile(const std::string & source, size_t & errorPosition);
+
+		// Building a program an instruction at a time (as recorded
+		// macros are).  position is what run() reports on an error.
+		void clear();
+		void push(const AF & v, size_t position);
+		void stackOp(StackOp op, size_t position);
+		void duplicate(size_t position);
+		void constant(const std::string & name, size_t position);
+		void convert(const std::string & category, const std::string & from, const std::string & to, size_t position);
+
+		/* If this returns an error, errorPosition is the offset in the
+		 * source of the word that failed, and the words before it have
+		 * taken effect.  With checkpoint, the whole program is one step
+		 * in st's undo history, as a single keypress would be.
+		 */
+		ErrorCode run(Stack & st, size_t & errorPosition, bool checkpoint = false) const;
+
+		// Number of instructions
+		size_t size() const;
+
+	private:
+		typedef enum _Code : uint8_t {
+			codePush,      // constants[arg]
+			codeStackOp,   // stackOps[arg]
+			codeDuplicate,
+			codeConstant,  // Named constant names[arg]
+			codeConvert,   // Category, from and to are names[arg..arg+2]
+		} Code;
+
+		typedef struct _Instruction {
+			Code code;
+			uint32_t arg;
+			uint32_t position;
+		} Instruction;
+
+		void add(Code code, size_t arg, size_t position);
+
+		std::vector<Instruction> instructions;
+		std::vector<AF> constants;
+		std::vector<StackOp> stackOps;
+		std::vector<std::string> names;
+};
+
+#endif
@@ -20,18 +20,23 @@
 
 #include <stddef.h>
 #include <vector>
+#include <deque>
 #include <list>
 #include <map>
 #include <set>
+#include <bitset>
 #include <random>
+#include <memory>
+#include <stdio.h>
 #include "arpfloat.h"
 
 typedef enum _CalcOpt {
 	ReplicateStack, // Use an X, Y, Z, T replicating stack
 	Radians,        // Use radians instead of degrees
-	SaveHistory,    // Save the stack history (memory intensive)
+	SaveHistory,    // Save the stack history for undo
 	PercentLeavesY, // Leave Y in place when calculating percentage
 	// If adding any here, make sure they're added to getCalcOptionByName
+	CalcOptCount    // Not an option: the size of the option bitset
 } CalcOpt;
 
 #define NAME(x) #x, x
@@ -57,6 +62,10 @@ typedef enum _ErrorCode {
 	NoFunction,
 	NoHistorySaved,
 	NotImplemented,
+	InvalidShift,
+	InvalidStackCount,
+	InvalidPercentile,
+	UnknownMacro,
 } ErrorCode;
 
 typedef enum _BitCount {
@@ -64,6 +73,10 @@ typedef enum _BitCount {
 	bc16,
 	bc32,
 	bc64,
+	bc128,
+	bc256,
+	bc512,
+	bcArbitrary,
 } BitCount;
 
 typedef struct _Constant {
@@ -80,17 +93,128 @@ typedef struct _Density {
 	std::string category;
 } Density;
 
+/* The undo history is a journal of the changes made to the stack since
+ * each call to saveHistory, so undo only has to reverse what the last
+ * operation touched rather than copying the whole stack each time.
+ */
+typedef enum _StackChangeType {
+	changePush,      // Pushed onto X
+	changePop,       // value popped from X
+	changePushFront, // Bottom entry duplicated (replicating stack)
+	changePopFront,  // value dropped from the bottom (replicating stack)
+	changeRollUp,    // X moved to the bottom (or to depth entries up)
+	changeRollDown,  // Bottom (or depth entries up) moved to X
+	changeReverse,   // The top depth entries reversed
+	changeSetX,      // X overwritten; the old value is in value
+	changeReplace,   // Whole stack replaced; the old one is in contents
+} StackChangeType;
+
+typedef struct _StackChange {
+	StackChangeType type;
+	AF value;
+	std::vector<AF> contents;
+	size_t depth = 0; // Entries a roll or reverse applies to; 0 for all
+} StackChange;
+
+/* Read-only view of the stack with X first, which refers to the values
+ * rather than copying them.  A pending value (one being entered) can be
+ * put in front of X.  It is only valid until the stack next changes.
+ */
+class StackView
+{
+	public:
+		class iterator
+		{
+			public:
+				iterator(const StackView & v, size_t i) : view(v), index(i) {}
+				const AF & operator*() const { return view[index]; }
+				const AF * operator->() const { return &view[index]; }
+				iterator & operator++() { index++; return *this; }
+				bool operator==(const iterator & other) const { return index == other.index; }
+				bool operator!=(const iterator & other) const { return index != other.index; }
+
+			private:
+				const StackView & view;
+				size_t index;
+		};
+
+		StackView(const std::deque<AF> & s, const AF * pending = NULL) : stack(s), pending(pending) {}
+
+		size_t size() const { return stack.size() + (pending ? 1 : 0); }
+		bool empty() const { return size() == 0; }
+
+		// 0 is X (or the pending value)
+		const AF & operator[](size_t index) const
+		{
+			if (pending) {
+				if (index == 0) {
+					return *pending;
+				}
+				index--;
+			}
+			return stack[stack.size() - (1+index)];
+		}
+		// 0 is the bottom of the stack, as it is saved
+		const AF & fromBottom(size_t index) const { return (*this)[size() - (1+index)]; }
+
+		iterator begin() const { return iterator(*this, 0); }
+		iterator end() const { return iterator(*this, size()); }
+
+	private:
+		const std::deque<AF> & stack;
+		const AF * pending;
+};
+
 // Forward definition for the typedef
 class Stack;
+
+/* A snapshot of the whole stack, which can be restored later.  Taking
+ * one doesn't copy anything: the stack logs its changes while there are
+ * snapshots to go back to, and only makes a copy once that log would be
+ * bigger than the stack itself.
+ */
+typedef struct _StackCheckpoint {
+	const Stack *owner;
+	size_t mark;           // Position in the change log
+	bool copied;           // If so, contents holds the stack instead
+	std::deque<AF> contents;
+} StackCheckpoint;
+
+class StackSnapshot
+{
+	public:
+		StackSnapshot() {}
+		bool isValid() const { return checkpoint != NULL; }
+
+	private:
+		friend class Stack;
+		explicit StackSnapshot(std::shared_ptr<StackCheckpoint> cp) : checkpoint(cp) {}
+		std::shared_ptr<StackCheckpoint> checkpoint;
+};
 typedef ErrorCode (Stack::*CustomConversionFunction)();
 
 typedef struct _Conversion {
 	std::string from;
 	std::string to;
 	CustomConversionFunction ConvFunc; // NULL if just a multiplier
-	double multiplier; // use convertMultiplier instead of a custom function
+	AF multiplier; // use convertMultiplier instead of a custom function
 } Conversion;
 
+/* Stack disciplines.  The primitives that add and remove values are
+ * instantiated for each of these and setOption(ReplicateStack) picks
+ * which ones push(), pop() and dropX() call, so they don't look up the
+ * option every time.
+ */
+struct UnboundedStack {
+	static constexpr size_t depth = 0; // no limit
+};
+
+struct ReplicatingStack {
+	// X, Y, Z, T: values pushed past T are lost and T is copied down
+	// when X is removed
+	static constexpr size_t depth = 4;
+};
+
 class Stack
 {
 	// Need to include everything from Stack, Ops and Conversion!
@@ -98,15 +222,23 @@ class Stack
 		// Stack.kt:
 		Stack();
 
-		std::vector<AF> getStackForDisplay();
+		StackView view(const AF * pending = NULL) const;
 
 		void setOption(CalcOpt o, bool v);
 		bool getOption(CalcOpt o);
 		const std::map<std::string, CalcOpt> getOptionNameMap();
 
-		intmax_t getBitMask();
+		// Register size for bitwise operations, or 0 if unlimited
+		int getBitWidth();
 
 		void saveHistory();
+		// Number of operations that can be undone
+		void setHistoryDepth(size_t depth);
+		// Memory to use for the most recent history.  Older entries are
+		// moved to the history file if there is one (and dropped if not).
+		void setHistoryMemory(size_t bytes);
+		// Empty to stop using a file.  Returns false if it can't be created.
+		bool setHistoryFile(std::string path);
 
 		void clear();
 
@@ -115,14 +247,52 @@ class Stack
 		void push(std::vector<AF> vs);
 
 		AF pop();
-		AF peek();
-		AF peekAt(int index);
+		// Zero if there aren't enough entries
+		const AF & peek() const;
+		const AF & peekAt(int index) const;
 
 		ErrorCode rollUp();
 		ErrorCode rollDown();
 
+		/* RPL-style stack words.  Apart from depth(), these take a count
+		 * n from X (which is dropped) and work on the n entries above
+		 * it: pickN copies entry n to X, rollN moves entry n to X,
+		 * rollDN moves X to entry n, dropN and dupN drop or duplicate
+		 * the top n, and reverseN reverses them.
+		 */
+		ErrorCode pickN();
+		ErrorCode rollN();
+		ErrorCode rollDN();
+		ErrorCode dropN();
+		ErrorCode dupN();
+		ErrorCode reverseN();
+		ErrorCode depth();
+
+		/* Statistics of everything on the stack, which is replaced with
+		 * the result.  variance() and stddev() are for a sample and
+		 * percentile() takes the percentage (0 to 100) from X.  Large
+		 * stacks are split between threads.
+		 */
+		ErrorCode sum();
+		ErrorCode product();
+		ErrorCode mean();
+		ErrorCode variance();
+		ErrorCode stddev();
+		ErrorCode minimum();
+		ErrorCode maximum();
+		ErrorCode median();
+		ErrorCode percentile();
+
 		ErrorCode undo();
 
+		StackSnapshot snapshot();
+		// Replace the whole stack with a snapshot (undo goes back again)
+		void restore(const StackSnapshot & s);
+		// Named copies of the whole stack.  Recalling a name that hasn't
+		// been stored empties the stack.
+		void storeStack(std::string name);
+		void recallStack(std::string name);
+
 
 		// Ops.kt
 		ErrorCode random();
@@ -148,6 +318,10 @@ class Stack
 		ErrorCode bitwisexor();
 		ErrorCode bitwisenot();
 		ErrorCode twoscomplement();
+		ErrorCode shiftleft();
+		ErrorCode shiftright();
+		ErrorCode rotateleft();
+		ErrorCode rotateright();
 		ErrorCode absolute();
 		ErrorCode log10();
 		ErrorCode loge();
@@ -219,8 +393,7 @@ class Stack
 		ErrorCode convertKilometresPerLitreToLitresPer100KM();
 		ErrorCode convertLitresPer100KMToKilometresPerLitre();
 
-		ErrorCode convertMultiplier(double mult);
-		ErrorCode convertMultiplier(AF mult);
+		ErrorCode convertMultiplier(const AF & mult);
 		void populateConversionTable();
 		void registerCurrencies(std::map<std::string, double> wrtEuro);
 		bool seenConv(std::vector<Conversion> path, std::string to);
@@ -234,6 +407,10 @@ class Stack
 		void setBitCount(BitCount b);
 		BitCount getBitCount();
 
+		// Working precision in decimal digits
+		void setPrecision(int digits);
+		int getPrecision();
+
 		void debugStackPrint();
 
 		std::vector<Constant> getConstants();
@@ -260,22 +437,84 @@ class Stack
 		ErrorCode convertDayOfYearToDateInCurrentYear();
 
 		std::map<std::string, std::string> unitSymbols;
-		std::vector<AF> stack;
+		// X is at the back; a deque so that rolling and replicating
+		// (which work at the front) don't shift the whole stack
+		std::deque<AF> stack;
 		std::vector<Constant> constants;
 		std::vector<Density> densities;
 
 		void printHistory();
-		void printThisStack(std::vector<AF> s);
+		void printThisStack(const std::deque<AF> & s);
 	private:
-		std::list< std::vector< AF > > history;
+		/* Ops check their operands with peek() and peekAt(), and return
+		 * an error before changing anything if they're invalid.  Once
+		 * they're valid, takeX() and takeY() give an operand to compute
+		 * the result from.  It is moved out of the stack unless the old
+		 * value has to be kept for undo, in which case it's a copy.  So
+		 * they must be followed by setX() (unary ops) or setXY() (binary
+		 * ops), which overwrite the result slot in place.  Missing
+		 * operands are zero, and the effect on the stack (including the
+		 * T register in a replicating stack) is the same as popping the
+		 * operands and pushing the result.
+		 */
+		AF takeX();
+		AF takeY();
+		void setX(AF v);
+		void setXY(AF v);
+		void dropX();
+
+		template <class P> void pushAs(AF v);
+		template <class P> AF popAs();
+		template <class P> void dropXAs();
+		void (Stack::*pushFn)(AF) = &Stack::pushAs<UnboundedStack>;
+		AF (Stack::*popFn)() = &Stack::popAs<UnboundedStack>;
+		void (Stack::*dropXFn)() = &Stack::dropXAs<UnboundedStack>;
+
+		bool validCount(bool allowZero = true);
+		ErrorCode varianceOf(AF & result);
+		ErrorCode percentileOf(size_t count, const AF & p);
+
+		bool journaling();
+		void journal(StackChangeType type, AF value = AF(), std::vector<AF> contents = {}, size_t depth = 0);
+		void replaceStack(std::deque<AF> s);
+		void trimHistory();
+		void spillHistory();
+		bool unspillHistory();
+		void clearHistory();
+		void logChange(StackChange c);
+		void pruneSnapshots();
+		void copySnapshots();
+		std::deque<AF> stackAt(size_t mark);
+
+		// One list of changes per saveHistory call, oldest first.  Older
+		// lists than these are in historyFile, starting at each of
+		// spilledHistory (the newest of those is always read back in
+		// before history is empty).
+		std::list< std::vector< StackChange > > history;
+		size_t historyMemory = 0;
+		size_t maxHistoryMemory = 16 << 20;
+		std::unique_ptr<FILE, int (*)(FILE *)> historyFile{NULL, &fclose};
+		std::deque<long> spilledHistory;
+		long historyFileEnd = 0;
+		// Changes since the oldest snapshot in snapshots that hasn't been
+		// copied yet; snapshotLogStart is the mark of the first of them
+		std::deque<std::shared_ptr<StackCheckpoint> > snapshots;
+		std::deque<StackChange> snapshotLog;
+		size_t snapshotLogStart = 0;
+		size_t snapshotLogSize = 0; // In values, to compare with the stack
+		std::map<std::string, StackSnapshot> stackSlots;
 		std::map<std::string, std::vector<Conversion> > conversionTable;
 		std::map<std::string, std::string> currencyMap;
 		std::map<std::string, double> rawCurrencyData;
-		std::set<CalcOpt> options;
+		std::bitset<CalcOptCount> options;
 		BitCount bitCount = bc32;
-		const uintmax_t MAX_HIST = 50;
+		int precisionDigits = AF::DEFAULT_DIGITS;
+		size_t maxHistory = 1000;
 
 		std::mt19937 rng;  // the Mersenne Twister with a popular choice of parameters
 };
 
+// An operation that works on the stack alone, such as Stack::plus
+typedef ErrorCode (Stack::*StackOp)();
+
 #endif
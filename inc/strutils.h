@@ -27,6 +27,5 @@ bool contains(std::string const &haystack, std::string const &needle);
 std::vector<std::string> split(std::string const &fullString, char splitOn);
 std::string toUpper(std::string original);
 std::string toLower(std::string original);
-std::string convertWithBase(intmax_t value, int base);
 
 #endif
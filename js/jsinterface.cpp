@@ -46,10 +46,22 @@ class JSI {
 		std::string getStatusAngularUnits() { return calc.getStatusAngularUnits(); }
 		std::string getStatusBase() { return calc.getStatusBase(); }
 
+		// Stack entries (0 is X, including any value being entered)
+		int getStackDepth() { return (int) calc.getStackView().size(); }
+		std::string getStackEntry(int i) {
+			StackView sv = calc.getStackView();
+			if ((i < 0) || (i >= (int) sv.size())) {
+				return "";
+			}
+			return sv[i].toString();
+		}
+
 		// Direct map other functions
 		bool isHexadecimal() { return calc.isHexadecimal(); }
 		void store(std::string name) { calc.store(name); }
 		void recall(std::string name) { calc.recall(name); }
+		void storeStack(std::string name) { calc.storeStack(name); }
+		void recallStack(std::string name) { calc.recallStack(name); }
 
 		// jscalc custom functions
 		void setBitCountByValue(int i) {
@@ -59,6 +71,10 @@ class JSI {
 				default:
 				case 32: calc.setBitCount(bc32); break;
 				case 64: calc.setBitCount(bc64); break;
+				case 128: calc.setBitCount(bc128); break;
+				case 256: calc.setBitCount(bc256); break;
+				case 512: calc.setBitCount(bc512); break;
+				case 0: calc.setBitCount(bcArbitrary); break;
 			}
 		}
 
@@ -69,6 +85,10 @@ class JSI {
 				default:
 				case bc32: return 32;
 				case bc64: return 64;
+				case bc128: return 128;
+				case bc256: return 256;
+				case bc512: return 512;
+				case bcArbitrary: return 0;
 			}
 		}
 
@@ -124,6 +144,11 @@ class JSI {
 			}
 			calc.setStatusBase(base);
 
+			val wp = localStorage.call<emscripten::val>("getItem", std::string("WorkingPrecision"));
+			if ( ! wp.isNull() ) {
+				calc.setPrecision(wp.as<int>());
+			}
+
 			// TODO: currency
 			int storeKeyCount = localStorage["length"].as<int>();
 			std::map<std::string, AF> vMap;
@@ -184,22 +209,23 @@ class JSI {
 			}
 
 			localStorage.call<void>("setItem", std::string("BitCount"), getBitCountAsValue());
+			localStorage.call<void>("setItem", std::string("WorkingPrecision"), calc.getPrecision());
 
 			saveStack();
 		}
 
 		void saveStack() {
-			std::vector<AF> storeStack;
+			StackView storeStack = calc.st.view();
+			int count = 0;
 			if (calc.getOption(SaveStackOnExit)) {
-				// Abusing encapsulation here a lot - not the best way to do it!
-				storeStack = calc.st.stack;
+				count = (int) storeStack.size();
 			}
 
 			val localStorage = val::global("localStorage");
-			localStorage.call<void>("setItem", std::string("SavedStackLength"), (int) storeStack.size());
-			for (int i=0;i<storeStack.size();i++) {
+			localStorage.call<void>("setItem", std::string("SavedStackLength"), count);
+			for (int i=0;i<count;i++) {
 				localStorage.call<void>("setItem", "SavedStack-" + std::to_string(i),
-						storeStack[i].toString());
+						storeStack.fromBottom(i).toString());
 			}
 		}
 
@@ -361,6 +387,10 @@ class JSI {
 				case UnknownSI: return "UnknownSI";
 				case NoFunction: return "NoFunction";
 				case NoHistorySaved: return "NoHistorySaved";
+				case InvalidShift: return "InvalidShift";
+				case InvalidStackCount: return "InvalidStackCount";
+				case InvalidPercentile: return "InvalidPercentile";
+				case UnknownMacro: return "UnknownMacro";
 				default:
 				case NotImplemented: return "NotImplemented";
 			}
@@ -379,10 +409,14 @@ EMSCRIPTEN_BINDINGS(arpcalc_jsi) {
 		.function("getStatusExponent", &JSI::getStatusExponent)
 		.function("getStatusAngularUnits", &JSI::getStatusAngularUnits)
 		.function("getStatusBase", &JSI::getStatusBase)
+		.function("getStackDepth", &JSI::getStackDepth)
+		.function("getStackEntry", &JSI::getStackEntry)
 
 		.function("isHexadecimal", &JSI::isHexadecimal)
 		.function("store", &JSI::store)
 		.function("recall", &JSI::recall)
+		.function("storeStack", &JSI::storeStack)
+		.function("recallStack", &JSI::recallStack)
 
 		.function("setBitCountByValue", &JSI::setBitCountByValue)
 		.function("getBitCountAsValue", &JSI::getBitCountAsValue)
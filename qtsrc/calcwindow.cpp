@@ -675,13 +675,24 @@ void CalcWindow::recallPressed()
 void CalcWindow::createSettings()
 {
 	QFileInfo exeDir(QCoreApplication::applicationDirPath());
+	QString historyPath;
 	if (exeDir.isDir() && exeDir.isWritable()) {
 		QDir dir = QCoreApplication::applicationDirPath();
 		settings = new QSettings(dir.filePath("settings.ini"),
 				QSettings::IniFormat);
+		historyPath = dir.filePath("history.bin");
 	}
 	else {
 		settings = new QSettings("cgtk.co.uk", "ARPCalc");
+		QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+		if (( ! dataDir.isEmpty()) && QDir().mkpath(dataDir)) {
+			historyPath = QDir(dataDir).filePath("history.bin");
+		}
+	}
+
+	// Older undo history spills to disk, so there's no need to limit the depth
+	if (( ! historyPath.isEmpty()) && calc.st.setHistoryFile(historyPath.toStdString())) {
+		calc.st.setHistoryDepth(SIZE_MAX);
 	}
 }
 
@@ -702,6 +713,10 @@ void CalcWindow::restoreSettings()
 		calc.setPlaces(settings->value("DecimalPlaces").toInt());
 	}
 
+	if (settings->contains("WorkingPrecision")) {
+		calc.setPrecision(settings->value("WorkingPrecision").toInt());
+	}
+
 	if (calc.getOption(SaveBaseOnExit)) {
 		if (settings->contains("SavedBase")) {
 			calc.setStatusBase(settings->value("SavedBase").toString().toStdString());
@@ -745,6 +760,10 @@ void CalcWindow::restoreSettings()
 			default:
 			case 32: calc.setBitCount(bc32); break;
 			case 64: calc.setBitCount(bc64); break;
+			case 128: calc.setBitCount(bc128); break;
+			case 256: calc.setBitCount(bc256); break;
+			case 512: calc.setBitCount(bc512); break;
+			case 0: calc.setBitCount(bcArbitrary); break;
 		}
 	}
 }
@@ -757,6 +776,7 @@ void CalcWindow::saveSettings()
 	}
 
 	settings->setValue("DecimalPlaces", calc.getPlaces());
+	settings->setValue("WorkingPrecision", calc.getPrecision());
 
 	if (calc.getOption(SaveBaseOnExit)) {
 		settings->setValue("SavedBase", QString::fromStdString(calc.getStatusBase()));
@@ -787,22 +807,26 @@ void CalcWindow::saveSettings()
 		default:
 		case bc32: settings->setValue("BitCount", 32); break;
 		case bc64: settings->setValue("BitCount", 64); break;
+		case bc128: settings->setValue("BitCount", 128); break;
+		case bc256: settings->setValue("BitCount", 256); break;
+		case bc512: settings->setValue("BitCount", 512); break;
+		case bcArbitrary: settings->setValue("BitCount", 0); break;
 	}
 }
 
 void CalcWindow::saveStack()
 {
-	std::vector<AF> storeStack;
+	StackView storeStack = calc.st.view();
+	qlonglong count = 0;
 	if (calc.getOption(SaveStackOnExit)) {
-		// Abusing encapsulation here a lot - not the best way to do it!
-		storeStack = calc.st.stack;
+		count = (qlonglong) storeStack.size();
 	}
 
-	settings->setValue("SavedStackLength", (qulonglong) storeStack.size());
-	for (qlonglong i=0;i<(int)storeStack.size();i++) {
+	settings->setValue("SavedStackLength", (qulonglong) count);
+	for (qlonglong i=0;i<count;i++) {
 		settings->setValue(QString("SavedStack-%1").arg((qlonglong) i,
 					(int) 3, (int) 10, (QChar) '0'),
-				QString::fromStdString(storeStack[i].toString()));
+				QString::fromStdString(storeStack.fromBottom(i).toString()));
 	}
 }
 
@@ -1108,10 +1132,18 @@ void CalcWindow::buttonPress(QString command)
 
 	if (( ! handled) && (command.startsWith("Store"))) {
 		handled = true;
-		if (storeMode == "store") {
+		// Ctrl-click stores or recalls the whole stack
+		bool wholeStack = QApplication::keyboardModifiers() & Qt::ControlModifier;
+		if ((storeMode == "store") && wholeStack) {
+			calc.storeStack(command.toStdString());
+		}
+		else if (storeMode == "store") {
 			calc.store(command.toStdString());
 			saveSettings();
 		}
+		else if ((storeMode == "recall") && wholeStack) {
+			calc.recallStack(command.toStdString());
+		}
 		else if (storeMode == "recall") {
 			calc.recall(command.toStdString());
 		}
@@ -1184,6 +1216,18 @@ void CalcWindow::handleErrorCode(ErrorCode result)
 		case UnknownSI:
 			showToast("Unknown SI unit");
 			break;
+		case InvalidShift:
+			showToast("Invalid shift or rotate");
+			break;
+		case InvalidStackCount:
+			showToast("Not enough stack entries");
+			break;
+		case InvalidPercentile:
+			showToast("Percentile must be from 0 to 100");
+			break;
+		case UnknownMacro:
+			showToast("No macro recorded on that key");
+			break;
 		default:
 			break;
 	}
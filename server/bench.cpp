@@ -0,0 +1,205 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Puts load on a calculation server: each connection (on its own
+ * thread) keeps a number of requests on the go, spread over its
+ * sessions, and the time from sending each one to getting its response
+ * is recorded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "calcclient.h"
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct _BenchSettings {
+	std::string socketPath = defaultSocketPath();
+	size_t connections = 4;
+	size_t sessions = 16;      // Per connection
+	size_t requests = 100000;  // Per connection
+	size_t pipeline = 32;      // Requests on the go per connection
+	std::string keys = "2 sqrt 3 * drop";
+	bool close = false;
+} BenchSettings;
+
+typedef struct _Result {
+	std::vector<uint32_t> latencies; // Nanoseconds
+	uint64_t newSessions = 0;
+	uint64_t errors = 0;
+	std::string failure;
+} Result;
+
+static void runConnection(const BenchSettings & settings, size_t connection, Result & result)
+{
+	CalcClient client;
+	if ( ! client.connect(settings.socketPath)) {
+		result.failure = client.getError();
+		return;
+	}
+
+	// Ids start at 1
+	std::vector<Clock::time_point> sentAt(settings.requests + 1);
+	result.latencies.reserve(settings.requests);
+	uint64_t firstSession = (uint64_t) (connection + 1) << 32;
+
+	size_t sent = 0;
+	size_t received = 0;
+	CalcResponse response;
+	while (received < settings.requests) {
+		while ((sent < settings.requests) && (sent - received < settings.pipeline)) {
+			uint32_t id = client.send(firstSession + (sent % settings.sessions), settings.keys);
+			sentAt[id] = Clock::now();
+			sent++;
+		}
+		if ( ! client.receive(response)) {
+			result.failure = client.getError();
+			return;
+		}
+		Clock::time_point now = Clock::now();
+		result.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sentAt[response.id]).count());
+		if (response.status == statusNewSession) {
+			result.newSessions++;
+		}
+		if (response.error != 0) {
+			result.errors++;
+		}
+		received++;
+	}
+
+	if (settings.close) {
+		for (size_t s = 0; s < std::min(settings.sessions, settings.requests); s++) {
+			client.sendClose(firstSession + s);
+		}
+		for (size_t s = 0; s < std::min(settings.sessions, settings.requests); s++) {
+			if ( ! client.receive(response)) {
+				result.failure = client.getError();
+				return;
+			}
+		}
+	}
+}
+
+static void usage(const char * name)
+{
+	BenchSettings defaults;
+	std::cerr << "Usage: " << name << " [options]" << std::endl
+		<< std::endl
+		<< "  --socket PATH       Server socket (default " << defaults.socketPath << ")" << std::endl
+		<< "  --connections N     Connections, each on its own thread (default " << defaults.connections << ")" << std::endl
+		<< "  --sessions N        Sessions per connection (default " << defaults.sessions << ")" << std::endl
+		<< "  --requests N        Requests per connection (default " << defaults.requests << ")" << std::endl
+		<< "  --pipeline N        Requests on the go per connection (default " << defaults.pipeline << ")" << std::endl
+		<< "  --keys KEYS         Keys for each request (default \"" << defaults.keys << "\")" << std::endl
+		<< "  --close             Close the sessions at the end" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchSettings settings;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--close") {
+			settings.close = true;
+		}
+		else if ((arg == "--socket") && (i + 1 < argc)) {
+			settings.socketPath = argv[++i];
+		}
+		else if ((arg == "--keys") && (i + 1 < argc)) {
+			settings.keys = argv[++i];
+		}
+		else if (((arg == "--connections") || (arg == "--sessions") || (arg == "--requests") || (arg == "--pipeline"))
+				&& (i + 1 < argc)) {
+			long v = atol(argv[++i]);
+			if (v <= 0) {
+				usage(argv[0]);
+				return 2;
+			}
+			if (arg == "--connections") {
+				settings.connections = v;
+			}
+			else if (arg == "--sessions") {
+				settings.sessions = v;
+			}
+			else if (arg == "--requests") {
+				settings.requests = v;
+			}
+			else {
+				settings.pipeline = v;
+			}
+		}
+		else if ((arg == "-h") || (arg == "--help")) {
+			usage(argv[0]);
+			return 0;
+		}
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	std::vector<Result> results(settings.connections);
+	std::vector<std::thread> threads;
+	Clock::time_point started = Clock::now();
+	for (size_t c = 0; c < settings.connections; c++) {
+		threads.emplace_back(runConnection, std::cref(settings), c, std::ref(results[c]));
+	}
+	for (auto & t : threads) {
+		t.join();
+	}
+	double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+	std::vector<uint32_t> latencies;
+	uint64_t newSessions = 0;
+	uint64_t errors = 0;
+	bool failed = false;
+	for (auto & r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		newSessions += r.newSessions;
+		errors += r.errors;
+		if (r.failure != "") {
+			std::cerr << r.failure << std::endl;
+			failed = true;
+		}
+	}
+	if (latencies.empty()) {
+		return 1;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p) {
+		size_t i = std::min(latencies.size() - 1, (size_t) (p / 100.0 * latencies.size()));
+		return latencies[i] / 1000.0;
+	};
+
+	// Any more new sessions than were asked for means some were evicted
+	uint64_t sessions = settings.connections * std::min(settings.sessions, settings.requests);
+	printf("%zu requests in %.3f s: %.0f requests/s\n", latencies.size(), elapsed, latencies.size() / elapsed);
+	printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+			percentile(50), percentile(90), percentile(99), latencies.back() / 1000.0);
+	printf("%llu new sessions (%llu restarted after eviction), %llu errors\n",
+			(unsigned long long) newSessions,
+			(unsigned long long) ((newSessions > sessions) ? (newSessions - sessions) : 0),
+			(unsigned long long) errors);
+	return failed ? 1 : 0;
+}
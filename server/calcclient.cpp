@@ -0,0 +1,193 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "calcclient.h"
+
+// Requests are sent once this much is queued, even without flush()
+static const size_t SEND_BYTES = 64 * 1024;
+
+CalcClient::CalcClient()
+{
+}
+
+CalcClient::~CalcClient()
+{
+	disconnect();
+}
+
+bool CalcClient::connect(const std::string & socketPath)
+{
+	disconnect();
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.length() >= sizeof(address.sun_path)) {
+		error = socketPath + ": path too long";
+		return false;
+	}
+	strcpy(address.sun_path, socketPath.c_str());
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((fd < 0) || (::connect(fd, (sockaddr *) &address, sizeof(address)) != 0)) {
+		return fail(socketPath);
+	}
+	error = "";
+	return true;
+}
+
+void CalcClient::disconnect()
+{
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	out.clear();
+	in.clear();
+	inUsed = 0;
+}
+
+bool CalcClient::isConnected() const
+{
+	return fd >= 0;
+}
+
+bool CalcClient::fail(const std::string & what)
+{
+	error = what + ": " + ((errno == 0) ? "connection closed" : strerror(errno));
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	return false;
+}
+
+const std::string & CalcClient::getError() const
+{
+	return error;
+}
+
+bool CalcClient::call(uint64_t session, const std::string & keys, CalcResponse & response)
+{
+	uint32_t id = send(session, keys);
+	do {
+		if ( ! receive(response)) {
+			return false;
+		}
+	} while (response.id != id);
+	return true;
+}
+
+uint32_t CalcClient::send(uint64_t session, const std::string & keys)
+{
+	return queue(requestKeys, session, keys);
+}
+
+uint32_t CalcClient::sendClose(uint64_t session)
+{
+	return queue(requestClose, session, "");
+}
+
+uint32_t CalcClient::queue(RequestType type, uint64_t session, const std::string & keys)
+{
+	uint32_t id = nextId++;
+	putU32(out, REQUEST_HEADER_BYTES + keys.length());
+	putU32(out, id);
+	putU8(out, type);
+	putU64(out, session);
+	out += keys;
+	if (out.length() >= SEND_BYTES) {
+		flush();
+	}
+	return id;
+}
+
+bool CalcClient::flush()
+{
+	if (fd < 0) {
+		return false;
+	}
+	size_t sent = 0;
+	while (sent < out.length()) {
+		ssize_t n = ::send(fd, out.data() + sent, out.length() - sent, MSG_NOSIGNAL);
+		if (n > 0) {
+			sent += n;
+		}
+		else if ((n < 0) && (errno == EINTR)) {
+			continue;
+		}
+		else {
+			return fail("send");
+		}
+	}
+	out.clear();
+	return true;
+}
+
+bool CalcClient::receive(CalcResponse & response)
+{
+	if (( ! out.empty()) && ( ! flush())) {
+		return false;
+	}
+	for (;;) {
+		size_t available = in.length() - inUsed;
+		if (available >= LENGTH_BYTES) {
+			const char * p = in.data() + inUsed;
+			size_t length = getU32(p);
+			if ((length < RESPONSE_HEADER_BYTES) || (length > MAX_FRAME_BYTES)) {
+				errno = EPROTO;
+				return fail("receive");
+			}
+			if (available >= LENGTH_BYTES + length) {
+				p += LENGTH_BYTES;
+				response.id = getU32(p);
+				response.status = (Status) p[4];
+				response.error = (unsigned char) p[5];
+				response.depth = getU32(p + 6);
+				response.x.assign(p + RESPONSE_HEADER_BYTES, length - RESPONSE_HEADER_BYTES);
+				inUsed += LENGTH_BYTES + length;
+				return true;
+			}
+		}
+		if (fd < 0) {
+			return false;
+		}
+
+		// Make room before reading any more
+		in.erase(0, inUsed);
+		inUsed = 0;
+		char buffer[64 * 1024];
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n > 0) {
+			in.append(buffer, n);
+		}
+		else if ((n < 0) && (errno == EINTR)) {
+			continue;
+		}
+		else {
+			if (n == 0) {
+				errno = 0;
+			}
+			return fail("receive");
+		}
+	}
+}
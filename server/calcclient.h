@@ -0,0 +1,82 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CALCCLIENT_H
+#define CALCCLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "protocol.h"
+
+typedef struct _CalcResponse {
+	uint32_t id;
+	Status status;
+	int error;        // An ErrorCode (see stack.h); 0 if there wasn't one
+	uint32_t depth;   // Stack depth, including X
+	std::string x;    // In full, as AF() takes it
+} CalcResponse;
+
+/* A connection to the calculation server.  It doesn't need the rest of
+ * the calculator (or GMP and MPFR) to be linked in.
+ *
+ * call() sends one request and waits for the answer.  To have several
+ * on the go at once, send() any number of them (which just queues them
+ * up until flush() or receive()) and receive() the responses, matching
+ * them up by id.  The server only reads so far ahead of the responses
+ * that haven't been read, so don't send more than a few hundred before
+ * receiving.
+ *
+ * Functions returning bool return false if the connection has failed,
+ * with the reason in getError().
+ */
+class CalcClient
+{
+	public:
+		CalcClient();
+		~CalcClient();
+		CalcClient(const CalcClient &) = delete;
+		CalcClient & operator=(const CalcClient &) = delete;
+
+		bool connect(const std::string & socketPath = defaultSocketPath());
+		void disconnect();
+		bool isConnected() const;
+
+		bool call(uint64_t session, const std::string & keys, CalcResponse & response);
+
+		// These return the request's id
+		uint32_t send(uint64_t session, const std::string & keys);
+		uint32_t sendClose(uint64_t session);
+		bool flush();
+		bool receive(CalcResponse & response);
+
+		const std::string & getError() const;
+
+	private:
+		uint32_t queue(RequestType type, uint64_t session, const std::string & keys);
+		bool fail(const std::string & what);
+
+		int fd = -1;
+		uint32_t nextId = 1;
+		std::string out;
+		std::string in;
+		size_t inUsed = 0;
+		std::string error;
+};
+
+#endif
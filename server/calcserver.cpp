@@ -0,0 +1,597 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+#include "calcserver.h"
+#include "protocol.h"
+
+// Requests done for one session before letting others have a go
+static const int JOBS_PER_TURN = 32;
+// How long a worker waits for a client to read its responses
+static const int SEND_TIMEOUT_MS = 30000;
+// Used if the allocator can't tell us
+static const size_t DEFAULT_HANDLER_BYTES = 192 << 10;
+
+CalcServer::_Connection::~_Connection()
+{
+	close(fd);
+}
+
+CalcServer::CalcServer(const Settings & s) :
+	settings(s)
+{
+	if (settings.threads == 0) {
+		settings.threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+CalcServer::~CalcServer()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		stopping = true;
+	}
+	workWaiting.notify_all();
+	for (auto & t : workers) {
+		t.join();
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		unlink(settings.socketPath.c_str());
+	}
+	for (int fd : wakeFds) {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+}
+
+bool CalcServer::start(std::string & error)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (settings.socketPath.length() >= sizeof(address.sun_path)) {
+		error = settings.socketPath + ": path too long";
+		return false;
+	}
+	strcpy(address.sun_path, settings.socketPath.c_str());
+
+	// Only take over the socket if nothing's listening on it
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connect(probe, (sockaddr *) &address, sizeof(address)) == 0) {
+		close(probe);
+		error = settings.socketPath + ": another server is already running";
+		return false;
+	}
+	close(probe);
+	unlink(settings.socketPath.c_str());
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((listenFd < 0)
+			|| (bind(listenFd, (sockaddr *) &address, sizeof(address)) != 0)
+			|| (listen(listenFd, 128) != 0)) {
+		error = settings.socketPath + ": " + strerror(errno);
+		if (listenFd >= 0) {
+			close(listenFd);
+			listenFd = -1;
+		}
+		return false;
+	}
+	fcntl(listenFd, F_SETFL, O_NONBLOCK);
+
+	if (pipe(wakeFds) != 0) {
+		error = std::string("pipe: ") + strerror(errno);
+		return false;
+	}
+	fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+
+	// The first one sets up the tables that are shared, so measure the
+	// second
+	spares.push_back(newHandler());
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	size_t before = mallinfo2().uordblks;
+	spares.push_back(newHandler());
+	size_t after = mallinfo2().uordblks;
+	handlerBytes = (after > before) ? (after - before) : DEFAULT_HANDLER_BYTES;
+#else
+	handlerBytes = DEFAULT_HANDLER_BYTES;
+#endif
+	if (settings.undo) {
+		handlerBytes += settings.historyMemory;
+	}
+	totalBytes = spares.size() * handlerBytes;
+
+	poolStats.assign(settings.threads, LimbPoolStats());
+	for (size_t w = 0; w < settings.threads; w++) {
+		workers.emplace_back(&CalcServer::workerLoop, this, w);
+	}
+	return true;
+}
+
+void CalcServer::stop()
+{
+	stopping = true;
+	wake();
+}
+
+void CalcServer::wake()
+{
+	char c = 0;
+	// If the pipe's full, it's going to wake up anyway
+	if (write(wakeFds[1], &c, 1) < 0) {
+		return;
+	}
+}
+
+void CalcServer::run()
+{
+	std::vector<pollfd> fds;
+	while ( ! stopping) {
+		fds.clear();
+		fds.push_back({wakeFds[0], POLLIN, 0});
+		fds.push_back({listenFd, POLLIN, 0});
+		for (auto & c : connections) {
+			// Stop reading once it has enough on the go
+			short events = (c->inFlight < MAX_IN_FLIGHT) ? POLLIN : 0;
+			fds.push_back({c->fd, events, 0});
+		}
+
+		int timeout = (settings.idleSeconds > 0) ? 1000 : -1;
+		if (poll(fds.data(), fds.size(), timeout) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			std::cerr << "poll: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		if (fds[0].revents != 0) {
+			char drain[64];
+			while (read(wakeFds[0], drain, sizeof(drain)) > 0) {
+			}
+		}
+
+		if (fds[1].revents & POLLIN) {
+			int fd;
+			while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				auto c = std::make_shared<Connection>();
+				c->fd = fd;
+				connections.push_back(c);
+			}
+		}
+
+		// fds and connections line up as far as fds goes; any new
+		// connections are at the end and haven't been polled yet
+		std::vector<std::shared_ptr<Connection> > open;
+		for (size_t i = 0; i < connections.size(); i++) {
+			auto & c = connections[i];
+			short revents = (i + 2 < fds.size()) ? fds[i + 2].revents : 0;
+			bool ok = true;
+			if (revents & (POLLIN | POLLHUP | POLLERR)) {
+				ok = readFrom(c);
+			}
+			if (ok && (c->in.length() > 0)) {
+				// There may be frames left from when it had too many
+				// in flight
+				ok = parseFrames(c);
+			}
+			if (ok) {
+				open.push_back(c);
+			}
+			else {
+				// The workers may still have responses for it, so
+				// it's only closed once they've finished with it
+				std::lock_guard<std::mutex> l(c->writeLock);
+				c->broken = true;
+			}
+		}
+		connections.swap(open);
+
+		if (settings.idleSeconds > 0) {
+			evictIdle();
+		}
+	}
+}
+
+bool CalcServer::readFrom(const std::shared_ptr<Connection> & c)
+{
+	char buffer[64 * 1024];
+	for (;;) {
+		ssize_t n = recv(c->fd, buffer, sizeof(buffer), 0);
+		if (n > 0) {
+			c->in.append(buffer, n);
+			if (c->inFlight >= MAX_IN_FLIGHT) {
+				return true;
+			}
+			if ( ! parseFrames(c)) {
+				return false;
+			}
+		}
+		else if (n == 0) {
+			return false;
+		}
+		else if (errno == EINTR) {
+			continue;
+		}
+		else {
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+		}
+	}
+}
+
+// Returns false if the connection's sent something that isn't a frame
+bool CalcServer::parseFrames(const std::shared_ptr<Connection> & c)
+{
+	size_t used = 0;
+	while (c->inFlight < MAX_IN_FLIGHT) {
+		size_t available = c->in.length() - used;
+		if (available < LENGTH_BYTES) {
+			break;
+		}
+		const char * p = c->in.data() + used;
+		size_t length = getU32(p);
+		if ((length < REQUEST_HEADER_BYTES) || (length > MAX_FRAME_BYTES)) {
+			return false;
+		}
+		if (available < LENGTH_BYTES + length) {
+			break;
+		}
+		p += LENGTH_BYTES;
+
+		Job job;
+		job.connection = c;
+		job.id = getU32(p);
+		job.type = (uint8_t) p[4];
+		uint64_t session = getU64(p + 5);
+		job.keys.assign(p + REQUEST_HEADER_BYTES, length - REQUEST_HEADER_BYTES);
+		used += LENGTH_BYTES + length;
+
+		c->inFlight++;
+		submit(session, std::move(job));
+	}
+	c->in.erase(0, used);
+	return true;
+}
+
+void CalcServer::submit(uint64_t session, Job && job)
+{
+	std::lock_guard<std::mutex> l(lock);
+	requests++;
+	auto it = sessions.find(session);
+	Session * s;
+	if (it == sessions.end()) {
+		auto created = std::make_unique<Session>();
+		s = created.get();
+		s->id = session;
+		lru.push_back(s);
+		s->lruPosition = std::prev(lru.end());
+		sessions[session] = std::move(created);
+	}
+	else {
+		s = it->second.get();
+		lru.splice(lru.end(), lru, s->lruPosition);
+	}
+	s->lastUsed = Clock::now();
+	s->jobs.push_back(std::move(job));
+	if ( ! s->scheduled) {
+		s->scheduled = true;
+		runQueue.push_back(s);
+		workWaiting.notify_one();
+	}
+}
+
+void CalcServer::workerLoop(size_t worker)
+{
+	std::string response;
+	std::vector<std::unique_ptr<CommandHandler> > dropped;
+	auto ready = [this]() {
+		return stopping || ( ! runQueue.empty())
+			|| ((spares.size() + sparesBuilding < settings.spares)
+					&& (totalBytes + handlerBytes <= settings.memoryLimit));
+	};
+	bool busy = false; // Since the limb pool was last trimmed
+	std::unique_lock<std::mutex> l(lock);
+	for (;;) {
+		if (busy && ( ! ready())) {
+			// Going idle, so give back the limbs this thread's keeping
+			busy = false;
+			l.unlock();
+			limbPoolTrim();
+			LimbPoolStats stats = limbPoolGetStats();
+			l.lock();
+			poolStats[worker] = stats;
+			continue;
+		}
+		workWaiting.wait(l, ready);
+		if (stopping) {
+			break;
+		}
+		busy = true;
+
+		if (runQueue.empty()) {
+			// Nothing to do, so get a session ready for later
+			totalBytes += handlerBytes;
+			sparesBuilding++;
+			l.unlock();
+			auto calc = newHandler();
+			l.lock();
+			sparesBuilding--;
+			spares.push_back(std::move(calc));
+			continue;
+		}
+
+		Session * s = runQueue.front();
+		runQueue.pop_front();
+		for (int n = 0; (n < JOBS_PER_TURN) && ( ! s->jobs.empty()); n++) {
+			Job job = std::move(s->jobs.front());
+			s->jobs.pop_front();
+			l.unlock();
+
+			response.clear();
+			handle(*s, job, response);
+			send(*job.connection, response);
+			if (job.connection->inFlight-- == MAX_IN_FLIGHT) {
+				// The reader will have stopped listening to it
+				wake();
+			}
+
+			l.lock();
+			totalBytes -= s->bytes;
+			s->bytes = estimateBytes(*s);
+			totalBytes += s->bytes;
+			peakBytes = std::max(peakBytes, totalBytes);
+		}
+
+		if ( ! s->jobs.empty()) {
+			runQueue.push_back(s);
+		}
+		else {
+			s->scheduled = false;
+			if ( ! s->calc) {
+				remove(s);
+			}
+		}
+		trim(dropped);
+		if ( ! dropped.empty()) {
+			// Freeing them takes a little while
+			l.unlock();
+			dropped.clear();
+			l.lock();
+		}
+	}
+	l.unlock();
+	mpfr_free_cache();
+}
+
+void CalcServer::handle(Session & s, Job & job, std::string & response)
+{
+	Status status = statusOk;
+	ErrorCode firstError = NoError;
+
+	if (job.type == requestKeys) {
+		if ( ! s.calc) {
+			status = statusNewSession;
+			{
+				std::lock_guard<std::mutex> l(lock);
+				sessionsCreated++;
+				if ( ! spares.empty()) {
+					s.calc = std::move(spares.back());
+					spares.pop_back();
+					totalBytes -= handlerBytes;
+				}
+			}
+			if ( ! s.calc) {
+				s.calc = newHandler();
+			}
+		}
+
+		const std::string & keys = job.keys;
+		size_t i = 0;
+		while (i < keys.length()) {
+			if (isspace((unsigned char) keys[i])) {
+				i++;
+				continue;
+			}
+			size_t start = i;
+			while ((i < keys.length()) && ( ! isspace((unsigned char) keys[i]))) {
+				i++;
+			}
+			ErrorCode ec = s.calc->keypressWord(keys.substr(start, i - start));
+			if (firstError == NoError) {
+				firstError = ec;
+			}
+		}
+	}
+	else if (job.type == requestClose) {
+		if (s.calc) {
+			s.calc.reset();
+		}
+		else {
+			status = statusUnknownSession;
+		}
+	}
+	else {
+		status = statusBadRequest;
+	}
+
+	std::string x = s.calc ? s.calc->getParseableX() : "";
+	uint32_t depth = s.calc ? s.calc->getStackView().size() : 0;
+	putU32(response, RESPONSE_HEADER_BYTES + x.length());
+	putU32(response, job.id);
+	putU8(response, status);
+	putU8(response, firstError);
+	putU32(response, depth);
+	response += x;
+}
+
+std::unique_ptr<CommandHandler> CalcServer::newHandler()
+{
+	auto calc = std::make_unique<CommandHandler>();
+	calc->setDefaultOptions();
+	calc->setOption(SaveHistory, settings.undo);
+	if (settings.undo) {
+		calc->st.setHistoryMemory(settings.historyMemory);
+	}
+	return calc;
+}
+
+// Roughly: new sessions are measured when starting, and each value is
+// taken to be as big as it can be at the session's precision
+size_t CalcServer::estimateBytes(Session & s)
+{
+	if ( ! s.calc) {
+		return 0;
+	}
+	mpfr_prec_t bits = (mpfr_prec_t) (s.calc->getPrecision() * 3.33) + 1;
+	size_t valueBytes = sizeof(AF) + mpfr_custom_get_size(bits);
+	return handlerBytes + s.calc->getStackView().size() * valueBytes;
+}
+
+// Gets back under the memory limit, spares first and then sessions
+// that nobody's using, least recently used first
+void CalcServer::trim(std::vector<std::unique_ptr<CommandHandler> > & dropped)
+{
+	while ((totalBytes > settings.memoryLimit) && ( ! spares.empty())) {
+		dropped.push_back(std::move(spares.back()));
+		spares.pop_back();
+		totalBytes -= handlerBytes;
+	}
+	auto it = lru.begin();
+	while ((totalBytes > settings.memoryLimit) && (it != lru.end())) {
+		Session * s = *it;
+		it++;
+		if (s->scheduled) {
+			continue;
+		}
+		if (s->calc) {
+			dropped.push_back(std::move(s->calc));
+			sessionsEvicted++;
+		}
+		remove(s);
+	}
+}
+
+void CalcServer::evictIdle()
+{
+	std::vector<std::unique_ptr<CommandHandler> > dropped;
+	{
+		std::lock_guard<std::mutex> l(lock);
+		Clock::time_point cutoff = Clock::now() - std::chrono::seconds(settings.idleSeconds);
+		auto it = lru.begin();
+		while ((it != lru.end()) && ((*it)->lastUsed < cutoff)) {
+			Session * s = *it;
+			it++;
+			if (s->scheduled) {
+				continue;
+			}
+			if (s->calc) {
+				dropped.push_back(std::move(s->calc));
+				sessionsEvicted++;
+			}
+			remove(s);
+		}
+	}
+	if ( ! dropped.empty()) {
+		// There may be room for spares again
+		workWaiting.notify_all();
+	}
+}
+
+// With lock held
+void CalcServer::remove(Session * s)
+{
+	totalBytes -= s->bytes;
+	lru.erase(s->lruPosition);
+	sessions.erase(s->id);
+}
+
+void CalcServer::send(Connection & c, const std::string & data)
+{
+	std::unique_lock<std::mutex> l(c.writeLock);
+	c.out += data;
+	if (c.sending) {
+		// Whoever's sending will pick it up
+		return;
+	}
+	c.sending = true;
+
+	std::string chunk;
+	while (( ! c.out.empty()) && ( ! c.broken)) {
+		chunk.clear();
+		chunk.swap(c.out);
+		l.unlock();
+
+		size_t sent = 0;
+		bool ok = true;
+		while (ok && (sent < chunk.length())) {
+			ssize_t n = ::send(c.fd, chunk.data() + sent, chunk.length() - sent, MSG_NOSIGNAL);
+			if (n >= 0) {
+				sent += n;
+			}
+			else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				pollfd p = {c.fd, POLLOUT, 0};
+				ok = (poll(&p, 1, SEND_TIMEOUT_MS) > 0);
+			}
+			else if (errno != EINTR) {
+				ok = false;
+			}
+		}
+
+		l.lock();
+		if ( ! ok) {
+			// Let the reader see it's gone
+			c.broken = true;
+			shutdown(c.fd, SHUT_RDWR);
+		}
+	}
+	c.out.clear();
+	c.sending = false;
+}
+
+void CalcServer::printSummary()
+{
+	std::lock_guard<std::mutex> l(lock);
+	std::cerr << requests << " requests, " << sessionsCreated << " sessions started, "
+		<< sessionsEvicted << " evicted, " << sessions.size() << " still open, peak memory about "
+		<< (peakBytes >> 10) << " KiB" << std::endl;
+
+	LimbPoolStats total = {};
+	for (auto & p : poolStats) {
+		total.allocations += p.allocations;
+		total.poolHits += p.poolHits;
+		total.released += p.released;
+	}
+	if (total.allocations > 0) {
+		std::cerr << "Limb pool: " << total.allocations << " allocations, "
+			<< (100 * total.poolHits / total.allocations) << "% reused, "
+			<< total.released << " blocks given back" << std::endl;
+	}
+}
@@ -0,0 +1,153 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CALCSERVER_H
+#define CALCSERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "commands.h"
+#include "limbpool.h"
+
+/* Keeps CommandHandler sessions for any number of clients, so that they
+ * don't each have to set one up (which takes a while, mostly building
+ * the conversion tables).  See protocol.h for what goes over the socket.
+ *
+ * One thread reads requests from every connection and queues them on
+ * their sessions; a pool of workers takes sessions that have requests
+ * waiting and does them in order.  A session is only worked on by one
+ * worker at a time, so its CommandHandler needs no locking.
+ *
+ * Sessions that haven't been used for the idle time, or the least
+ * recently used ones when the estimated memory use goes over the limit,
+ * are thrown away.  Idle workers keep a few spare CommandHandlers ready
+ * for new sessions.
+ */
+class CalcServer
+{
+	public:
+		typedef struct _Settings {
+			std::string socketPath;
+			size_t threads = 0;                 // 0 for one per core
+			size_t memoryLimit = 256 << 20;     // Bytes, estimated
+			int idleSeconds = 0;                // 0 to keep sessions until the limit's reached
+			size_t spares = 4;
+			bool undo = false;
+			size_t historyMemory = 64 << 10;    // Per session, with undo
+		} Settings;
+
+		CalcServer(const Settings & s);
+		~CalcServer();
+		CalcServer(const CalcServer &) = delete;
+		CalcServer & operator=(const CalcServer &) = delete;
+
+		// Binds the socket and starts the workers
+		bool start(std::string & error);
+		// Serves requests until stop() is called
+		void run();
+		// Safe to call from a signal handler
+		void stop();
+
+		void printSummary();
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		typedef struct _Connection {
+			int fd;
+			std::string in;
+			std::atomic<size_t> inFlight{0};
+
+			// Responses waiting to be sent, by whichever worker is
+			// already sending (if any)
+			std::mutex writeLock;
+			std::string out;
+			bool sending = false;
+			bool broken = false;
+
+			~_Connection();
+		} Connection;
+
+		typedef struct _Job {
+			std::shared_ptr<Connection> connection;
+			uint32_t id;
+			uint8_t type;
+			std::string keys;
+		} Job;
+
+		typedef struct _Session {
+			uint64_t id;
+			std::unique_ptr<CommandHandler> calc;
+			std::deque<Job> jobs;
+			bool scheduled = false; // On runQueue or being worked on
+			size_t bytes = 0;
+			Clock::time_point lastUsed;
+			std::list<struct _Session *>::iterator lruPosition;
+		} Session;
+
+		void workerLoop(size_t worker);
+		void handle(Session & s, Job & job, std::string & response);
+		std::unique_ptr<CommandHandler> newHandler();
+		size_t estimateBytes(Session & s);
+		void submit(uint64_t session, Job && job);
+		void trim(std::vector<std::unique_ptr<CommandHandler> > & dropped);
+		void evictIdle();
+		void remove(Session * s);
+
+		bool readFrom(const std::shared_ptr<Connection> & c);
+		bool parseFrames(const std::shared_ptr<Connection> & c);
+		void send(Connection & c, const std::string & data);
+		void wake();
+
+		Settings settings;
+		int listenFd = -1;
+		int wakeFds[2] = {-1, -1};
+		std::atomic<bool> stopping{false};
+		std::vector<std::thread> workers;
+		std::vector<std::shared_ptr<Connection> > connections;
+
+		// Everything below is protected by lock
+		std::mutex lock;
+		std::condition_variable workWaiting;
+		std::unordered_map<uint64_t, std::unique_ptr<Session> > sessions;
+		std::list<Session *> lru;           // Least recently used first
+		std::deque<Session *> runQueue;
+		std::vector<std::unique_ptr<CommandHandler> > spares;
+		size_t sparesBuilding = 0;
+		size_t totalBytes = 0;
+		size_t handlerBytes = 0;            // Estimated size of a new session
+
+		uint64_t requests = 0;
+		uint64_t sessionsCreated = 0;
+		uint64_t sessionsEvicted = 0;
+		size_t peakBytes = 0;
+		std::vector<LimbPoolStats> poolStats; // Per worker, as of when it last went idle
+};
+
+#endif
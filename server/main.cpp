@@ -0,0 +1,111 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <signal.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+
+#include "calcserver.h"
+#include "protocol.h"
+
+static CalcServer * running = NULL;
+
+static void onSignal(int)
+{
+	if (running != NULL) {
+		running->stop();
+	}
+}
+
+static void usage(const char * name)
+{
+	CalcServer::Settings defaults;
+	std::cerr << "Usage: " << name << " [options]" << std::endl
+		<< std::endl
+		<< "Keeps calculator sessions for clients connecting to a Unix domain socket." << std::endl
+		<< std::endl
+		<< "  --socket PATH     Where to listen (default " << defaultSocketPath() << ")" << std::endl
+		<< "  --threads N       Worker threads (default one per core)" << std::endl
+		<< "  --memory MB       Evict the least recently used sessions above about this" << std::endl
+		<< "                    much memory (default " << (defaults.memoryLimit >> 20) << ")" << std::endl
+		<< "  --idle SECONDS    Evict sessions that haven't been used for this long" << std::endl
+		<< "  --spares N        New sessions to keep ready (default " << defaults.spares << ")" << std::endl
+		<< "  --undo            Keep undo history in each session" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	CalcServer::Settings settings;
+	settings.socketPath = defaultSocketPath();
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--undo") {
+			settings.undo = true;
+		}
+		else if ((arg == "--socket") && (i + 1 < argc)) {
+			settings.socketPath = argv[++i];
+		}
+		else if (((arg == "--threads") || (arg == "--memory") || (arg == "--idle") || (arg == "--spares"))
+				&& (i + 1 < argc)) {
+			long v = atol(argv[++i]);
+			if ((v < 0) || ((v == 0) && (arg == "--memory"))) {
+				usage(argv[0]);
+				return 2;
+			}
+			if (arg == "--threads") {
+				settings.threads = v;
+			}
+			else if (arg == "--memory") {
+				settings.memoryLimit = (size_t) v << 20;
+			}
+			else if (arg == "--idle") {
+				settings.idleSeconds = (int) v;
+			}
+			else {
+				settings.spares = v;
+			}
+		}
+		else if ((arg == "-h") || (arg == "--help")) {
+			usage(argv[0]);
+			return 0;
+		}
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	CalcServer server(settings);
+	std::string error;
+	if ( ! server.start(error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	running = &server;
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::cerr << "Listening on " << settings.socketPath << std::endl;
+	server.run();
+
+	running = NULL;
+	server.printSummary();
+	return 0;
+}
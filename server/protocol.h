@@ -0,0 +1,104 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+/* What the calculation server and its clients send each other over the
+ * socket.  Every message is a frame: a 32-bit length and then that many
+ * bytes.  All numbers are little endian.
+ *
+ * Request:  id (32 bits), type (8 bits), session (64 bits), then the
+ *           rest of the frame is the keys, separated by white space, as
+ *           CommandHandler::keypressWord() takes them.
+ * Response: id (32 bits), status (8 bits), error (8 bits, an ErrorCode),
+ *           depth (32 bits), then the rest of the frame is X in full.
+ *
+ * A client can send any number of requests before reading the responses
+ * (up to MAX_IN_FLIGHT are worked on at once; the server stops reading
+ * after that).  Requests for the same session are done in the order
+ * they're sent, but responses for different sessions can come back in
+ * any order, so they're matched up by id.
+ */
+
+typedef enum _RequestType : uint8_t {
+	requestKeys = 1,   // Press the keys, creating the session if needed
+	requestClose = 2,  // Finish with the session
+} RequestType;
+
+typedef enum _Status : uint8_t {
+	statusOk = 0,
+	// The session didn't exist (or had been evicted), so this request
+	// started a new one
+	statusNewSession = 1,
+	statusUnknownSession = 2,
+	statusBadRequest = 3,
+} Status;
+
+static const size_t LENGTH_BYTES = 4;
+static const size_t REQUEST_HEADER_BYTES = 4 + 1 + 8;
+static const size_t RESPONSE_HEADER_BYTES = 4 + 1 + 1 + 4;
+// Longer frames are taken to mean the connection's out of step
+static const size_t MAX_FRAME_BYTES = 1024 * 1024;
+static const size_t MAX_IN_FLIGHT = 1024;
+
+inline void putU8(std::string & s, uint8_t v)
+{
+	s += (char) v;
+}
+
+inline void putU32(std::string & s, uint32_t v)
+{
+	for (int i = 0; i < 4; i++) {
+		s += (char) ((v >> (8 * i)) & 0xFF);
+	}
+}
+
+inline void putU64(std::string & s, uint64_t v)
+{
+	for (int i = 0; i < 8; i++) {
+		s += (char) ((v >> (8 * i)) & 0xFF);
+	}
+}
+
+inline uint32_t getU32(const char * p)
+{
+	const unsigned char * u = (const unsigned char *) p;
+	return (uint32_t) u[0] | ((uint32_t) u[1] << 8) | ((uint32_t) u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+inline uint64_t getU64(const char * p)
+{
+	return (uint64_t) getU32(p) | ((uint64_t) getU32(p + 4) << 32);
+}
+
+// $XDG_RUNTIME_DIR/arpcalc.sock or, failing that, one per user in /tmp
+inline std::string defaultSocketPath()
+{
+	const char * runtime = getenv("XDG_RUNTIME_DIR");
+	if ((runtime != NULL) && (runtime[0] != '\0')) {
+		return std::string(runtime) + "/arpcalc.sock";
+	}
+	return "/tmp/arpcalc-" + std::to_string(getuid()) + ".sock";
+}
+
+#endif
@@ -16,15 +16,144 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "arpfloat.h"
+#include "afexpr.h"
+#include "limbpool.h"
 #include <stdio.h>
+#include <limits.h>
+#include <float.h> // DBL_MANT_DIG
 #include <cmath> // std::ceil
+#include <cstdlib> // std::abs
+#include <utility> // std::move, std::swap
+#include <algorithm> // std::max, std::clamp
+#include <map>
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <deque>
+#include <charconv> // std::to_chars
+#include <string.h>
+
+/* Small values are exact in 64 bits, so they can be handed to MPFR
+ * through a 64-bit mpfr_t whose limbs live on the stack.
+ */
+static const mpfr_prec_t SMALL_PREC = 64;
+static const int SMALL_LIMBS = (SMALL_PREC + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+
+// Integers up to this magnitude are exactly representable as doubles
+static const int64_t MAX_EXACT_DOUBLE_INT = INT64_C(9007199254740992);
+
+// Below this magnitude, exactness checks based on fma could be upset by
+// subnormal error terms, so let MPFR handle it.
+static const double MIN_FAST_MAGNITUDE = 0x1p-900;
+
+static thread_local int workingDigits = AF::DEFAULT_DIGITS;
+static thread_local mpfr_rnd_t workingRounding = MPFR_RNDN;
+
+/* GMP only converts to and from long, which is 32 bits on some of the
+ * platforms we build for.
+ */
+static void mpz_set_int64(mpz_ptr z, int64_t v)
+{
+	if ((v >= LONG_MIN) && (v <= LONG_MAX)) {
+		mpz_set_si(z, (long) v);
+		return;
+	}
+	uint64_t magnitude = (v < 0) ? -(uint64_t) v : (uint64_t) v;
+	mpz_import(z, 1, 1, sizeof(magnitude), 0, 0, &magnitude);
+	if (v < 0) {
+		mpz_neg(z, z);
+	}
+}
+
+static bool mpz_get_int64(mpz_srcptr z, int64_t & v)
+{
+	if (mpz_fits_slong_p(z)) {
+		v = mpz_get_si(z);
+		return true;
+	}
+	if (mpz_sizeinbase(z, 2) > 63) {
+		return false;
+	}
+	uint64_t magnitude = 0;
+	mpz_export(&magnitude, NULL, 1, sizeof(magnitude), 0, 0, z);
+	v = (mpz_sgn(z) < 0) ? -(int64_t) magnitude : (int64_t) magnitude;
+	return true;
+}
+
+static size_t rationalBits(mpq_srcptr q)
+{
+	return mpz_sizeinbase(mpq_numref(q), 2) + mpz_sizeinbase(mpq_denref(q), 2);
+}
+
+class AF::MpfrArg
+{
+	public:
+		MpfrArg(const AF & v)
+		{
+			if (v.repr == reprMpfr) {
+				ptr = v.vptr;
+				return;
+			}
+			if (v.repr == reprRational) {
+				// Rounded once, at the value's own precision
+				mpfr_init2(tmp, v.precision);
+				mpfr_set_q(tmp, v.small.q, v.rounding_mode);
+				owned = true;
+				ptr = tmp;
+				return;
+			}
+			mpfr_custom_init(limbs, SMALL_PREC);
+			mpfr_custom_init_set(tmp, MPFR_ZERO_KIND, 0, SMALL_PREC, limbs);
+			if (v.repr == reprInt) {
+				mpfr_set_sj(tmp, v.small.i, MPFR_RNDN);
+			}
+			else {
+				mpfr_set_d(tmp, v.small.d, MPFR_RNDN);
+			}
+			ptr = tmp;
+		}
+		~MpfrArg()
+		{
+			if (owned) {
+				mpfr_clear(tmp);
+			}
+		}
+		MpfrArg(const MpfrArg &) = delete;
+		MpfrArg & operator=(const MpfrArg &) = delete;
+
+		operator mpfr_srcptr() const { return ptr; }
+
+	private:
+		mp_limb_t limbs[SMALL_LIMBS];
+		mpfr_t tmp;
+		mpfr_srcptr ptr;
+		bool owned = false;
+};
 
 
 void AF::init_mpfr()
 {
-	const int digits = 256;
-	set_precision(digits);
+	// Route the limb allocations through the pool before the first one
+	static const bool poolInstalled = (limbPoolInstall(), true);
+	(void) poolInstalled;
+
+	set_precision(workingDigits);
+	rounding_mode = workingRounding;
 	mpfr_init2(vptr, precision);
+	repr = reprMpfr;
+}
+
+void AF::init_small()
+{
+	set_precision(workingDigits);
+	rounding_mode = workingRounding;
+	vptr[0]._mpfr_prec = 0;
+	vptr[0]._mpfr_sign = 1;
+	vptr[0]._mpfr_exp = 0;
+	vptr[0]._mpfr_d = NULL;
+	repr = reprInt;
+	small.i = 0;
 }
 
 void AF::set_precision(int digits)
@@ -32,60 +161,638 @@ void AF::set_precision(int digits)
 	// This sets the class variable appropriately; it doesn't
 	// change the actual precision of the internal variable
 	// as that has to be done at initialisation
+	precision = digits_to_bits(digits);
+}
+
+mpfr_prec_t AF::digits_to_bits(int digits)
+{
+	const double log2_10 = 3.32192809488736262580;
+	return std::ceil(std::clamp(digits, MIN_DIGITS, MAX_DIGITS) * log2_10);
+}
+
+void AF::setWorkingDigits(int digits)
+{
+	workingDigits = std::clamp(digits, MIN_DIGITS, MAX_DIGITS);
+}
+
+int AF::getWorkingDigits()
+{
+	return workingDigits;
+}
+
+void AF::setWorkingRounding(mpfr_rnd_t rounding)
+{
+	workingRounding = rounding;
+}
+
+mpfr_rnd_t AF::getWorkingRounding()
+{
+	return workingRounding;
+}
+
+void AF::setDigits(int digits)
+{
+	precision = digits_to_bits(digits);
+	if (repr == reprMpfr) {
+		mpfr_prec_round(vptr, precision, rounding_mode);
+	}
+	else if ((repr == reprRational) && (rationalBits(small.q) > (size_t) precision)) {
+		promote();
+	}
+}
+
+int AF::getDigits() const
+{
 	const double log2_10 = 3.32192809488736262580;
-	precision = std::ceil(digits * log2_10);
+	return std::lround(precision / log2_10);
+}
+
+void AF::promote(mpfr_prec_t minPrec)
+{
+	// Convert a small value to MPFR at the full precision, widening
+	// to at least minPrec bits (which is always exact)
+	if (precision < minPrec) {
+		precision = minPrec;
+		if (repr == reprMpfr) {
+			mpfr_prec_round(vptr, precision, rounding_mode);
+		}
+	}
+	if (repr == reprMpfr) {
+		return;
+	}
+	static const bool poolInstalled = (limbPoolInstall(), true);
+	(void) poolInstalled;
+
+	mpfr_init2(vptr, precision);
+	if (repr == reprInt) {
+		mpfr_set_sj(vptr, small.i, rounding_mode);
+	}
+	else if (repr == reprDouble) {
+		mpfr_set_d(vptr, small.d, rounding_mode);
+	}
+	else {
+		mpfr_set_q(vptr, small.q, rounding_mode);
+		mpq_clear(small.q);
+		delete small.q;
+	}
+	repr = reprMpfr;
+}
+
+void AF::demote()
+{
+	// Convert an MPFR value back to a small one if that can be
+	// done exactly.  Used for parsed values, most of which are
+	// short integers or simple fractions.
+	if ((repr != reprMpfr) || ( ! mpfr_number_p(vptr))) {
+		return;
+	}
+	if (mpfr_integer_p(vptr) && mpfr_fits_intmax_p(vptr, MPFR_RNDN) && ( ! (mpfr_zero_p(vptr) && mpfr_signbit(vptr)))) {
+		set_small((int64_t) mpfr_get_sj(vptr, MPFR_RNDN));
+		return;
+	}
+	double d = mpfr_get_d(vptr, MPFR_RNDN);
+	if (std::isfinite(d) && (mpfr_cmp_d(vptr, d) == 0) && ( ! mpfr_zero_p(vptr))) {
+		set_small(d);
+	}
+}
+
+void AF::release()
+{
+	// Free the storage for an MPFR or rational value
+	if ((repr == reprMpfr) && (vptr[0]._mpfr_d != NULL)) {
+		mpfr_clear(vptr);
+		vptr[0]._mpfr_d = NULL;
+	}
+	else if (repr == reprRational) {
+		mpq_clear(small.q);
+		delete small.q;
+	}
+}
+
+void AF::set_small(int64_t v)
+{
+	release();
+	repr = reprInt;
+	small.i = v;
+}
+
+void AF::set_small(double v)
+{
+	// v must be finite
+	if ((v == std::trunc(v)) && (std::fabs(v) <= (double) MAX_EXACT_DOUBLE_INT) && ( ! std::signbit(v))) {
+		set_small((int64_t) v);
+		return;
+	}
+	release();
+	repr = reprDouble;
+	small.d = v;
+}
+
+void AF::set_rational(mpq_ptr q, mpfr_prec_t prec)
+{
+	// Takes the value of q (which must be canonical and not alias this
+	// value) in the simplest form that holds it exactly.  Anything too
+	// big for the precision is rounded to MPFR instead: the size of a
+	// rational can grow without limit in a long calculation.
+	precision = prec;
+	mpz_srcptr num = mpq_numref(q);
+	mpz_srcptr den = mpq_denref(q);
+	int64_t i;
+	if ((mpz_cmp_ui(den, 1) == 0) && mpz_get_int64(num, i)) {
+		set_small(i);
+		return;
+	}
+	if ((mpz_popcount(den) == 1) && (mpz_sizeinbase(num, 2) <= DBL_MANT_DIG)) {
+		// A dyadic fraction that fits in a double's mantissa
+		unsigned long shift = mpz_scan1(den, 0);
+		if (shift < 1000) {
+			set_small(std::ldexp(mpz_get_d(num), -(int) shift));
+			return;
+		}
+	}
+	if (rationalBits(q) <= (size_t) prec) {
+		if (repr != reprRational) {
+			release();
+			small.q = new __mpq_struct;
+			mpq_init(small.q);
+			repr = reprRational;
+		}
+		mpq_swap(small.q, q);
+		return;
+	}
+	if (repr == reprMpfr) {
+		mpfr_set_prec(vptr, prec);
+	}
+	else {
+		release();
+		mpfr_init2(vptr, prec);
+		repr = reprMpfr;
+	}
+	mpfr_set_q(vptr, q, rounding_mode);
+}
+
+bool AF::small_as_double(double & d) const
+{
+	if (repr == reprDouble) {
+		d = small.d;
+		return true;
+	}
+	if ((repr == reprInt) && (small.i >= -MAX_EXACT_DOUBLE_INT) && (small.i <= MAX_EXACT_DOUBLE_INT)) {
+		d = (double) small.i;
+		return true;
+	}
+	return false;
+}
+
+mpq_srcptr AF::as_rational(mpq_ptr tmp) const
+{
+	// The exact value of a value that isn't MPFR, converted into tmp
+	// if it isn't already a rational
+	if (repr == reprRational) {
+		return small.q;
+	}
+	if (repr == reprInt) {
+		mpz_set_int64(mpq_numref(tmp), small.i);
+		mpz_set_ui(mpq_denref(tmp), 1);
+	}
+	else {
+		mpq_set_d(tmp, small.d);
+	}
+	return tmp;
+}
+
+bool AF::isSmall() const
+{
+	return repr != reprMpfr;
+}
+
+AF AF::with_precision(mpfr_prec_t prec)
+{
+	// An MPFR zero to hold the result of an operation
+	AF r;
+	r.precision = prec;
+	r.promote();
+	return r;
+}
+
+bool AF::fast_add(const AF & a, const AF & b, AF & r)
+{
+	const mpfr_prec_t prec = std::max(a.precision, b.precision);
+	if ((a.repr == reprInt) && (b.repr == reprInt)) {
+		int64_t v;
+		if (__builtin_add_overflow(a.small.i, b.small.i, &v)) {
+			return false;
+		}
+		r.set_small(v);
+		r.precision = prec;
+		return true;
+	}
+	double x, y;
+	if (( ! a.small_as_double(x)) || ( ! b.small_as_double(y))) {
+		return exact_op(a, b, r, mpq_add);
+	}
+	// TwoSum: the sum is exact if the rounding error is zero
+	double s = x + y;
+	if ( ! std::isfinite(s)) {
+		return false;
+	}
+	double bb = s - x;
+	double err = (x - (s - bb)) + (y - bb);
+	if (err != 0.0) {
+		return false;
+	}
+	r.set_small(s);
+	r.precision = prec;
+	return true;
+}
+
+bool AF::fast_sub(const AF & a, const AF & b, AF & r)
+{
+	const mpfr_prec_t prec = std::max(a.precision, b.precision);
+	if ((a.repr == reprInt) && (b.repr == reprInt)) {
+		int64_t v;
+		if (__builtin_sub_overflow(a.small.i, b.small.i, &v)) {
+			return false;
+		}
+		r.set_small(v);
+		r.precision = prec;
+		return true;
+	}
+	double x, y;
+	if (( ! a.small_as_double(x)) || ( ! b.small_as_double(y))) {
+		return exact_op(a, b, r, mpq_sub);
+	}
+	double s = x - y;
+	if ( ! std::isfinite(s)) {
+		return false;
+	}
+	double bb = s - x;
+	double err = (x - (s - bb)) + ((-y) - bb);
+	if (err != 0.0) {
+		return false;
+	}
+	r.set_small(s);
+	r.precision = prec;
+	return true;
+}
+
+bool AF::fast_mul(const AF & a, const AF & b, AF & r)
+{
+	const mpfr_prec_t prec = std::max(a.precision, b.precision);
+	if ((a.repr == reprInt) && (b.repr == reprInt)) {
+		int64_t v;
+		if (__builtin_mul_overflow(a.small.i, b.small.i, &v)) {
+			return false;
+		}
+		if ((v == 0) && ((a.small.i < 0) || (b.small.i < 0))) {
+			// MPFR gives a negative zero here
+			r.set_small(-0.0);
+			r.precision = prec;
+		}
+		else {
+			r.set_small(v);
+			r.precision = prec;
+		}
+		return true;
+	}
+	double x, y;
+	if (( ! a.small_as_double(x)) || ( ! b.small_as_double(y))) {
+		return exact_op(a, b, r, mpq_mul);
+	}
+	double p = x * y;
+	if ( ! std::isfinite(p)) {
+		return false;
+	}
+	if (p == 0.0) {
+		if ((x != 0.0) && (y != 0.0)) {
+			// Underflow
+			return false;
+		}
+	}
+	else if ((std::fabs(p) < MIN_FAST_MAGNITUDE) || (std::fma(x, y, -p) != 0.0)) {
+		return false;
+	}
+	r.set_small(p);
+	r.precision = prec;
+	return true;
+}
+
+bool AF::fast_div(const AF & a, const AF & b, AF & r)
+{
+	const mpfr_prec_t prec = std::max(a.precision, b.precision);
+	if ((a.repr == reprInt) && (b.repr == reprInt)) {
+		if ((b.small.i == 0) || ((a.small.i == INT64_MIN) && (b.small.i == -1))) {
+			return false;
+		}
+		if ((a.small.i % b.small.i) != 0) {
+			return exact_op(a, b, r, mpq_div);
+		}
+		if ((a.small.i == 0) && (b.small.i < 0)) {
+			r.set_small(-0.0);
+			r.precision = prec;
+		}
+		else {
+			r.set_small(a.small.i / b.small.i);
+			r.precision = prec;
+		}
+		return true;
+	}
+	double x, y;
+	if (( ! a.small_as_double(x)) || ( ! b.small_as_double(y))) {
+		return exact_op(a, b, r, mpq_div);
+	}
+	if (y == 0.0) {
+		return false;
+	}
+	double q = x / y;
+	if ( ! std::isfinite(q)) {
+		return false;
+	}
+	if (q == 0.0) {
+		if (x != 0.0) {
+			// Underflow
+			return false;
+		}
+	}
+	else if ((std::fabs(q) < MIN_FAST_MAGNITUDE) || (std::fma(q, y, -x) != 0.0)) {
+		// Not a double, but still exact as a fraction
+		return exact_op(a, b, r, mpq_div);
+	}
+	r.set_small(q);
+	r.precision = prec;
+	return true;
+}
+
+bool AF::exact_op(const AF & a, const AF & b, AF & r, void (*op)(mpq_ptr, mpq_srcptr, mpq_srcptr))
+{
+	// Rational arithmetic, which is always exact.  Anything involving
+	// an MPFR value (or dividing by zero) is left to MPFR.
+	if ((a.repr == reprMpfr) || (b.repr == reprMpfr) || ((op == mpq_div) && b.isZero())) {
+		return false;
+	}
+	mpq_t x, y, q;
+	mpq_init(x);
+	mpq_init(y);
+	mpq_init(q);
+	op(q, a.as_rational(x), b.as_rational(y));
+	auto negative = [](const AF & v) { return (v.repr == reprDouble) ? std::signbit(v.small.d) : (v.sign() < 0); };
+	if ((mpq_sgn(q) == 0) && ((op == mpq_mul) || (op == mpq_div)) && (negative(a) != negative(b))) {
+		// MPFR gives a negative zero here
+		r.set_small(-0.0);
+		r.precision = std::max(a.precision, b.precision);
+	}
+	else {
+		r.set_rational(q, std::max(a.precision, b.precision));
+	}
+	mpq_clear(x);
+	mpq_clear(y);
+	mpq_clear(q);
+	return true;
 }
 
 AF::AF()
 {
-	init_mpfr();
-	mpfr_set_d(vptr, 0, rounding_mode);
+	init_small();
 }
 
 AF::AF(const AF& v)
 {
-	init_mpfr();
-	mpfr_set(vptr, v.vptr, rounding_mode);
+	init_small();
+	precision = v.precision;
+	rounding_mode = v.rounding_mode;
+	if (v.repr == reprMpfr) {
+		mpfr_init2(vptr, precision);
+		mpfr_set(vptr, v.vptr, rounding_mode);
+		repr = reprMpfr;
+	}
+	else if (v.repr == reprRational) {
+		small.q = new __mpq_struct;
+		mpq_init(small.q);
+		mpq_set(small.q, v.small.q);
+		repr = reprRational;
+	}
+	else {
+		repr = v.repr;
+		small = v.small;
+	}
+}
+
+AF::AF(AF&& v) noexcept
+{
+	// Steal the limbs from v and leave it holding a small zero
+	vptr[0] = v.vptr[0];
+	rounding_mode = v.rounding_mode;
+	precision = v.precision;
+	repr = v.repr;
+	small = v.small;
+	v.vptr[0]._mpfr_d = NULL;
+	v.repr = reprInt;
+	v.small.i = 0;
 }
 
 AF::AF(double v)
 {
-	init_mpfr();
-	mpfr_set_d(vptr, v, rounding_mode);
+	if (std::isfinite(v)) {
+		init_small();
+		set_small(v);
+	}
+	else {
+		init_mpfr();
+		mpfr_set_d(vptr, v, rounding_mode);
+	}
 }
 
 AF::AF(long double v)
 {
 	init_mpfr();
 	mpfr_set_ld(vptr, v, rounding_mode);
+	demote();
 }
 
 AF::AF(int v)
 {
-	init_mpfr();
-	mpfr_set_d(vptr, (double) v, rounding_mode);
+	init_small();
+	small.i = v;
 }
 
 AF::AF(intmax_t v)
 {
-	init_mpfr();
-	mpfr_set_sj(vptr, v, rounding_mode);
+	init_small();
+	small.i = v;
+}
+
+typedef enum _DecimalParse {
+	decimalShort,   // Valid, with at most 19 significant digits
+	decimalLong,    // Valid, but too long to convert without MPFR
+	decimalInvalid, // Not a number (and MPFR wouldn't accept it either)
+	decimalOther,   // Something other than digits, sign, point and exponent
+} DecimalParse;
+
+// Longest mantissa that always fits in a uint64_t
+static const int MAX_SHORT_DIGITS = 19;
+// Beyond this the exponent is left to MPFR (and can't overflow a long)
+static const long MAX_SHORT_EXPONENT = 100000;
+
+static DecimalParse parseDecimal(const char *s, uint64_t & mantissa, long & exponent, bool & negative)
+{
+	// Recognise [+-]digits[.digits][(e|E)[+-]digits] in a single pass,
+	// which is the whole of mpfr_set_str's base 10 syntax apart from
+	// inf/nan, @ exponents and leading whitespace
+	mantissa = 0;
+	exponent = 0;
+	negative = false;
+	int significant = 0;
+	bool anyDigits = false;
+	bool tooLong = false;
+
+	if ((*s == '-') || (*s == '+')) {
+		negative = (*s == '-');
+		s++;
+	}
+	for ( ; (*s >= '0') && (*s <= '9'); s++) {
+		anyDigits = true;
+		if ((significant == 0) && (*s == '0')) {
+			continue;
+		}
+		if (significant < MAX_SHORT_DIGITS) {
+			mantissa = (mantissa * 10) + (*s - '0');
+		}
+		else {
+			tooLong = true;
+		}
+		significant++;
+	}
+	if (*s == '.') {
+		s++;
+		for ( ; (*s >= '0') && (*s <= '9'); s++) {
+			anyDigits = true;
+			if ((significant == 0) && (*s == '0')) {
+				exponent--;
+				continue;
+			}
+			if (significant < MAX_SHORT_DIGITS) {
+				mantissa = (mantissa * 10) + (*s - '0');
+				exponent--;
+			}
+			else {
+				tooLong = true;
+			}
+			significant++;
+		}
+	}
+	if ( ! anyDigits) {
+		return ((*s == '\0') || (strchr("eE.+-", *s) != NULL)) ? decimalInvalid : decimalOther;
+	}
+
+	if ((*s == 'e') || (*s == 'E')) {
+		s++;
+		bool negativeExponent = false;
+		if ((*s == '-') || (*s == '+')) {
+			negativeExponent = (*s == '-');
+			s++;
+		}
+		if ( ! ((*s >= '0') && (*s <= '9'))) {
+			return (*s == '\0') || (strchr("eE.+-", *s) != NULL) ? decimalInvalid : decimalOther;
+		}
+		long e = 0;
+		for ( ; (*s >= '0') && (*s <= '9'); s++) {
+			if (e <= MAX_SHORT_EXPONENT) {
+				e = (e * 10) + (*s - '0');
+			}
+		}
+		if (e > MAX_SHORT_EXPONENT) {
+			tooLong = true;
+		}
+		exponent += negativeExponent ? -e : e;
+	}
+
+	if (*s != '\0') {
+		return (strchr("0123456789eE.+-", *s) != NULL) ? decimalInvalid : decimalOther;
+	}
+	return tooLong ? decimalLong : decimalShort;
+}
+
+bool AF::set_decimal(uint64_t mantissa, long exponent, bool negative)
+{
+	// Exactly mantissa * 10^exponent, held as a rational (or rounded
+	// once if it's too big for that, so the same result as
+	// mpfr_set_str).  Returns false if it needs MPFR to parse it.
+	if ((exponent >= 0) && ((mantissa != 0) || ( ! negative))) {
+		uint64_t v = mantissa;
+		long i;
+		for (i = 0; (i < exponent) && (v <= (uint64_t) INT64_MAX / 10); i++) {
+			v *= 10;
+		}
+		if ((i == exponent) && (v <= (uint64_t) INT64_MAX)) {
+			set_small(negative ? -(int64_t) v : (int64_t) v);
+			return true;
+		}
+	}
+
+	if (mantissa == 0) {
+		set_small(negative ? -0.0 : 0.0);
+		return true;
+	}
+
+	// 10^n needs about 3.32n bits
+	long n = (exponent < 0) ? -exponent : exponent;
+	if ((double) n * 3.33 > (double) precision) {
+		return false;
+	}
+
+	mpq_t q;
+	mpq_init(q);
+	mpz_ptr num = mpq_numref(q);
+	mpz_ptr den = mpq_denref(q);
+	mpz_import(num, 1, 1, sizeof(mantissa), 0, 0, &mantissa);
+	if (negative) {
+		mpz_neg(num, num);
+	}
+	if (exponent > 0) {
+		mpz_t scale;
+		mpz_init(scale);
+		mpz_ui_pow_ui(scale, 10, n);
+		mpz_mul(num, num, scale);
+		mpz_clear(scale);
+	}
+	else {
+		mpz_ui_pow_ui(den, 10, n);
+	}
+	mpq_canonicalize(q);
+	set_rational(q, precision);
+	mpq_clear(q);
+	return true;
 }
 
 AF::AF(std::string v)
 {
-	init_mpfr();
+	init_small();
+
+	uint64_t mantissa;
+	long exponent;
+	bool negative;
+	if ((parseDecimal(v.c_str(), mantissa, exponent, negative) == decimalShort)
+			&& set_decimal(mantissa, exponent, negative)) {
+		return;
+	}
+
+	promote();
 	mpfr_set_str(vptr, v.c_str(), 10, rounding_mode);
+	demote();
 }
 
 AF::~AF()
 {
-	mpfr_clear(vptr);
+	release();
 }
 
 AF& AF::operator=(AF other)
 {
-	mpfr_swap(vptr, other.vptr);
+	std::swap(vptr[0], other.vptr[0]);
+	std::swap(precision, other.precision);
+	std::swap(rounding_mode, other.rounding_mode);
+	std::swap(repr, other.repr);
+	std::swap(small, other.small);
 	return *this;
 }
 
@@ -109,24 +816,46 @@ bool AF::equals(const std::string other) const
 	return compareTo(other) == 0;
 }
 
-bool AF::equals(const AF other) const
+bool AF::equals(const AF & other) const
 {
 	return compareTo(other) == 0;
 }
 
 int AF::compareTo(const int other) const
 {
-	return compareTo(AF(other));
+	return compareTo((intmax_t) other);
 }
 
 int AF::compareTo(const intmax_t other) const
 {
+	if (repr == reprInt) {
+		return (small.i > other) - (small.i < other);
+	}
+	if ((repr == reprDouble) && (other >= -MAX_EXACT_DOUBLE_INT) && (other <= MAX_EXACT_DOUBLE_INT)) {
+		return (small.d > (double) other) - (small.d < (double) other);
+	}
+	if ((other >= LONG_MIN) && (other <= LONG_MAX)) {
+		if (repr == reprRational) {
+			return mpq_cmp_si(small.q, (long) other, 1);
+		}
+		return mpfr_cmp_si(MpfrArg(*this), (long) other);
+	}
 	return compareTo(AF(other));
 }
 
 int AF::compareTo(const double other) const
 {
-	return compareTo(AF(other));
+	// Like mpfr_cmp, this gives 0 if either side is NaN
+	if (repr == reprDouble) {
+		return (small.d > other) - (small.d < other);
+	}
+	if ((repr == reprInt) && (small.i >= -MAX_EXACT_DOUBLE_INT) && (small.i <= MAX_EXACT_DOUBLE_INT)) {
+		return ((double) small.i > other) - ((double) small.i < other);
+	}
+	if ((repr == reprRational) && std::isfinite(other)) {
+		return compareTo(AF(other));
+	}
+	return mpfr_cmp_d(MpfrArg(*this), other);
 }
 
 int AF::compareTo(const std::string other) const
@@ -134,394 +863,1754 @@ int AF::compareTo(const std::string other) const
 	return compareTo(AF(other));
 }
 
-int AF::compareTo(const AF other) const
+int AF::compareTo(const AF & other) const
 {
-	return mpfr_cmp(vptr, other.vptr);
+	if ((repr == reprInt) && (other.repr == reprInt)) {
+		return (small.i > other.small.i) - (small.i < other.small.i);
+	}
+	double x, y;
+	if (small_as_double(x) && other.small_as_double(y)) {
+		return (x > y) - (x < y);
+	}
+	if ((repr != reprMpfr) && (other.repr != reprMpfr)) {
+		mpq_t tx, ty;
+		mpq_init(tx);
+		mpq_init(ty);
+		int c = mpq_cmp(as_rational(tx), other.as_rational(ty));
+		mpq_clear(tx);
+		mpq_clear(ty);
+		return c;
+	}
+	if (other.repr == reprRational) {
+		return mpfr_cmp_q(MpfrArg(*this), other.small.q);
+	}
+	if (repr == reprRational) {
+		return -mpfr_cmp_q(other.vptr, small.q);
+	}
+	return mpfr_cmp(MpfrArg(*this), MpfrArg(other));
 }
 
-AF AF::unaryMinus()
+bool AF::isZero() const
 {
-	AF zero(0);
-	AF r;
-	mpfr_sub(r.vptr, zero.vptr, vptr, rounding_mode);
-	return r;
+	switch (repr) {
+		case reprInt:
+			return small.i == 0;
+		case reprDouble:
+			return small.d == 0.0;
+		case reprRational:
+			return false;
+		default:
+			return mpfr_zero_p(vptr);
+	}
 }
 
-AF AF::minus(AF b)
+bool AF::isFinite() const
 {
-	AF r;
-	mpfr_sub(r.vptr, vptr, b.vptr, rounding_mode);
+	switch (repr) {
+		case reprInt:
+		case reprRational:
+			return true;
+		case reprDouble:
+			return std::isfinite(small.d);
+		default:
+			return mpfr_number_p(vptr);
+	}
+}
+
+int AF::sign() const
+{
+	switch (repr) {
+		case reprInt:
+			return (small.i > 0) - (small.i < 0);
+		case reprDouble:
+			return (small.d > 0.0) - (small.d < 0.0);
+		case reprRational:
+			return mpq_sgn(small.q);
+		default:
+			return mpfr_sgn(vptr);
+	}
+}
+
+AF AF::scalar(double v) const
+{
+	// A scalar operand takes on this value's precision so it
+	// doesn't widen the result
+	AF r(v);
+	r.precision = precision;
 	return r;
 }
 
-AF AF::minus(double b)
+AF AF::scalar(intmax_t v) const
 {
-	AF r;
-	AF ba(b);
-	mpfr_sub(r.vptr, vptr, ba.vptr, rounding_mode);
+	AF r(v);
+	r.precision = precision;
 	return r;
 }
 
+AF AF::unaryMinus() const &
+{
+	return AF(*this).unaryMinus();
+}
 
-AF AF::times(AF b)
+AF AF::unaryMinus() &&
 {
-	AF r;
-	mpfr_mul(r.vptr, vptr, b.vptr, rounding_mode);
-	return r;
+	if ((repr == reprInt) && (small.i != INT64_MIN)) {
+		small.i = -small.i;
+	}
+	else if (repr == reprDouble) {
+		set_small(0.0 - small.d);
+	}
+	else if (repr == reprRational) {
+		mpq_neg(small.q, small.q);
+	}
+	else {
+		promote();
+		mpfr_ui_sub(vptr, 0, vptr, rounding_mode);
+	}
+	return std::move(*this);
 }
 
-AF AF::times(double b)
+AF AF::minus(const AF & b) const &
 {
 	AF r;
-	AF ba(b);
-	mpfr_mul(r.vptr, vptr, ba.vptr, rounding_mode);
+	if ( ! fast_sub(*this, b, r)) {
+		r = with_precision(std::max(precision, b.precision));
+		mpfr_sub(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	}
 	return r;
 }
 
+AF AF::minus(const AF & b) &&
+{
+	if ( ! fast_sub(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_sub(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return std::move(*this);
+}
+
+AF AF::minus(AF && b) const &
+{
+	if ( ! fast_sub(*this, b, b)) {
+		b.promote(precision);
+		mpfr_sub(b.vptr, MpfrArg(*this), b.vptr, rounding_mode);
+	}
+	return std::move(b);
+}
 
-AF AF::plus(AF b)
+AF AF::minus(AF && b) &&
 {
-	AF r;
-	mpfr_add(r.vptr, vptr, b.vptr, rounding_mode);
-	return r;
+	return std::move(*this).minus(static_cast<const AF &>(b));
 }
 
-AF AF::plus(double b)
+AF AF::minus(double b) const &
 {
-	AF r;
-	AF ba(b);
-	mpfr_add(r.vptr, vptr, ba.vptr, rounding_mode);
-	return r;
+	if (repr == reprMpfr) {
+		AF r = with_precision(precision);
+		mpfr_sub_d(r.vptr, vptr, b, rounding_mode);
+		return r;
+	}
+	return minus(scalar(b));
 }
 
+AF AF::minus(double b) &&
+{
+	if (repr == reprMpfr) {
+		mpfr_sub_d(vptr, vptr, b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).minus(scalar(b));
+}
 
-AF AF::div(AF b)
+AF AF::minus(int b) const &
 {
-	AF r;
-	mpfr_div(r.vptr, vptr, b.vptr, rounding_mode);
-	return r;
+	return minus((intmax_t) b);
 }
 
-AF AF::div(double b)
+AF AF::minus(int b) &&
 {
-	AF r;
-	AF ba(b);
-	mpfr_div(r.vptr, vptr, ba.vptr, rounding_mode);
-	return r;
+	return std::move(*this).minus((intmax_t) b);
 }
 
+AF AF::minus(intmax_t b) const &
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		AF r = with_precision(precision);
+		mpfr_sub_si(r.vptr, vptr, (long) b, rounding_mode);
+		return r;
+	}
+	return minus(scalar(b));
+}
 
-AF AF::rem(AF b)
+AF AF::minus(intmax_t b) &&
 {
-	AF r;
-	mpfr_remainder(r.vptr, vptr, b.vptr, rounding_mode);
-	return r;
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_sub_si(vptr, vptr, (long) b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).minus(scalar(b));
 }
 
-AF AF::rem(double b)
+
+AF AF::times(const AF & b) const &
 {
 	AF r;
-	AF ba(b);
-	mpfr_remainder(r.vptr, vptr, ba.vptr, rounding_mode);
+	if ( ! fast_mul(*this, b, r)) {
+		r = with_precision(std::max(precision, b.precision));
+		mpfr_mul(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	}
 	return r;
 }
 
+AF AF::times(const AF & b) &&
+{
+	if ( ! fast_mul(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_mul(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return std::move(*this);
+}
+
+AF AF::times(AF && b) const &
+{
+	if ( ! fast_mul(*this, b, b)) {
+		b.promote(precision);
+		mpfr_mul(b.vptr, MpfrArg(*this), b.vptr, rounding_mode);
+	}
+	return std::move(b);
+}
+
+AF AF::times(AF && b) &&
+{
+	return std::move(*this).times(static_cast<const AF &>(b));
+}
+
+AF AF::times(double b) const &
+{
+	if (repr == reprMpfr) {
+		AF r = with_precision(precision);
+		mpfr_mul_d(r.vptr, vptr, b, rounding_mode);
+		return r;
+	}
+	return times(scalar(b));
+}
+
+AF AF::times(double b) &&
+{
+	if (repr == reprMpfr) {
+		mpfr_mul_d(vptr, vptr, b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).times(scalar(b));
+}
+
+AF AF::times(int b) const &
+{
+	return times((intmax_t) b);
+}
+
+AF AF::times(int b) &&
+{
+	return std::move(*this).times((intmax_t) b);
+}
+
+AF AF::times(intmax_t b) const &
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		AF r = with_precision(precision);
+		mpfr_mul_si(r.vptr, vptr, (long) b, rounding_mode);
+		return r;
+	}
+	return times(scalar(b));
+}
+
+AF AF::times(intmax_t b) &&
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_mul_si(vptr, vptr, (long) b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).times(scalar(b));
+}
+
+
+AF AF::plus(const AF & b) const &
+{
+	AF r;
+	if ( ! fast_add(*this, b, r)) {
+		r = with_precision(std::max(precision, b.precision));
+		mpfr_add(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	}
+	return r;
+}
+
+AF AF::plus(const AF & b) &&
+{
+	if ( ! fast_add(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_add(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return std::move(*this);
+}
+
+AF AF::plus(AF && b) const &
+{
+	if ( ! fast_add(*this, b, b)) {
+		b.promote(precision);
+		mpfr_add(b.vptr, MpfrArg(*this), b.vptr, rounding_mode);
+	}
+	return std::move(b);
+}
+
+AF AF::plus(AF && b) &&
+{
+	return std::move(*this).plus(static_cast<const AF &>(b));
+}
+
+AF AF::plus(double b) const &
+{
+	if (repr == reprMpfr) {
+		AF r = with_precision(precision);
+		mpfr_add_d(r.vptr, vptr, b, rounding_mode);
+		return r;
+	}
+	return plus(scalar(b));
+}
+
+AF AF::plus(double b) &&
+{
+	if (repr == reprMpfr) {
+		mpfr_add_d(vptr, vptr, b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).plus(scalar(b));
+}
+
+AF AF::plus(int b) const &
+{
+	return plus((intmax_t) b);
+}
+
+AF AF::plus(int b) &&
+{
+	return std::move(*this).plus((intmax_t) b);
+}
+
+AF AF::plus(intmax_t b) const &
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		AF r = with_precision(precision);
+		mpfr_add_si(r.vptr, vptr, (long) b, rounding_mode);
+		return r;
+	}
+	return plus(scalar(b));
+}
+
+AF AF::plus(intmax_t b) &&
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_add_si(vptr, vptr, (long) b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).plus(scalar(b));
+}
+
+
+AF AF::div(const AF & b) const &
+{
+	AF r;
+	if ( ! fast_div(*this, b, r)) {
+		r = with_precision(std::max(precision, b.precision));
+		mpfr_div(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	}
+	return r;
+}
+
+AF AF::div(const AF & b) &&
+{
+	if ( ! fast_div(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_div(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return std::move(*this);
+}
+
+AF AF::div(AF && b) const &
+{
+	if ( ! fast_div(*this, b, b)) {
+		b.promote(precision);
+		mpfr_div(b.vptr, MpfrArg(*this), b.vptr, rounding_mode);
+	}
+	return std::move(b);
+}
+
+AF AF::div(AF && b) &&
+{
+	return std::move(*this).div(static_cast<const AF &>(b));
+}
+
+AF AF::div(double b) const &
+{
+	if (repr == reprMpfr) {
+		AF r = with_precision(precision);
+		mpfr_div_d(r.vptr, vptr, b, rounding_mode);
+		return r;
+	}
+	return div(scalar(b));
+}
+
+AF AF::div(double b) &&
+{
+	if (repr == reprMpfr) {
+		mpfr_div_d(vptr, vptr, b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).div(scalar(b));
+}
+
+AF AF::div(int b) const &
+{
+	return div((intmax_t) b);
+}
+
+AF AF::div(int b) &&
+{
+	return std::move(*this).div((intmax_t) b);
+}
+
+AF AF::div(intmax_t b) const &
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		AF r = with_precision(precision);
+		mpfr_div_si(r.vptr, vptr, (long) b, rounding_mode);
+		return r;
+	}
+	return div(scalar(b));
+}
+
+AF AF::div(intmax_t b) &&
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_div_si(vptr, vptr, (long) b, rounding_mode);
+		return std::move(*this);
+	}
+	return std::move(*this).div(scalar(b));
+}
+
+
+AF AF::rem(const AF & b) const &
+{
+	AF r = with_precision(std::max(precision, b.precision));
+	mpfr_remainder(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	return r;
+}
+
+AF AF::rem(const AF & b) &&
+{
+	promote(b.precision);
+	mpfr_remainder(vptr, vptr, MpfrArg(b), rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::rem(double b) const &
+{
+	return rem(AF(b));
+}
+
+AF AF::rem(double b) &&
+{
+	return std::move(*this).rem(AF(b));
+}
+
+
+AF AF::remainder(const AF & b) const &
+{
+	return rem(b);
+}
+
+AF AF::remainder(const AF & b) &&
+{
+	return std::move(*this).rem(b);
+}
+
+AF AF::remainder(double b) const &
+{
+	return rem(b);
+}
+
+AF AF::remainder(double b) &&
+{
+	return std::move(*this).rem(b);
+}
+
+
+AF AF::round() const &
+{
+	return AF(*this).round();
+}
+
+AF AF::round() &&
+{
+	if (repr == reprDouble) {
+		set_small(std::round(small.d));
+	}
+	else if (repr == reprRational) {
+		round_rational(0);
+	}
+	else if (repr == reprMpfr) {
+		mpfr_round(vptr, vptr);
+	}
+	return std::move(*this);
+}
+
+void AF::reduce_precision()
+{
+	// Used in conversions where only small number of decimal places
+	// are required.  This is a bit of a crude hack, but seems to work.
+	// I mainly implemented this to deal with some strange rounding
+	// effects associated with convertHoursToHms and convertHmsToHours
+	precision -= 2;
+	if (repr == reprMpfr) {
+		mpfr_prec_round(vptr, precision, rounding_mode);
+	}
+	else if ((repr == reprRational) && (rationalBits(small.q) > (size_t) precision)) {
+		promote();
+	}
+}
+
+void AF::round_rational(int direction)
+{
+	// To an integer: downwards if direction is negative, upwards if
+	// positive and to the nearest (with halves away from zero) if zero
+	mpq_t q;
+	mpq_init(q);
+	mpq_swap(q, small.q);
+	mpz_ptr num = mpq_numref(q);
+	mpz_ptr den = mpq_denref(q);
+	const bool negative = (mpz_sgn(num) < 0);
+	if (direction < 0) {
+		mpz_fdiv_q(num, num, den);
+	}
+	else if (direction > 0) {
+		mpz_cdiv_q(num, num, den);
+	}
+	else {
+		// (2n + d) / 2d, away from zero
+		mpz_mul_2exp(num, num, 1);
+		if (negative) {
+			mpz_sub(num, num, den);
+		}
+		else {
+			mpz_add(num, num, den);
+		}
+		mpz_mul_2exp(den, den, 1);
+		mpz_tdiv_q(num, num, den);
+	}
+	mpz_set_ui(den, 1);
+	if ((mpz_sgn(num) == 0) && negative) {
+		// As MPFR, rounding a negative value to zero gives -0
+		set_small(-0.0);
+	}
+	else {
+		set_rational(q, precision);
+	}
+	mpq_clear(q);
+}
+
+AF AF::floor() const &
+{
+	return AF(*this).floor();
+}
+
+AF AF::floor() &&
+{
+	if (repr == reprDouble) {
+		set_small(std::floor(small.d));
+	}
+	else if (repr == reprRational) {
+		round_rational(-1);
+	}
+	else if (repr == reprMpfr) {
+		mpfr_floor(vptr, vptr);
+	}
+	return std::move(*this);
+}
+
+AF AF::ceil() const &
+{
+	return AF(*this).ceil();
+}
+
+AF AF::ceil() &&
+{
+	if (repr == reprDouble) {
+		set_small(std::ceil(small.d));
+	}
+	else if (repr == reprRational) {
+		round_rational(1);
+	}
+	else if (repr == reprMpfr) {
+		mpfr_ceil(vptr, vptr);
+	}
+	return std::move(*this);
+}
+
+AF AF::pow(const AF & b) const &
+{
+	AF r = with_precision(std::max(precision, b.precision));
+	mpfr_pow(r.vptr, MpfrArg(*this), MpfrArg(b), rounding_mode);
+	return r;
+}
+
+AF AF::pow(const AF & b) &&
+{
+	promote(b.precision);
+	mpfr_pow(vptr, vptr, MpfrArg(b), rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::pow(AF && b) const &
+{
+	b.promote(precision);
+	mpfr_pow(b.vptr, MpfrArg(*this), b.vptr, rounding_mode);
+	return std::move(b);
+}
+
+AF AF::pow(AF && b) &&
+{
+	return std::move(*this).pow(static_cast<const AF &>(b));
+}
+
+
+AF AF::sqrt() const &
+{
+	AF r = with_precision(precision);
+	mpfr_sqrt(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::sqrt() &&
+{
+	promote();
+	mpfr_sqrt(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::cbrt() const &
+{
+	AF r = with_precision(precision);
+	mpfr_cbrt(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::cbrt() &&
+{
+	promote();
+	mpfr_cbrt(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::root(const AF & p) const &
+{
+	AF power = AF(1).div(p);
+	AF r = with_precision(std::max(precision, p.precision));
+	mpfr_pow(r.vptr, MpfrArg(*this), MpfrArg(power), rounding_mode);
+	return r;
+}
+
+AF AF::root(const AF & p) &&
+{
+	AF power = AF(1).div(p);
+	promote(p.precision);
+	mpfr_pow(vptr, vptr, MpfrArg(power), rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::root(double p) const &
+{
+	return root(AF(p));
+}
+
+AF AF::root(double p) &&
+{
+	return std::move(*this).root(AF(p));
+}
+
+
+AF AF::cos() const &
+{
+	AF r = with_precision(precision);
+	mpfr_cos(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::cos() &&
+{
+	promote();
+	mpfr_cos(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::sin() const &
+{
+	AF r = with_precision(precision);
+	mpfr_sin(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::sin() &&
+{
+	promote();
+	mpfr_sin(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::tan() const &
+{
+	AF r = with_precision(precision);
+	mpfr_tan(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::tan() &&
+{
+	promote();
+	mpfr_tan(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::acos() const &
+{
+	AF r = with_precision(precision);
+	mpfr_acos(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::acos() &&
+{
+	promote();
+	mpfr_acos(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::asin() const &
+{
+	AF r = with_precision(precision);
+	mpfr_asin(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::asin() &&
+{
+	promote();
+	mpfr_asin(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::atan() const &
+{
+	AF r = with_precision(precision);
+	mpfr_atan(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::atan() &&
+{
+	promote();
+	mpfr_atan(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+
+AF AF::cosh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_cosh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::cosh() &&
+{
+	promote();
+	mpfr_cosh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::sinh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_sinh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::sinh() &&
+{
+	promote();
+	mpfr_sinh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::tanh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_tanh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::tanh() &&
+{
+	promote();
+	mpfr_tanh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::acosh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_acosh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::acosh() &&
+{
+	promote();
+	mpfr_acosh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::asinh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_asinh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::asinh() &&
+{
+	promote();
+	mpfr_asinh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::atanh() const &
+{
+	AF r = with_precision(precision);
+	mpfr_atanh(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::atanh() &&
+{
+	promote();
+	mpfr_atanh(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+
+AF AF::abs() const &
+{
+	return AF(*this).abs();
+}
+
+AF AF::abs() &&
+{
+	if ((repr == reprInt) && (small.i != INT64_MIN)) {
+		small.i = (small.i < 0) ? -small.i : small.i;
+	}
+	else if (repr == reprDouble) {
+		set_small(std::fabs(small.d));
+	}
+	else if (repr == reprRational) {
+		mpq_abs(small.q, small.q);
+	}
+	else {
+		promote();
+		mpfr_abs(vptr, vptr, rounding_mode);
+	}
+	return std::move(*this);
+}
+
+
+AF AF::log() const &
+{
+	AF r = with_precision(precision);
+	mpfr_log(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::log() &&
+{
+	promote();
+	mpfr_log(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+AF AF::log10() const &
+{
+	AF r = with_precision(precision);
+	mpfr_log10(r.vptr, MpfrArg(*this), rounding_mode);
+	return r;
+}
+
+AF AF::log10() &&
+{
+	promote();
+	mpfr_log10(vptr, vptr, rounding_mode);
+	return std::move(*this);
+}
+
+
+double AF::toDouble() const
+{
+	if (repr == reprInt) {
+		return (double) small.i;
+	}
+	if (repr == reprDouble) {
+		return small.d;
+	}
+	return mpfr_get_d(MpfrArg(*this), rounding_mode);
+}
+
+intmax_t AF::toLong() const
+{
+	if (repr == reprInt) {
+		return small.i;
+	}
+	return mpfr_get_sj(MpfrArg(*this), rounding_mode);
+}
+
+int AF::toInt() const
+{
+	return (int) toLong();
+}
+
+void AF::toInteger(mpz_ptr z) const
+{
+	if ((repr == reprInt) && (small.i >= LONG_MIN) && (small.i <= LONG_MAX)) {
+		mpz_set_si(z, (long) small.i);
+		return;
+	}
+	// NaN and infinity give zero
+	mpfr_get_z(z, MpfrArg(*this), rounding_mode);
+}
+
+AF AF::fromInteger(mpz_srcptr z)
+{
+	if (mpz_fits_slong_p(z)) {
+		return AF((intmax_t) mpz_get_si(z));
+	}
+	AF r;
+	r.promote((mpfr_prec_t) mpz_sizeinbase(z, 2));
+	mpfr_set_z(r.vptr, z, r.rounding_mode);
+	r.demote();
+	return r;
+}
+
+/* Sums convert every value to an mpfr_t (for mpfr_sum) so they are done
+ * in blocks of this many to limit the memory the conversions take.  An
+ * exact sum's precision is limited to MAX_EXACT_SUM_PREC.
+ */
+static const size_t SUM_BLOCK = 4096;
+static const mpfr_prec_t MAX_EXACT_SUM_PREC = 1 << 18;
+
+static AF int128ToAF(__int128 v)
+{
+	if ((v >= INT64_MIN) && (v <= INT64_MAX)) {
+		return AF((intmax_t) v);
+	}
+	unsigned __int128 magnitude = (v < 0) ? -(unsigned __int128) v : (unsigned __int128) v;
+	uint64_t words[2] = {(uint64_t) (magnitude >> 64), (uint64_t) magnitude};
+	mpz_t z;
+	mpz_init(z);
+	mpz_import(z, 2, 1, sizeof(words[0]), 0, 0, words);
+	if (v < 0) {
+		mpz_neg(z, z);
+	}
+	AF r = AF::fromInteger(z);
+	mpz_clear(z);
+	return r;
+}
+
+bool AF::exactSum(const AF * const * values, size_t count, AF & result)
+{
+	if (count > SUM_BLOCK) {
+		std::vector<AF> partials;
+		for (size_t i = 0; i < count; i += SUM_BLOCK) {
+			partials.emplace_back();
+			if ( ! exactSum(values + i, std::min(SUM_BLOCK, count - i), partials.back())) {
+				return false;
+			}
+		}
+		std::vector<const AF *> ptrs;
+		for (auto & v : partials) {
+			ptrs.push_back(&v);
+		}
+		return exactSum(ptrs.data(), ptrs.size(), result);
+	}
+
+	// Integers can't overflow 128 bits in a block, which is the usual case
+	__int128 total = 0;
+	size_t i;
+	for (i = 0; (i < count) && (values[i]->repr == reprInt); i++) {
+		total += values[i]->small.i;
+	}
+	if (i == count) {
+		result = int128ToAF(total);
+		return true;
+	}
+
+	// The exact sum needs enough bits to go from the top of the largest
+	// value to the bottom of the one with the lowest last bit, plus one
+	// bit of carry for each doubling of the count
+	std::deque<MpfrArg> args;
+	std::vector<mpfr_srcptr> ptrs;
+	mpfr_exp_t top = mpfr_get_emin_min();
+	mpfr_exp_t bottom = mpfr_get_emax_max();
+	bool special = false;
+	for (i = 0; i < count; i++) {
+		mpfr_srcptr x = args.emplace_back(*values[i]);
+		ptrs.push_back(x);
+		if (mpfr_regular_p(x)) {
+			top = std::max(top, mpfr_get_exp(x));
+			bottom = std::min(bottom, mpfr_get_exp(x) - (mpfr_exp_t) mpfr_get_prec(x));
+		}
+		else if ( ! mpfr_zero_p(x)) {
+			special = true; // Infinity or NaN
+		}
+	}
+	mpfr_prec_t prec = MPFR_PREC_MIN;
+	if (( ! special) && (top >= bottom)) {
+		mpfr_prec_t carry = 1;
+		while (((size_t) 1 << (carry - 1)) < count) {
+			carry++;
+		}
+		if (top - bottom > MAX_EXACT_SUM_PREC) {
+			return false;
+		}
+		prec = std::max(prec, (mpfr_prec_t) (top - bottom) + carry);
+	}
+	result = with_precision(prec);
+	mpfr_sum(result.vptr, (mpfr_ptr *) ptrs.data(), count, MPFR_RNDN);
+	result.demote();
+	return true;
+}
+
+AF AF::sum(const AF * const * values, size_t count)
+{
+	AF r;
+	std::vector<AF> partials;
+	if (count > SUM_BLOCK) {
+		// Rounding the sum of the exact sums of each block is the same as
+		// rounding the sum of everything
+		for (size_t i = 0; i < count; i += SUM_BLOCK) {
+			partials.emplace_back();
+			if ( ! exactSum(values + i, std::min(SUM_BLOCK, count - i), partials.back())) {
+				partials.clear();
+				break;
+			}
+		}
+	}
+	std::vector<const AF *> partialPtrs;
+	for (auto & v : partials) {
+		partialPtrs.push_back(&v);
+	}
+	if ( ! partials.empty()) {
+		values = partialPtrs.data();
+		count = partialPtrs.size();
+	}
+
+	std::deque<MpfrArg> args;
+	std::vector<mpfr_srcptr> ptrs;
+	for (size_t i = 0; i < count; i++) {
+		ptrs.push_back(args.emplace_back(*values[i]));
+	}
+	r.promote();
+	mpfr_sum(r.vptr, (mpfr_ptr *) ptrs.data(), count, r.rounding_mode);
+	r.demote();
+	return r;
+}
+
+
+/* Formatting gives the same output as printf's %.<digits>RNg, but is
+ * built from mpfr_get_str in thread-local scratch buffers rather than
+ * going through mpfr_asprintf and a malloc'd result each time.
+ */
+static thread_local std::vector<char> digitBuffer;
+static thread_local std::vector<char> formatBuffer;
+
+static size_t layoutDigits(char *out, const char *digits, int count, bool negative, long x)
+{
+	/* digits holds count significant digits for a value of d1.d2...dn
+	 * times 10^x.  out needs room for count + 32 characters.
+	 */
+	char *p = out;
+
+	// %g drops trailing zeros from the fraction
+	int used = count;
+	while ((used > 1) && (digits[used-1] == '0')) {
+		used--;
+	}
+
+	if (negative) {
+		*p++ = '-';
+	}
+
+	if ((x < count) && (x >= -4)) {
+		if (x >= 0) {
+			for (int i=0;i<=x;i++) {
+				*p++ = digits[i];
+			}
+			if (used > (x+1)) {
+				*p++ = '.';
+				for (int i=x+1;i<used;i++) {
+					*p++ = digits[i];
+				}
+			}
+		}
+		else {
+			*p++ = '0';
+			*p++ = '.';
+			for (int i=0;i<(-x-1);i++) {
+				*p++ = '0';
+			}
+			for (int i=0;i<used;i++) {
+				*p++ = digits[i];
+			}
+		}
+	}
+	else {
+		*p++ = digits[0];
+		if (used > 1) {
+			*p++ = '.';
+			for (int i=1;i<used;i++) {
+				*p++ = digits[i];
+			}
+		}
+		p += sprintf(p, "e%c%02ld", (x < 0) ? '-' : '+', (x < 0) ? -x : x);
+	}
+	*p = '\0';
+	return p - out;
+}
+
+static const char * fetchDigits(mpfr_srcptr v, int count, mpfr_exp_t & exp)
+{
+	if (digitBuffer.size() < (size_t) (count + 2)) {
+		digitBuffer.resize(count + 2);
+	}
+	mpfr_get_str(digitBuffer.data(), &exp, 10, count, v, MPFR_RNDN);
+	return digitBuffer.data();
+}
+
+static bool roundTrips(mpfr_srcptr v, int count, mpfr_prec_t bits)
+{
+	// Does reading count digits back in at bits precision give exactly the same value?
+	static thread_local mpfr_t check;
+	static thread_local bool checkInitialised = false;
+	if ( ! checkInitialised) {
+		mpfr_init2(check, bits);
+		checkInitialised = true;
+	}
+	else if (mpfr_get_prec(check) != bits) {
+		mpfr_set_prec(check, bits);
+	}
+
+	mpfr_exp_t exp;
+	const char *digits = fetchDigits(v, count, exp);
+	formatBuffer.resize(count + 32);
+	snprintf(formatBuffer.data(), formatBuffer.size(), "%se%ld", digits, (long) exp - count);
+	mpfr_strtofr(check, formatBuffer.data(), NULL, 10, MPFR_RNDN);
+	return mpfr_equal_p(check, v);
+}
+
+size_t AF::format_to_scratch(int digits, bool shortest) const
+{
+	if (digits <= 0) {
+		digits = getDigits();
+	}
+
+	if ((repr == reprInt) && ( ! shortest)) {
+		// Integers are printed in full if they fit in the digits
+		char intBuffer[24];
+		size_t len = std::to_chars(intBuffer, intBuffer + sizeof(intBuffer), small.i).ptr - intBuffer;
+		if ((int) (len - (small.i < 0)) <= digits) {
+			formatBuffer.resize(len + 1);
+			memcpy(formatBuffer.data(), intBuffer, len);
+			formatBuffer[len] = '\0';
+			return len;
+		}
+	}
+
+	MpfrArg arg(*this);
+	mpfr_srcptr v = arg;
+	formatBuffer.resize(32);
+	if (mpfr_nan_p(v)) {
+		strcpy(formatBuffer.data(), "nan");
+		return 3;
+	}
+	if (mpfr_inf_p(v)) {
+		strcpy(formatBuffer.data(), mpfr_signbit(v) ? "-inf" : "inf");
+		return strlen(formatBuffer.data());
+	}
+	if (mpfr_zero_p(v)) {
+		strcpy(formatBuffer.data(), mpfr_signbit(v) ? "-0" : "0");
+		return strlen(formatBuffer.data());
+	}
+
+	if (shortest) {
+		// Binary search: if n digits round trip then so do n+1.  Doubles
+		// only need to round trip as doubles, not at the view's 64 bits.
+		mpfr_prec_t bits = (repr == reprDouble) ? DBL_MANT_DIG : mpfr_get_prec(v);
+		int lo = 1;
+		int hi = mpfr_get_str_ndigits(10, bits);
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (roundTrips(v, mid, bits)) {
+				hi = mid;
+			}
+			else {
+				lo = mid + 1;
+			}
+		}
+		digits = lo;
+	}
+
+	mpfr_exp_t exp;
+	const char *d = fetchDigits(v, digits, exp);
+	bool negative = (d[0] == '-');
+	if (negative) {
+		d++;
+	}
+	formatBuffer.resize(digits + 32);
+	return layoutDigits(formatBuffer.data(), d, digits, negative, (long) exp - 1);
+}
+
+std::string AF::toString() const
+{
+	return toString(0);
+}
+
+std::string AF::toString(int digits, bool shortest) const
+{
+	size_t len = format_to_scratch(digits, shortest);
+	return std::string(formatBuffer.data(), len);
+}
+
+size_t AF::format(char *buffer, size_t size, int digits, bool shortest) const
+{
+	size_t len = format_to_scratch(digits, shortest);
+	if (size > 0) {
+		size_t n = std::min(len, size - 1);
+		memcpy(buffer, formatBuffer.data(), n);
+		buffer[n] = '\0';
+	}
+	return len;
+}
+
+void AF::debugPrint() const
+{
+	printf("Debug print value: ");
+	mpfr_out_str(stdout, 10, 0, MpfrArg(*this), MPFR_RNDD);
+	printf("\n");
+}
+
+bool AF::write(FILE *f) const
+{
+	// The representation, the precision and then the value
+	uint8_t r = repr;
+	int32_t prec = precision;
+	if ((fwrite(&r, sizeof(r), 1, f) != 1) || (fwrite(&prec, sizeof(prec), 1, f) != 1)) {
+		return false;
+	}
+	switch (repr) {
+		case reprInt:
+			return fwrite(&small.i, sizeof(small.i), 1, f) == 1;
+		case reprDouble:
+			return fwrite(&small.d, sizeof(small.d), 1, f) == 1;
+		case reprRational:
+			return (mpz_out_raw(f, mpq_numref(small.q)) != 0) && (mpz_out_raw(f, mpq_denref(small.q)) != 0);
+		default:
+			return mpfr_fpif_export(f, const_cast<mpfr_ptr>(vptr)) == 0;
+	}
+}
+
+bool AF::read(FILE *f, AF & v)
+{
+	uint8_t r;
+	int32_t prec;
+	if ((fread(&r, sizeof(r), 1, f) != 1) || (fread(&prec, sizeof(prec), 1, f) != 1)) {
+		return false;
+	}
+	AF result;
+	result.precision = prec;
+	switch (r) {
+		case reprInt:
+			if (fread(&result.small.i, sizeof(result.small.i), 1, f) != 1) {
+				return false;
+			}
+			break;
+		case reprDouble:
+			if (fread(&result.small.d, sizeof(result.small.d), 1, f) != 1) {
+				return false;
+			}
+			result.repr = reprDouble;
+			break;
+		case reprRational: {
+			mpq_t q;
+			mpq_init(q);
+			bool ok = (mpz_inp_raw(mpq_numref(q), f) != 0) && (mpz_inp_raw(mpq_denref(q), f) != 0)
+				&& (mpz_sgn(mpq_denref(q)) != 0);
+			if (ok) {
+				mpq_canonicalize(q);
+				result.set_rational(q, prec);
+			}
+			mpq_clear(q);
+			if ( ! ok) {
+				return false;
+			}
+			break;
+		}
+		case reprMpfr:
+			result.promote();
+			if (mpfr_fpif_import(result.vptr, f) != 0) {
+				return false;
+			}
+			break;
+		default:
+			return false;
+	}
+	v = std::move(result);
+	return true;
+}
+
+size_t AF::memoryUsed() const
+{
+	switch (repr) {
+		case reprRational:
+			return sizeof(AF) + sizeof(__mpq_struct)
+				+ ((mpz_size(mpq_numref(small.q)) + mpz_size(mpq_denref(small.q))) * sizeof(mp_limb_t));
+		case reprMpfr:
+			return sizeof(AF) + mpfr_custom_get_size(mpfr_get_prec(vptr));
+		default:
+			return sizeof(AF);
+	}
+}
+
+
+AF AF::from(intmax_t v)
+{
+	return AF(v);
+}
+
+AF AF::from(int v)
+{
+	return AF(v);
+}
+
+AF AF::from(double v)
+{
+	return AF(v);
+}
+
+AF AF::from(std::string v)
+{
+	return AF(v);
+}
+
+/* Constants are cached per working precision.  Sets are only ever
+ * added (never removed or modified once published), so references
+ * handed out stay valid and can be read from any thread without
+ * holding the lock.  They're rounded to nearest whatever rounding the
+ * thread that happens to build them is using.
+ */
+typedef struct _ConstantSet {
+	AF pi;
+	AF e;
+	AF ln2;
+	AF ln10;
+	AF degreesToRadians;
+	AF radiansToDegrees;
+	// Filled in on demand (under the lock) for powers up to
+	// INTEGER_POWER_CACHE_LIMIT
+	mutable std::map<int, std::unique_ptr<AF> > tens;
+	mutable std::map<int, std::unique_ptr<AF> > twos;
+} ConstantSet;
+
+static std::shared_mutex constantsMutex;
+static std::map<int, std::unique_ptr<ConstantSet> > constantSets;
+static const int INTEGER_POWER_CACHE_LIMIT = 256;
+
+const ConstantSet & AF::constant_set()
+{
+	const int digits = workingDigits;
+	{
+		std::shared_lock<std::shared_mutex> lock(constantsMutex);
+		auto it = constantSets.find(digits);
+		if (it != constantSets.end()) {
+			return *it->second;
+		}
+	}
+
+	// Build outside the lock as this is the slow bit; if another thread
+	// gets there first, its copy is kept and this one is discarded
+	AFWorkingRounding wr(MPFR_RNDN);
+	std::unique_ptr<ConstantSet> cs(new ConstantSet);
+	const mpfr_prec_t prec = digits_to_bits(digits);
+	cs->pi = with_precision(prec);
+	mpfr_const_pi(cs->pi.vptr, cs->pi.rounding_mode);
+	cs->e = with_precision(prec);
+	mpfr_exp(cs->e.vptr, MpfrArg(AF(1)), cs->e.rounding_mode);
+	cs->ln2 = AF(2).log();
+	cs->ln10 = AF(10).log();
+	cs->degreesToRadians = cs->pi / 180;
+	cs->radiansToDegrees = AF(180) / cs->pi;
+
+	std::unique_lock<std::shared_mutex> lock(constantsMutex);
+	auto result = constantSets.emplace(digits, std::move(cs));
+	return *result.first->second;
+}
+
+AF AF::integer_power(int base, int n)
+{
+	AFWorkingRounding wr(MPFR_RNDN);
+	if ((n > INTEGER_POWER_CACHE_LIMIT) || (n < -INTEGER_POWER_CACHE_LIMIT)) {
+		// Any exponent can be asked for (e.g. for rounding to a number
+		// of decimal places), so don't keep the odd ones
+		AF v = AF(base).pow(AF(n));
+		v.demote();
+		return v;
+	}
+
+	const ConstantSet & cs = constant_set();
+	std::map<int, std::unique_ptr<AF> > & table = (base == 10) ? cs.tens : cs.twos;
+	{
+		std::shared_lock<std::shared_mutex> lock(constantsMutex);
+		auto it = table.find(n);
+		if (it != table.end()) {
+			return *it->second;
+		}
+	}
+
+	std::unique_ptr<AF> v(new AF(AF(base).pow(AF(n))));
+	// Most of these are exact, so keep them small if possible
+	v->demote();
+
+	std::unique_lock<std::shared_mutex> lock(constantsMutex);
+	auto result = table.emplace(n, std::move(v));
+	return *result.first->second;
+}
+
+const AF & AF::pi()
+{
+	return constant_set().pi;
+}
+
+const AF & AF::e()
+{
+	return constant_set().e;
+}
+
+const AF & AF::ln2()
+{
+	return constant_set().ln2;
+}
+
+const AF & AF::ln10()
+{
+	return constant_set().ln10;
+}
+
+const AF & AF::degreesToRadians()
+{
+	return constant_set().degreesToRadians;
+}
+
+const AF & AF::radiansToDegrees()
+{
+	return constant_set().radiansToDegrees;
+}
 
-AF AF::remainder(AF b)
+AF AF::powerOfTen(int n)
 {
-	return rem(b);
+	return integer_power(10, n);
 }
 
-AF AF::remainder(double b)
+AF AF::powerOfTwo(int n)
 {
-	return rem(b);
+	return integer_power(2, n);
 }
 
 
-AF AF::round()
+AF AF::operator+(const AF & b) const &
 {
-	AF r;
-	mpfr_round(r.vptr, vptr);
-	return r;
+	return plus(b);
 }
 
-void AF::reduce_precision()
+AF AF::operator+(const AF & b) &&
 {
-	// Used in conversions where only small number of decimal places
-	// are required.  This is a bit of a crude hack, but seems to work.
-	// I mainly implemented this to deal with some strange rounding
-	// effects associated with convertHoursToHms and convertHmsToHours
-	precision -= 2;
-	mpfr_prec_round(vptr, precision, rounding_mode);
+	return std::move(*this).plus(b);
 }
 
-AF AF::floor()
+AF AF::operator+(AF && b) const &
 {
-	AF r;
-	mpfr_floor(r.vptr, vptr);
-	return r;
+	return plus(std::move(b));
 }
 
-AF AF::ceil()
+AF AF::operator+(AF && b) &&
 {
-	AF r;
-	mpfr_ceil(r.vptr, vptr);
-	return r;
+	return std::move(*this).plus(std::move(b));
 }
 
-AF AF::pow(AF x)
+AF AF::operator-(const AF & b) const &
 {
-	AF r;
-	mpfr_pow(r.vptr, vptr, x.vptr, rounding_mode);
-	return r;
+	return minus(b);
 }
 
-
-AF AF::sqrt()
+AF AF::operator-(const AF & b) &&
 {
-	AF r;
-	mpfr_sqrt(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).minus(b);
 }
 
-AF AF::cbrt()
+AF AF::operator-(AF && b) const &
 {
-	AF r;
-	mpfr_cbrt(r.vptr, vptr, rounding_mode);
-	return r;
+	return minus(std::move(b));
 }
 
-AF AF::root(AF p)
+AF AF::operator-(AF && b) &&
 {
-	AF r;
-	AF one(1);
-	AF power;
-	power = one.div(p);
-	mpfr_pow(r.vptr, vptr, power.vptr, rounding_mode);
-	return r;
+	return std::move(*this).minus(std::move(b));
 }
 
-AF AF::root(double p)
+AF AF::operator/(const AF & b) const &
 {
-	AF pa(p);
-	return root(pa);
+	return div(b);
 }
 
-
-AF AF::cos()
+AF AF::operator/(const AF & b) &&
 {
-	AF r;
-	mpfr_cos(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).div(b);
 }
 
-AF AF::sin()
+AF AF::operator/(AF && b) const &
 {
-	AF r;
-	mpfr_sin(r.vptr, vptr, rounding_mode);
-	return r;
+	return div(std::move(b));
 }
 
-AF AF::tan()
+AF AF::operator/(AF && b) &&
 {
-	AF r;
-	mpfr_tan(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).div(std::move(b));
 }
 
-AF AF::acos()
+AF AF::operator*(const AF & b) const &
 {
-	AF r;
-	mpfr_acos(r.vptr, vptr, rounding_mode);
-	return r;
+	return times(b);
 }
 
-AF AF::asin()
+AF AF::operator*(const AF & b) &&
 {
-	AF r;
-	mpfr_asin(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).times(b);
 }
 
-AF AF::atan()
+AF AF::operator*(AF && b) const &
 {
-	AF r;
-	mpfr_atan(r.vptr, vptr, rounding_mode);
-	return r;
+	return times(std::move(b));
 }
 
-
-AF AF::cosh()
+AF AF::operator*(AF && b) &&
 {
-	AF r;
-	mpfr_cosh(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).times(std::move(b));
 }
 
-AF AF::sinh()
+bool AF::operator==(const AF & b) const
 {
-	AF r;
-	mpfr_sinh(r.vptr, vptr, rounding_mode);
-	return r;
+	return equals(b);
 }
 
-AF AF::tanh()
+bool AF::operator!=(const AF & b) const
 {
-	AF r;
-	mpfr_tanh(r.vptr, vptr, rounding_mode);
-	return r;
+	return ( ! equals(b));
 }
 
-AF AF::acosh()
+bool AF::operator<(const AF & b) const
 {
-	AF r;
-	mpfr_acosh(r.vptr, vptr, rounding_mode);
-	return r;
+	if (compareTo(b) < 0) {
+		return true;
+	}
+	else {
+		return false;
+	}
 }
 
-AF AF::asinh()
+bool AF::operator>(const AF & b) const
 {
-	AF r;
-	mpfr_asinh(r.vptr, vptr, rounding_mode);
-	return r;
+	if (compareTo(b) > 0) {
+		return true;
+	}
+	else {
+		return false;
+	}
 }
 
-AF AF::atanh()
+bool AF::operator<=(const AF & b) const
 {
-	AF r;
-	mpfr_atanh(r.vptr, vptr, rounding_mode);
-	return r;
+	if (compareTo(b) > 0) {
+		return false;
+	}
+	else {
+		return true;
+	}
 }
 
+bool AF::operator>=(const AF & b) const
+{
+	if (compareTo(b) < 0) {
+		return false;
+	}
+	else {
+		return true;
+	}
+}
 
-AF AF::abs()
+AF AF::operator+(double b) const &
 {
-	AF r;
-	mpfr_abs(r.vptr, vptr, rounding_mode);
-	return r;
+	return plus(b);
 }
 
+AF AF::operator+(double b) &&
+{
+	return std::move(*this).plus(b);
+}
 
-AF AF::log()
+AF AF::operator-(double b) const &
 {
-	AF r;
-	mpfr_log(r.vptr, vptr, rounding_mode);
-	return r;
+	return minus(b);
 }
 
-AF AF::log10()
+AF AF::operator-(double b) &&
 {
-	AF r;
-	mpfr_log10(r.vptr, vptr, rounding_mode);
-	return r;
+	return std::move(*this).minus(b);
 }
 
+AF AF::operator/(double b) const &
+{
+	return div(b);
+}
 
-double AF::toDouble()
+AF AF::operator/(double b) &&
 {
-	return mpfr_get_d(vptr, rounding_mode);
+	return std::move(*this).div(b);
 }
 
-intmax_t AF::toLong()
+AF AF::operator*(double b) const &
 {
-	return mpfr_get_sj(vptr, rounding_mode);
+	return times(b);
 }
 
-int AF::toInt()
+AF AF::operator*(double b) &&
 {
-	return (int) toLong();
+	return std::move(*this).times(b);
 }
 
+bool AF::operator==(double b) const
+{
+	return equals(b);
+}
 
-std::string AF::toString()
+bool AF::operator!=(double b) const
 {
-	char format[] = "%.256RNg";
-	char *buffer = NULL;
-	std::string out;
+	return ( ! equals(b));
+}
 
-	if ( ! (mpfr_asprintf(&buffer, format, vptr) < 0))
-	{
-		out = std::string(buffer);
-		mpfr_free_str(buffer);
+bool AF::operator<(double b) const
+{
+	if (compareTo(b) < 0) {
+		return true;
+	}
+	else {
+		return false;
 	}
-	return out;
 }
 
-void AF::debugPrint()
+bool AF::operator>(double b) const
 {
-	printf("Debug print value: ");
-	mpfr_out_str(stdout, 10, 0, vptr, MPFR_RNDD);
-	printf("\n");
+	if (compareTo(b) > 0) {
+		return true;
+	}
+	else {
+		return false;
+	}
 }
 
-
-AF AF::from(intmax_t v)
+bool AF::operator<=(double b) const
 {
-	return AF(v);
+	if (compareTo(b) > 0) {
+		return false;
+	}
+	else {
+		return true;
+	}
 }
 
-AF AF::from(int v)
+bool AF::operator>=(double b) const
 {
-	return AF(v);
+	if (compareTo(b) < 0) {
+		return false;
+	}
+	else {
+		return true;
+	}
 }
 
-AF AF::from(double v)
+AF AF::operator+(int b) const &
 {
-	return AF(v);
+	return plus(b);
 }
 
-AF AF::from(std::string v)
+AF AF::operator+(int b) &&
 {
-	return AF(v);
+	return std::move(*this).plus(b);
 }
 
-AF AF::pi()
+AF AF::operator-(int b) const &
 {
-	AF r;
-	mpfr_const_pi(r.vptr, r.rounding_mode);
-	return r;
+	return minus(b);
 }
 
-AF AF::e()
+AF AF::operator-(int b) &&
 {
-	AF r;
-	AF one(1);
-	mpfr_exp(r.vptr, one.vptr, r.rounding_mode);
-	return r;
+	return std::move(*this).minus(b);
 }
 
-
-AF AF::operator+(const AF & b)
+AF AF::operator/(int b) const &
 {
-	return plus(b);
+	return div(b);
 }
 
-AF AF::operator-(const AF & b)
+AF AF::operator/(int b) &&
 {
-	return minus(b);
+	return std::move(*this).div(b);
 }
 
-AF AF::operator/(const AF & b)
+AF AF::operator*(int b) const &
 {
-	return div(b);
+	return times(b);
 }
 
-AF AF::operator*(const AF & b)
+AF AF::operator*(int b) &&
 {
-	return times(b);
+	return std::move(*this).times(b);
 }
 
-bool AF::operator==(const AF & b) const
+bool AF::operator==(int b) const
 {
 	return equals(b);
 }
 
-bool AF::operator!=(const AF & b) const
+bool AF::operator!=(int b) const
 {
 	return ( ! equals(b));
 }
 
-bool AF::operator<(const AF & b) const
+bool AF::operator<(int b) const
 {
 	if (compareTo(b) < 0) {
 		return true;
@@ -531,7 +2620,7 @@ bool AF::operator<(const AF & b) const
 	}
 }
 
-bool AF::operator>(const AF & b) const
+bool AF::operator>(int b) const
 {
 	if (compareTo(b) > 0) {
 		return true;
@@ -541,7 +2630,7 @@ bool AF::operator>(const AF & b) const
 	}
 }
 
-bool AF::operator<=(const AF & b) const
+bool AF::operator<=(int b) const
 {
 	if (compareTo(b) > 0) {
 		return false;
@@ -551,7 +2640,7 @@ bool AF::operator<=(const AF & b) const
 	}
 }
 
-bool AF::operator>=(const AF & b) const
+bool AF::operator>=(int b) const
 {
 	if (compareTo(b) < 0) {
 		return false;
@@ -561,41 +2650,57 @@ bool AF::operator>=(const AF & b) const
 	}
 }
 
-AF AF::operator+(double & b)
+AF AF::operator+(intmax_t b) const &
 {
-	AF ba(b);
 	return plus(b);
 }
 
-AF AF::operator-(double & b)
+AF AF::operator+(intmax_t b) &&
+{
+	return std::move(*this).plus(b);
+}
+
+AF AF::operator-(intmax_t b) const &
 {
-	AF ba(b);
 	return minus(b);
 }
 
-AF AF::operator/(double & b)
+AF AF::operator-(intmax_t b) &&
+{
+	return std::move(*this).minus(b);
+}
+
+AF AF::operator/(intmax_t b) const &
 {
-	AF ba(b);
 	return div(b);
 }
 
-AF AF::operator*(double & b)
+AF AF::operator/(intmax_t b) &&
+{
+	return std::move(*this).div(b);
+}
+
+AF AF::operator*(intmax_t b) const &
 {
-	AF ba(b);
 	return times(b);
 }
 
-bool AF::operator==(double & b) const
+AF AF::operator*(intmax_t b) &&
+{
+	return std::move(*this).times(b);
+}
+
+bool AF::operator==(intmax_t b) const
 {
 	return equals(b);
 }
 
-bool AF::operator!=(double & b) const
+bool AF::operator!=(intmax_t b) const
 {
 	return ( ! equals(b));
 }
 
-bool AF::operator<(double & b) const
+bool AF::operator<(intmax_t b) const
 {
 	if (compareTo(b) < 0) {
 		return true;
@@ -605,7 +2710,7 @@ bool AF::operator<(double & b) const
 	}
 }
 
-bool AF::operator>(double & b) const
+bool AF::operator>(intmax_t b) const
 {
 	if (compareTo(b) > 0) {
 		return true;
@@ -615,7 +2720,7 @@ bool AF::operator>(double & b) const
 	}
 }
 
-bool AF::operator<=(double & b) const
+bool AF::operator<=(intmax_t b) const
 {
 	if (compareTo(b) > 0) {
 		return false;
@@ -625,7 +2730,7 @@ bool AF::operator<=(double & b) const
 	}
 }
 
-bool AF::operator>=(double & b) const
+bool AF::operator>=(intmax_t b) const
 {
 	if (compareTo(b) < 0) {
 		return false;
@@ -635,11 +2740,153 @@ bool AF::operator>=(double & b) const
 	}
 }
 
+AF& AF::operator+=(const AF & b)
+{
+	if ( ! fast_add(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_add(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return *this;
+}
+
+AF& AF::operator-=(const AF & b)
+{
+	if ( ! fast_sub(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_sub(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return *this;
+}
+
+AF& AF::operator*=(const AF & b)
+{
+	if ( ! fast_mul(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_mul(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return *this;
+}
+
+AF& AF::operator/=(const AF & b)
+{
+	if ( ! fast_div(*this, b, *this)) {
+		promote(b.precision);
+		mpfr_div(vptr, vptr, MpfrArg(b), rounding_mode);
+	}
+	return *this;
+}
+
+AF& AF::operator+=(double b)
+{
+	if (repr == reprMpfr) {
+		mpfr_add_d(vptr, vptr, b, rounding_mode);
+		return *this;
+	}
+	return *this += scalar(b);
+}
+
+AF& AF::operator+=(int b)
+{
+	return *this += (intmax_t) b;
+}
+
+AF& AF::operator+=(intmax_t b)
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_add_si(vptr, vptr, (long) b, rounding_mode);
+		return *this;
+	}
+	return *this += scalar(b);
+}
+
+AF& AF::operator-=(double b)
+{
+	if (repr == reprMpfr) {
+		mpfr_sub_d(vptr, vptr, b, rounding_mode);
+		return *this;
+	}
+	return *this -= scalar(b);
+}
+
+AF& AF::operator-=(int b)
+{
+	return *this -= (intmax_t) b;
+}
+
+AF& AF::operator-=(intmax_t b)
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_sub_si(vptr, vptr, (long) b, rounding_mode);
+		return *this;
+	}
+	return *this -= scalar(b);
+}
+
+AF& AF::operator*=(double b)
+{
+	if (repr == reprMpfr) {
+		mpfr_mul_d(vptr, vptr, b, rounding_mode);
+		return *this;
+	}
+	return *this *= scalar(b);
+}
+
+AF& AF::operator*=(int b)
+{
+	return *this *= (intmax_t) b;
+}
+
+AF& AF::operator*=(intmax_t b)
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_mul_si(vptr, vptr, (long) b, rounding_mode);
+		return *this;
+	}
+	return *this *= scalar(b);
+}
+
+AF& AF::operator/=(double b)
+{
+	if (repr == reprMpfr) {
+		mpfr_div_d(vptr, vptr, b, rounding_mode);
+		return *this;
+	}
+	return *this /= scalar(b);
+}
+
+AF& AF::operator/=(int b)
+{
+	return *this /= (intmax_t) b;
+}
+
+AF& AF::operator/=(intmax_t b)
+{
+	if ((repr == reprMpfr) && (b >= LONG_MIN) && (b <= LONG_MAX)) {
+		mpfr_div_si(vptr, vptr, (long) b, rounding_mode);
+		return *this;
+	}
+	return *this /= scalar(b);
+}
+
 bool AF::isValidString(std::string s)
 {
+	uint64_t mantissa;
+	long exponent;
+	bool negative;
+	switch (parseDecimal(s.c_str(), mantissa, exponent, negative)) {
+		case decimalShort:
+		case decimalLong:
+			return true;
+		case decimalInvalid:
+			return false;
+		case decimalOther:
+			break;
+	}
+
 	AF test_af(0);
+	test_af.promote();
 
-	int result = mpfr_set_str(test_af.vptr, s.c_str(), 10, mpfr_get_default_rounding_mode());
+	int result = mpfr_set_str(test_af.vptr, s.c_str(), 10, workingRounding);
 
 	if (result == 0) {
 		return true;
@@ -649,3 +2896,50 @@ bool AF::isValidString(std::string s)
 }
 
 
+
+AF AFExprEval::result(mpfr_prec_t prec)
+{
+	return AF::with_precision(prec);
+}
+
+void AFExprEval::set(mpfr_ptr d, const AF & a, mpfr_rnd_t rnd)
+{
+	AF::MpfrArg av(a);
+	mpfr_set(d, (mpfr_srcptr) av, rnd);
+}
+
+void AFExprEval::apply(mpfr_ptr d, AFExprOp op, mpfr_srcptr x, const AF & a, bool aOnLeft, mpfr_rnd_t rnd)
+{
+	AF::MpfrArg av(a);
+	mpfr_srcptr lhs = aOnLeft ? (mpfr_srcptr) av : x;
+	mpfr_srcptr rhs = aOnLeft ? x : (mpfr_srcptr) av;
+	switch (op) {
+		case afxAdd: mpfr_add(d, lhs, rhs, rnd); break;
+		case afxSub: mpfr_sub(d, lhs, rhs, rnd); break;
+		case afxMul: mpfr_mul(d, lhs, rhs, rnd); break;
+		case afxDiv: mpfr_div(d, lhs, rhs, rnd); break;
+	}
+}
+
+void AFExprEval::fma(mpfr_ptr d, const AF & a, const AF & b, const AF & c, bool subtract, bool negate, mpfr_rnd_t rnd)
+{
+	AF::MpfrArg av(a);
+	mpfr_srcptr ap = av;
+	// -(a*b + c) is (-a)*b - c and so on, so that there's only one
+	// rounding.  The negated a shares a's significand.
+	mpfr_t negated;
+	if (negate) {
+		// The kind carries the sign
+		int kind = mpfr_custom_get_kind(ap);
+		mpfr_exp_t exp = (std::abs(kind) == MPFR_REGULAR_KIND) ? mpfr_custom_get_exp(ap) : 0;
+		mpfr_custom_init_set(negated, -kind, exp, mpfr_get_prec(ap),
+				mpfr_custom_get_significand((mpfr_ptr) ap));
+		ap = negated;
+	}
+	if (subtract != negate) {
+		mpfr_fms(d, ap, AF::MpfrArg(b), AF::MpfrArg(c), rnd);
+	}
+	else {
+		mpfr_fma(d, ap, AF::MpfrArg(b), AF::MpfrArg(c), rnd);
+	}
+}
@@ -0,0 +1,183 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "arpint.h"
+#include <memory> // std::unique_ptr
+
+AI::~AI()
+{
+	mpz_clear(z);
+}
+
+AI::AI()
+{
+	mpz_init(z);
+}
+
+AI::AI(const AI& v)
+{
+	mpz_init_set(z, v.z);
+}
+
+AI::AI(AI&& v) noexcept
+{
+	mpz_init(z);
+	mpz_swap(z, v.z);
+}
+
+AI::AI(const AF & v)
+{
+	mpz_init(z);
+	v.toInteger(z);
+}
+
+AI::AI(long v)
+{
+	mpz_init_set_si(z, v);
+}
+
+AI::AI(const std::string & digits, int base)
+{
+	if (mpz_init_set_str(z, digits.c_str(), base) != 0) {
+		mpz_set_ui(z, 0);
+	}
+}
+
+AI& AI::operator=(AI other)
+{
+	mpz_swap(z, other.z);
+	return *this;
+}
+
+AF AI::toAF() const
+{
+	return AF::fromInteger(z);
+}
+
+long AI::toLong() const
+{
+	return mpz_get_si(z);
+}
+
+std::string AI::toString(int base) const
+{
+	std::unique_ptr<char[]> buffer(new char[mpz_sizeinbase(z, base) + 2]);
+	mpz_get_str(buffer.get(), base, z);
+	return std::string(buffer.get());
+}
+
+bool AI::isNegative() const
+{
+	return mpz_sgn(z) < 0;
+}
+
+bool AI::fitsLong() const
+{
+	return mpz_fits_slong_p(z);
+}
+
+size_t AI::bitLength() const
+{
+	return (mpz_sgn(z) == 0) ? 0 : mpz_sizeinbase(z, 2);
+}
+
+AI AI::wrapped(int width) const
+{
+	if (width <= 0) {
+		return *this;
+	}
+	AI r;
+	mpz_fdiv_r_2exp(r.z, z, width);
+	return r;
+}
+
+AI AI::operator&(const AI & b) const
+{
+	AI r;
+	mpz_and(r.z, z, b.z);
+	return r;
+}
+
+AI AI::operator|(const AI & b) const
+{
+	AI r;
+	mpz_ior(r.z, z, b.z);
+	return r;
+}
+
+AI AI::operator^(const AI & b) const
+{
+	AI r;
+	mpz_xor(r.z, z, b.z);
+	return r;
+}
+
+AI AI::complement(int width) const
+{
+	AI r;
+	mpz_com(r.z, z);
+	return r.wrapped(width);
+}
+
+AI AI::twosComplement(int width) const
+{
+	AI r;
+	mpz_neg(r.z, z);
+	return r.wrapped(width);
+}
+
+AI AI::shiftLeft(unsigned long n, int width) const
+{
+	if ((width > 0) && (n >= (unsigned long) width)) {
+		return AI(0L);
+	}
+	AI r;
+	mpz_mul_2exp(r.z, wrapped(width).z, n);
+	return r.wrapped(width);
+}
+
+AI AI::shiftRight(unsigned long n, int width) const
+{
+	AI r;
+	mpz_fdiv_q_2exp(r.z, wrapped(width).z, n);
+	return r;
+}
+
+AI AI::rotateLeft(unsigned long n, int width) const
+{
+	if (width <= 0) {
+		return *this;
+	}
+	n %= width;
+	AI x = wrapped(width);
+	if (n == 0) {
+		return x;
+	}
+	AI high;
+	AI low;
+	mpz_mul_2exp(high.z, x.z, n);
+	mpz_fdiv_q_2exp(low.z, x.z, width - n);
+	return (high | low).wrapped(width);
+}
+
+AI AI::rotateRight(unsigned long n, int width) const
+{
+	if (width <= 0) {
+		return *this;
+	}
+	return rotateLeft(width - (n % width), width);
+}
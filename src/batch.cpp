@@ -0,0 +1,200 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+
+#include "batch.h"
+
+// Rows a worker takes from its own range at a time: enough that the
+// lock isn't noticeable, few enough that there's something to steal
+static const size_t ROWS_PER_TAKE = 32;
+
+BatchEvaluator::BatchEvaluator(size_t threads)
+{
+#if defined(__EMSCRIPTEN__) && ! defined(__EMSCRIPTEN_PTHREADS__)
+	threads = 1;
+#else
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+#endif
+	for (size_t w = 0; w < threads; w++) {
+		stacks.emplace_back();
+		stacks.back().setOption(SaveHistory, false);
+		ranges.emplace_back();
+	}
+	for (size_t w = 1; w < threads; w++) {
+		this->threads.emplace_back(&BatchEvaluator::workerLoop, this, w);
+	}
+}
+
+BatchEvaluator::~BatchEvaluator()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobLock);
+		stopping = true;
+	}
+	jobStarted.notify_all();
+	for (auto & t : threads) {
+		t.join();
+	}
+}
+
+void BatchEvaluator::setOption(CalcOpt o, bool v)
+{
+	if (o == SaveHistory) {
+		return;
+	}
+	for (auto & st : stacks) {
+		st.setOption(o, v);
+	}
+}
+
+size_t BatchEvaluator::threadCount() const
+{
+	return stacks.size();
+}
+
+void BatchEvaluator::evaluate(const Program & program, const std::vector<AF> & inputs, size_t width,
+		std::vector<AF> & results, std::vector<ErrorCode> & errors)
+{
+	size_t rows = (width == 0) ? 0 : (inputs.size() / width);
+	results.assign(rows, AF());
+	errors.assign(rows, NoError);
+	if (rows == 0) {
+		return;
+	}
+
+	size_t workers = stacks.size();
+	for (size_t w = 0; w < workers; w++) {
+		ranges[w].next = rows * w / workers;
+		ranges[w].end = rows * (w + 1) / workers;
+	}
+	{
+		std::lock_guard<std::mutex> lock(jobLock);
+		this->program = &program;
+		this->inputs = inputs.data();
+		this->width = width;
+		this->results = results.data();
+		this->errors = errors.data();
+		digits = AF::getWorkingDigits();
+		rounding = AF::getWorkingRounding();
+		busy = threads.size();
+		generation++;
+	}
+	jobStarted.notify_all();
+
+	work(0);
+
+	std::unique_lock<std::mutex> lock(jobLock);
+	jobFinished.wait(lock, [this]() { return busy == 0; });
+}
+
+void BatchEvaluator::workerLoop(size_t w)
+{
+	uint64_t done = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(jobLock);
+			jobStarted.wait(lock, [&]() { return stopping || (generation != done); });
+			if (stopping) {
+				break;
+			}
+			done = generation;
+		}
+		work(w);
+		std::lock_guard<std::mutex> lock(jobLock);
+		if (--busy == 0) {
+			jobFinished.notify_one();
+		}
+	}
+	// MPFR keeps some constants per thread
+	mpfr_free_cache();
+}
+
+void BatchEvaluator::work(size_t w)
+{
+	AFWorkingDigits wd(digits);
+	AFWorkingRounding wr(rounding);
+	Stack & st = stacks[w];
+	st.setPrecision(digits);
+
+	size_t first, last;
+	while (take(w, first, last)) {
+		for (size_t row = first; row < last; row++) {
+			st.clear();
+			for (size_t i = 0; i < width; i++) {
+				st.push(inputs[row * width + i]);
+			}
+			size_t position;
+			errors[row] = program->run(st, position);
+			results[row] = st.peek();
+		}
+	}
+}
+
+bool BatchEvaluator::take(size_t w, size_t & first, size_t & last)
+{
+	do {
+		Range & r = ranges[w];
+		std::lock_guard<std::mutex> lock(r.lock);
+		if (r.next < r.end) {
+			first = r.next;
+			last = std::min(r.end, first + ROWS_PER_TAKE);
+			r.next = last;
+			return true;
+		}
+	} while (steal(w));
+	return false;
+}
+
+bool BatchEvaluator::steal(size_t w)
+{
+	for (;;) {
+		size_t victim = w;
+		size_t most = 0;
+		for (size_t v = 0; v < ranges.size(); v++) {
+			std::lock_guard<std::mutex> lock(ranges[v].lock);
+			size_t left = ranges[v].end - ranges[v].next;
+			if (left > most) {
+				victim = v;
+				most = left;
+			}
+		}
+		if (most == 0) {
+			return false;
+		}
+
+		// Take the far half, so the victim carries on where it was
+		size_t first, last;
+		{
+			std::lock_guard<std::mutex> lock(ranges[victim].lock);
+			Range & r = ranges[victim];
+			if (r.next == r.end) {
+				// Finished while we were looking
+				continue;
+			}
+			first = r.next + (r.end - r.next) / 2;
+			last = r.end;
+			r.end = first;
+		}
+		std::lock_guard<std::mutex> lock(ranges[w].lock);
+		ranges[w].next = first;
+		ranges[w].end = last;
+		return true;
+	}
+}
@@ -24,9 +24,11 @@
 #include <regex>
 
 #include <sstream>
+#include <string_view>
 
 #include "commands.h"
 #include "strutils.h"
+#include "arpint.h"
 
 CommandHandler::CommandHandler()
 {
@@ -202,14 +204,10 @@ void CommandHandler::updateValueFromText()
 		}
 	}
 	else if (dspBase == baseHexadecimal) {
-		std::istringstream converter { dspState.enteredText };
-		intmax_t value = 0;
-		converter >> std::hex >> value;
-		dspState.enteredValue = AF(value);
+		dspState.enteredValue = AI(dspState.enteredText, 16).toAF();
 	}
 	else if (dspBase == baseBinary) {
-		intmax_t value = std::stoll(dspState.enteredText.c_str(), NULL, 2);
-		dspState.enteredValue = AF(value);
+		dspState.enteredValue = AI(dspState.enteredText, 2).toAF();
 	}
 	else {
 		assert(0);
@@ -224,12 +222,12 @@ void CommandHandler::clearButton()
 		dspState.justPressedEnter = false;
 	}
 	else if (dspState.entering) {
-		if ((dspState.enteredText.length() == 0) || (dspState.enteredValue == AF(0.0))) {
+		if ((dspState.enteredText.length() == 0) || (dspState.enteredValue.isZero())) {
 			st.saveHistory();
 			st.clear();
 		}
 	}
-	else if (st.peek() == AF(0.0)) {
+	else if (st.peek().isZero()) {
 		st.saveHistory();
 		st.clear();
 	}
@@ -336,7 +334,7 @@ void CommandHandler::backspace()
 {
 	if (dspState.entering && ( ! dspState.justPressedEnter)) {
 		int l = dspState.enteredText.length();
-		if (l == 1) {
+		if (l <= 1) {
 			clearButton();
 		}
 		else {
@@ -393,7 +391,7 @@ void CommandHandler::plusMinus()
 	}
 }
 
-AF CommandHandler::getXValue()
+const AF & CommandHandler::getXValue()
 {
 	if (dspState.entering && ( ! dspState.justPressedEnter)) {
 		return dspState.enteredValue;
@@ -405,7 +403,7 @@ AF CommandHandler::getXValue()
 
 std::string CommandHandler::getXDisplay()
 {
-	AF xValue = getXValue();
+	const AF & xValue = getXValue();
 	std::string formattedX = "";
 
 	if ( ! isDecimal()) {
@@ -429,12 +427,14 @@ std::string CommandHandler::getXDisplay()
 	return formattedX;
 }
 
+StackView CommandHandler::getStackView()
+{
+	return st.view(dspState.entering ? &dspState.enteredValue : NULL);
+}
+
 std::string CommandHandler::getStackDisplay()
 {
-	std::vector<AF> sd = st.getStackForDisplay();
-	if (dspState.entering) {
-		sd.insert(sd.begin(), dspState.enteredValue);
-	}
+	StackView sd = getStackView();
 	int l = sd.size();
 	std::string result;
 	std::vector<std::string> prefixes = { "X", "Y", "Z" };
@@ -527,18 +527,16 @@ std::string CommandHandler::getStatusExponent()
 
 std::string CommandHandler::getBaseDisplay()
 {
-	AF xValue = getXValue();
-	int bc;
-	switch(getBitCount()) {
-		case bc8:  bc = 8;  break;
-		case bc16: bc = 16; break;
-		case bc32: bc = 32; break;
-		default:
-		case bc64: bc = 64; break;
-	}
+	const AF & xValue = getXValue();
+	int bc = st.getBitWidth();
 	std::string result = "";
 
-	result += "As " + std::to_string(bc) + "-bit integer:<br><br>";
+	if (bc == 0) {
+		result += "As integer:<br><br>";
+	}
+	else {
+		result += "As " + std::to_string(bc) + "-bit integer:<br><br>";
+	}
 	result += "Dec: " + formatBase(xValue, baseDecimal) + "<br>";
 	result += "Hex: " + formatBase(xValue, baseHexadecimal) + "<br>";
 	result += "Bin: " + formatBase(xValue, baseBinary) + "<br>";
@@ -628,6 +626,20 @@ BitCount CommandHandler::getBitCount()
 	return st.getBitCount();
 }
 
+void CommandHandler::setPrecision(int digits)
+{
+	AFWorkingDigits wd(digits);
+	st.setPrecision(digits);
+	for (auto & [name, value] : varStore) {
+		value.setDigits(st.getPrecision());
+	}
+}
+
+int CommandHandler::getPrecision()
+{
+	return st.getPrecision();
+}
+
 void CommandHandler::nextBitCount()
 {
 	switch (st.getBitCount()) {
@@ -635,7 +647,11 @@ void CommandHandler::nextBitCount()
 		case bc16: setBitCount(bc32); break;
 		default:
 		case bc32: setBitCount(bc64); break;
-		case bc64: setBitCount(bc8);  break;
+		case bc64: setBitCount(bc128); break;
+		case bc128: setBitCount(bc256); break;
+		case bc256: setBitCount(bc512); break;
+		case bc512: setBitCount(bcArbitrary); break;
+		case bcArbitrary: setBitCount(bc8); break;
 	}
 }
 
@@ -696,6 +712,21 @@ void CommandHandler::recall(std::string name)
 	st.push(v);
 }
 
+void CommandHandler::storeStack(std::string name)
+{
+	completeEntering(false);
+	dspState.showAll = false;
+	st.storeStack(name);
+}
+
+void CommandHandler::recallStack(std::string name)
+{
+	dspState.showAll = false;
+	completeEntering(false);
+	st.recallStack(name);
+	st.saveHistory();
+}
+
 ErrorCode CommandHandler::keypresses(std::string charKeys)
 {
 	int l = charKeys.length();
@@ -725,84 +756,357 @@ ErrorCode CommandHandler::keypresses(std::list<std::string> commands)
 	return ec;
 }
 
-ErrorCode CommandHandler::keypress(std::string key)
+bool CommandHandler::isNumberWord(const std::string & word)
 {
-	bool handled = true;
+	size_t i = ((word.length() > 1) && (word[0] == '-')) ? 1 : 0;
+	if ((i < word.length()) && (word[i] == '.')) {
+		i++;
+	}
+	return (i < word.length()) && ('0' <= word[i]) && (word[i] <= '9');
+}
+
+ErrorCode CommandHandler::keypressWord(const std::string & word)
+{
+	if ( ! isNumberWord(word)) {
+		return keypress(word);
+	}
+	// Nothing typed (after clear, say) means the number just starts
+	if (dspState.entering && ( ! dspState.justPressedEnter) && ( ! dspState.enteredText.empty())) {
+		keypress(opEnter);
+	}
+
+	// Signs go after the digits, as they would be typed
+	bool negative = (word[0] == '-');
+	bool inExponent = false;
+	bool negativeExponent = false;
+	for (size_t i = negative ? 1 : 0; i < word.length(); i++) {
+		char c = word[i];
+		if (inExponent && ((c == '-') || (c == '+'))) {
+			negativeExponent = (c == '-');
+		}
+		else if (isDecimal() && ((c == 'e') || (c == 'E'))) {
+			if (negative) {
+				keypress(opPlusMinus);
+				negative = false;
+			}
+			keypress(opExponent);
+			inExponent = true;
+		}
+		else {
+			ErrorCode ec = keypress(std::string(1, c));
+			if (ec != NoError) {
+				return ec;
+			}
+		}
+	}
+	if (negative || negativeExponent) {
+		keypress(opPlusMinus);
+	}
+	return NoError;
+}
+
+// In the same order as OpCode
+const OpEntry CommandHandler::opTable[opCount] = {
+	{false, NULL, [](CommandHandler *) { std::cerr << "No function" << std::endl; return NoFunction; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("0"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("1"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("2"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("3"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("4"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("5"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("6"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("7"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("8"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->numInput("9"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->hexInput("A"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->hexInput("B"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->hexInput("C"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->hexInput("D"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) {
+		if (c->isDecimal()) {
+			c->exponent();
+		}
+		else if (c->dspBase == baseHexadecimal) {
+			c->hexInput("E");
+		}
+		return NoError;
+	}},
+	{false, NULL, [](CommandHandler *c) { c->hexInput("F"); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->dotInput(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->backspace(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->plusMinus(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->clearButton(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->enter(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->exponent(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { std::cout << c->st.peek().toString(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->engRotate(-1); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->engRotate(1); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->dspState.showAll = true; return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->nextBase(); return NoError; }},
+	{false, NULL, [](CommandHandler *c) { c->st.printHistory(); return NoError; }},
+	{true, &Stack::absolute, NULL},
+	{true, &Stack::bitwiseand, NULL},
+	{true, &Stack::bitwisenot, NULL},
+	{true, &Stack::bitwiseor, NULL},
+	{true, &Stack::bitwisexor, NULL},
+	{true, &Stack::twoscomplement, NULL},
+	{true, &Stack::shiftleft, NULL},
+	{true, &Stack::shiftright, NULL},
+	{true, &Stack::rotateleft, NULL},
+	{true, &Stack::rotateright, NULL},
+	{true, &Stack::ceiling, NULL},
+	{false, NULL, [](CommandHandler *c) {
+		std::cerr << "pi" << std::endl;
+		c->completeEntering(false);
+		return c->st.constant("Pi");
+	}},
+	{true, &Stack::cos, NULL},
+	{true, &Stack::cosh, NULL},
+	{true, &Stack::cube, NULL},
+	{true, &Stack::cuberoot, NULL},
+	{true, &Stack::divide, NULL},
+	{true, &Stack::drop, NULL},
+	{true, &Stack::etox, NULL},
+	{true, &Stack::floatingpart, NULL},
+	{true, &Stack::floor, NULL},
+	{true, &Stack::integerdivide, NULL},
+	{true, &Stack::integerpart, NULL},
+	{true, &Stack::inversecos, NULL},
+	{true, &Stack::inversesin, NULL},
+	{true, &Stack::inversetan, NULL},
+	{true, &Stack::inversetan2, NULL},
+	{true, &Stack::inversecosh, NULL},
+	{true, &Stack::inversesinh, NULL},
+	{true, &Stack::inversetanh, NULL},
+	{true, &Stack::inversetanh2, NULL},
+	{true, &Stack::log10, NULL},
+	{true, &Stack::log2, NULL},
+	{true, &Stack::loge, NULL},
+	{true, &Stack::minus, [](CommandHandler *c) {
+		if (c->dspState.entering && (endsWith(c->dspState.enteredText, "e0"))) {
+			c->plusMinus();
+			return NoError;
+		}
+		c->completeEntering(true);
+		ErrorCode ec = c->st.minus();
+		c->st.saveHistory();
+		return ec;
+	}},
+	{true, &Stack::percent, NULL},
+	{true, &Stack::percentchange, NULL},
+	{true, &Stack::plus, NULL},
+	{true, &Stack::power, NULL},
+	{false, &Stack::random, NULL},
+	{true, &Stack::reciprocal, NULL},
+	{true, &Stack::remainder, NULL},
+	{true, &Stack::rollDown, NULL},
+	{true, &Stack::rollUp, NULL},
+	{true, &Stack::pickN, NULL},
+	{true, &Stack::rollN, NULL},
+	{true, &Stack::rollDN, NULL},
+	{true, &Stack::dropN, NULL},
+	{true, &Stack::dupN, NULL},
+	{true, &Stack::reverseN, NULL},
+	{false, &Stack::depth, NULL},
+	{true, &Stack::round, NULL},
+	{true, &Stack::sin, NULL},
+	{true, &Stack::sinh, NULL},
+	{true, &Stack::square, NULL},
+	{true, &Stack::squareroot, NULL},
+	{true, &Stack::swap, NULL},
+	{true, &Stack::tan, NULL},
+	{true, &Stack::tanh, NULL},
+	{true, &Stack::tentox, NULL},
+	{true, &Stack::twotox, NULL},
+	{true, &Stack::times, NULL},
+	{false, NULL, [](CommandHandler *c) { c->completeEntering(false); return c->st.undo(); }},
+	{true, &Stack::xrooty, NULL},
+	{true, &Stack::sum, NULL},
+	{true, &Stack::product, NULL},
+	{true, &Stack::mean, NULL},
+	{true, &Stack::variance, NULL},
+	{true, &Stack::stddev, NULL},
+	{true, &Stack::minimum, NULL},
+	{true, &Stack::maximum, NULL},
+	{true, &Stack::median, NULL},
+	{true, &Stack::percentile, NULL},
+};
+
+static const std::pair<std::string_view, OpCode> opNames[] = {
+	{"0", opDigit0}, {"1", opDigit1}, {"2", opDigit2}, {"3", opDigit3}, {"4", opDigit4},
+	{"5", opDigit5}, {"6", opDigit6}, {"7", opDigit7}, {"8", opDigit8}, {"9", opDigit9},
+	{"A", opHexA}, {"a", opHexA}, {"B", opHexB}, {"b", opHexB}, {"C", opHexC}, {"c", opHexC},
+	{"D", opHexD}, {"d", opHexD}, {"E", opHexE}, {"e", opHexE}, {"F", opHexF}, {"f", opHexF},
+	{".", opDot}, {"dot", opDot},
+	{"backspace", opBackspace},
+	{"plusMinus", opPlusMinus}, {"invert", opPlusMinus},
+	{"clear", opClear},
+	{"enter", opEnter},
+	{"exponent", opExponent},
+	{"display", opDisplay},
+	{"EngL", opEngL},
+	{"EngR", opEngR},
+	{"ShowAll", opShowAll},
+	{"base", opBase},
+	{"debugHistory", opDebugHistory},
+	{"absolute", opAbsolute},
+	{"bitwiseand", opBitwiseAnd},
+	{"bitwisenot", opBitwiseNot},
+	{"bitwiseor", opBitwiseOr},
+	{"bitwisexor", opBitwiseXor},
+	{"twoscomp", opTwosComp},
+	{"shiftleft", opShiftLeft},
+	{"shiftright", opShiftRight},
+	{"rotateleft", opRotateLeft},
+	{"rotateright", opRotateRight},
+	{"ceiling", opCeiling},
+	{"pi", opPi},
+	{"cos", opCos},
+	{"cosh", opCosh},
+	{"cube", opCube},
+	{"cuberoot", opCubeRoot},
+	{"/", opDivide}, {"divide", opDivide},
+	{"drop", opDrop},
+	{"etox", opEToX},
+	{"floatingpart", opFloatingPart},
+	{"floor", opFloor},
+	{"integerdivide", opIntegerDivide},
+	{"integerpart", opIntegerPart},
+	{"inversecos", opInverseCos},
+	{"inversesin", opInverseSin},
+	{"inversetan", opInverseTan},
+	{"inversetan2", opInverseTan2},
+	{"inversecosh", opInverseCosh},
+	{"inversesinh", opInverseSinh},
+	{"inversetanh", opInverseTanh},
+	{"inversetanh2", opInverseTanh2},
+	{"log10", opLog10},
+	{"log2", opLog2},
+	{"loge", opLogE}, {"ln", opLogE},
+	{"-", opMinus}, {"minus", opMinus},
+	{"%", opPercent}, {"percent", opPercent},
+	{"percentchange", opPercentChange},
+	{"+", opPlus}, {"plus", opPlus},
+	{"^", opPower}, {"power", opPower},
+	{"random", opRandom},
+	{"reciprocal", opReciprocal},
+	{"remainder", opRemainder},
+	{"rollDown", opRollDown},
+	{"rollUp", opRollUp},
+	{"pickN", opPickN},
+	{"rollN", opRollN},
+	{"rollDN", opRollDN},
+	{"dropN", opDropN},
+	{"dupN", opDupN},
+	{"reverseN", opReverseN},
+	{"depth", opDepth},
+	{"round", opRound},
+	{"sin", opSin},
+	{"sinh", opSinh},
+	{"square", opSquare},
+	{"r", opSquareRoot}, {"sqrt", opSquareRoot}, {"squareroot", opSquareRoot},
+	{"w", opSwap}, {"swap", opSwap},
+	{"tan", opTan},
+	{"tanh", opTanh},
+	{"tentox", opTenToX},
+	{"twotox", opTwoToX},
+	{"*", opTimes}, {"times", opTimes},
+	{"u", opUndo}, {"undo", opUndo},
+	{"xrooty", opXRootY},
+	{"sum", opSum},
+	{"product", opProduct},
+	{"mean", opMean},
+	{"variance", opVariance},
+	{"stddev", opStdDev},
+	{"minimum", opMinimum},
+	{"maximum", opMaximum},
+	{"median", opMedian},
+	{"percentile", opPercentile},
+};
+
+OpCode CommandHandler::lookupOpCode(const std::string & name)
+{
+	// Sorted once so that each lookup is a binary search
+	static const std::vector<std::pair<std::string_view, OpCode> > sorted = [] {
+		std::vector<std::pair<std::string_view, OpCode> > v(std::begin(opNames), std::end(opNames));
+		std::sort(v.begin(), v.end());
+		return v;
+	}();
+	auto it = std::lower_bound(sorted.begin(), sorted.end(), std::string_view(name),
+			[](const std::pair<std::string_view, OpCode> & e, std::string_view n) { return e.first < n; });
+	if ((it != sorted.end()) && (it->first == name)) {
+		return it->second;
+	}
+	return opNone;
+}
+
+StackOp CommandHandler::getStackOp(OpCode op)
+{
+	if ((op <= opNone) || (op >= opCount)) {
+		return NULL;
+	}
+	return opTable[op].stackOp;
+}
+
+ErrorCode CommandHandler::keypress(OpCode op)
+{
+	if (recording && ( ! playingMacro)) {
+		recordedKeys.push_back({op, ""});
+	}
+
+	// Other stacks may share this thread, so use our own precision
+	AFWorkingDigits wd(st.getPrecision());
 	dspState.showAll = false;
-	if (key != "base") {
+	if (op != opBase) {
 		dspState.justPressedBase = false;
 	}
-	if (( key != "EngL") && (key != "EngR")) {
+	if ((op != opEngL) && (op != opEngR)) {
 		dspState.forcedEngDisplay = false;
 	}
+	if ((op < opNone) || (op >= opCount)) {
+		op = opNone;
+	}
 
-	if (key.length() == 1) {
-		switch (key[0]) {
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				numInput(key);
-				break;
-			case 'A':
-			case 'B':
-			case 'C':
-			case 'D':
-			case 'a':
-			case 'b':
-			case 'c':
-			case 'd':
-			case 'f':
-			case 'F':
-				hexInput(toUpper(key));
-				break;
-			case 'E':
-			case 'e':
-				if (isDecimal()) {
-					exponent();
-				}
-				else if (dspBase == baseHexadecimal) {
-					hexInput("E");
-				}
-				else {
-					// Do nothing
-				}
-				break;
-			case '.':
-				dotInput();
-				break;
-			default:
-				handled = false;
-		}
+	const OpEntry & e = opTable[op];
+	if (e.handler != NULL) {
+		return e.handler(this);
 	}
-	else {
-		if (key == "backspace") { backspace(); }
-		else if ((key == "plusMinus") || (key == "invert")) { plusMinus(); }
-		else if (key == "clear") { clearButton(); }
-		else if (key == "enter") { enter(); }
-		else if (key == "exponent") { exponent(); }
-		else if (key == "display") { std::cout << st.peek().toString(); }
-		else if (key == "dot") { dotInput(); }
-		else if (key == "EngL") { engRotate(-1); }
-		else if (key == "EngR") { engRotate(1); }
-		else if (key == "ShowAll") { dspState.showAll = true; }
-		else if (key == "base") { nextBase(); }
-		else if (key == "debugHistory") { st.printHistory(); }
-		else { handled = false; }
-	}
-
-	if (handled) {
-		return NoError;
+	completeEntering(e.takesValue);
+	ErrorCode ec = (st.*e.stackOp)();
+	st.saveHistory();
+	return ec;
+}
+
+ErrorCode CommandHandler::keypress(std::string key)
+{
+	OpCode op = lookupOpCode(key);
+	if (op != opNone) {
+		return keypress(op);
 	}
 
+	AFWorkingDigits wd(st.getPrecision());
+	dspState.showAll = false;
+	dspState.justPressedBase = false;
+	dspState.forcedEngDisplay = false;
+
 	//std::cerr << "Processing " << key << std::endl;
 
+	if (startsWith(key, "RecordMacro-")) {
+		if (recording) {
+			stopRecording();
+		}
+		else {
+			startRecording(key.substr(12));
+		}
+		return NoError;
+	}
+	if (startsWith(key, "PlayMacro-")) {
+		return playMacro(key.substr(10));
+	}
+	if (recording && ( ! playingMacro)) {
+		recordedKeys.push_back({opNone, key});
+	}
+
 	if (startsWith(key, "Const-")) {
 		completeEntering(false);
 		st.saveHistory();
@@ -818,6 +1122,14 @@ ErrorCode CommandHandler::keypress(std::string key)
 		st.saveHistory();
 		return SI(key.substr(3));
 	}
+	if (startsWith(key, "StoreStack-")) {
+		storeStack(key.substr(11));
+		return NoError;
+	}
+	if (startsWith(key, "RecallStack-")) {
+		recallStack(key.substr(12));
+		return NoError;
+	}
 	if (startsWith(key, "Convert_")) {
 		completeEntering(true);
 		st.saveHistory();
@@ -825,191 +1137,8 @@ ErrorCode CommandHandler::keypress(std::string key)
 		return st.convert(parts[1], parts[2], parts[3]);
 	}
 
-	bool takesValue = true;
-	std::set<std::string> noValueKeys = {"p", "pi", "random", "rUp", "rDown", "undo", "u" };
-
-	if (noValueKeys.contains(key)) {
-		takesValue = false;
-	}
-
-	//std::cerr << key << " takes value: " << takesValue << std::endl;
-
-	ErrorCode ec;
-
-	// This is a much more clunky implementation than the kotlin original
-	// There's probably a cleaner way with C++, but this'll do for now.
-	if (key == "absolute") {
-		completeEntering(takesValue); ec = st.absolute(); st.saveHistory();
-	}
-	else if (key == "bitwiseand") {
-		completeEntering(takesValue); ec = st.bitwiseand(); st.saveHistory();
-	}
-	else if (key == "bitwisenot") {
-		completeEntering(takesValue); ec = st.bitwisenot(); st.saveHistory();
-	}
-	else if (key == "bitwiseor") {
-		completeEntering(takesValue); ec = st.bitwiseor(); st.saveHistory();
-	}
-	else if (key == "bitwisexor") {
-		completeEntering(takesValue); ec = st.bitwisexor(); st.saveHistory();
-	}
-	else if (key == "twoscomp") {
-		completeEntering(takesValue); ec = st.twoscomplement(); st.saveHistory();
-	}
-	else if (key == "ceiling") {
-		completeEntering(takesValue); ec = st.ceiling(); st.saveHistory();
-	}
-	else if (key == "pi") {
-		std::cerr << "pi" << std::endl;
-		completeEntering(false); return st.constant("Pi");
-	}
-	else if (key == "cos") {
-		completeEntering(takesValue); ec = st.cos(); st.saveHistory();
-	}
-	else if (key == "cosh") {
-		completeEntering(takesValue); ec = st.cosh(); st.saveHistory();
-	}
-	else if (key == "cube") {
-		completeEntering(takesValue); ec = st.cube(); st.saveHistory();
-	}
-	else if (key == "cuberoot") {
-		completeEntering(takesValue); ec = st.cuberoot(); st.saveHistory();
-	}
-	else if ((key == "/") || (key == "divide")) {
-		completeEntering(takesValue); ec = st.divide(); st.saveHistory();
-	}
-	else if (key == "drop") {
-		completeEntering(takesValue); ec = st.drop(); st.saveHistory();
-	}
-	else if (key == "etox") {
-		completeEntering(takesValue); ec = st.etox(); st.saveHistory();
-	}
-	else if (key == "floatingpart") {
-		completeEntering(takesValue); ec = st.floatingpart(); st.saveHistory();
-	}
-	else if (key == "floor") {
-		completeEntering(takesValue); ec = st.floor(); st.saveHistory();
-	}
-	else if (key == "integerdivide") {
-		completeEntering(takesValue); ec = st.integerdivide(); st.saveHistory();
-	}
-	else if (key == "integerpart") {
-		completeEntering(takesValue); ec = st.integerpart(); st.saveHistory();
-	}
-	else if (key == "inversecos") {
-		completeEntering(takesValue); ec = st.inversecos(); st.saveHistory();
-	}
-	else if (key == "inversesin") {
-		completeEntering(takesValue); ec = st.inversesin(); st.saveHistory();
-	}
-	else if (key == "inversetan") {
-		completeEntering(takesValue); ec = st.inversetan(); st.saveHistory();
-	}
-	else if (key == "inversetan2") {
-		completeEntering(takesValue); ec = st.inversetan2(); st.saveHistory();
-	}
-	else if (key == "inversecosh") {
-		completeEntering(takesValue); ec = st.inversecosh(); st.saveHistory();
-	}
-	else if (key == "inversesinh") {
-		completeEntering(takesValue); ec = st.inversesinh(); st.saveHistory();
-	}
-	else if (key == "inversetanh") {
-		completeEntering(takesValue); ec = st.inversetanh(); st.saveHistory();
-	}
-	else if (key == "inversetanh2") {
-		completeEntering(takesValue); ec = st.inversetanh2(); st.saveHistory();
-	}
-	else if (key == "log10") {
-		completeEntering(takesValue); ec = st.log10(); st.saveHistory();
-	}
-	else if (key == "log2") {
-		completeEntering(takesValue); ec = st.log2(); st.saveHistory();
-	}
-	else if ((key == "loge") || (key == "ln")) {
-		completeEntering(takesValue); ec = st.loge(); st.saveHistory();
-	}
-	else if ((key == "-") || (key == "minus")) {
-		if (dspState.entering && (endsWith(dspState.enteredText, "e0"))) {
-			plusMinus();
-			return NoError;
-		}
-		else {
-			completeEntering(takesValue); ec = st.minus(); st.saveHistory();
-		}
-	}
-	else if ((key == "%") || (key == "percent")) {
-		completeEntering(takesValue); ec = st.percent(); st.saveHistory();
-	}
-	else if (key == "percentchange") {
-		completeEntering(takesValue); ec = st.percentchange(); st.saveHistory();
-	}
-	else if ((key == "+") || (key == "plus")) {
-		completeEntering(takesValue); ec = st.plus(); st.saveHistory();
-	}
-	else if ((key == "^") || (key == "power")) {
-		completeEntering(takesValue); ec = st.power(); st.saveHistory();
-	}
-	else if (key == "random") {
-		completeEntering(takesValue); ec = st.random(); st.saveHistory();
-	}
-	else if (key == "reciprocal") {
-		completeEntering(takesValue); ec = st.reciprocal(); st.saveHistory();
-	}
-	else if (key == "remainder") {
-		completeEntering(takesValue); ec = st.remainder(); st.saveHistory();
-	}
-	else if (key == "rollDown") {
-		completeEntering(takesValue); ec = st.rollDown(); st.saveHistory();
-	}
-	else if (key == "rollUp") {
-		completeEntering(takesValue); ec = st.rollUp(); st.saveHistory();
-	}
-	else if (key == "round") {
-		completeEntering(takesValue); ec = st.round(); st.saveHistory();
-	}
-	else if (key == "sin") {
-		completeEntering(takesValue); ec = st.sin(); st.saveHistory();
-	}
-	else if (key == "sinh") {
-		completeEntering(takesValue); ec = st.sinh(); st.saveHistory();
-	}
-	else if (key == "square") {
-		completeEntering(takesValue); ec = st.square(); st.saveHistory();
-	}
-	else if ((key == "r") || (key == "sqrt") || (key == "squareroot")) {
-		completeEntering(takesValue); ec = st.squareroot(); st.saveHistory();
-	}
-	else if ((key == "w") || (key == "swap")) {
-		completeEntering(takesValue); ec = st.swap(); st.saveHistory();
-	}
-	else if (key == "tan") {
-		completeEntering(takesValue); ec = st.tan(); st.saveHistory();
-	}
-	else if (key == "tanh") {
-		completeEntering(takesValue); ec = st.tanh(); st.saveHistory();
-	}
-	else if (key == "tentox") {
-		completeEntering(takesValue); ec = st.tentox(); st.saveHistory();
-	}
-	else if (key == "twotox") {
-		completeEntering(takesValue); ec = st.twotox(); st.saveHistory();
-	}
-	else if ((key == "*") || (key == "times")) {
-		completeEntering(takesValue); ec = st.times(); st.saveHistory();
-	}
-	else if ((key == "u") || (key =="undo")) {
-		completeEntering(takesValue); ec = st.undo();
-	}
-	else if (key == "xrooty") {
-		completeEntering(takesValue); ec = st.xrooty(); st.saveHistory();
-	}
-	else {
-		std::cerr << "No function" << std::endl;
-		ec = NoFunction;
-	}
-	//std::cerr << "Result: " << ec << std::endl;
-	return ec;
+	// Already recorded by name
+	return opTable[opNone].handler(this);
 }
 
 std::string CommandHandler::addPeriodic(std::string source, int spacing, std::string insertion)
@@ -1097,7 +1226,7 @@ std::string CommandHandler::europeanDecimal(std::string source)
 	return modified;
 }
 
-std::string CommandHandler::formatBase(AF value, DisplayBase base, bool isX)
+std::string CommandHandler::formatBase(const AF & value, DisplayBase base, bool isX)
 {
 	int bn = 10;
 	std::string prefix = "";
@@ -1123,26 +1252,18 @@ std::string CommandHandler::formatBase(AF value, DisplayBase base, bool isX)
 	}
 
 	std::string formatted;
-	intmax_t asLong = value.toLong();
-	intmax_t mask = st.getBitMask();
-
-	if ((asLong >= 0) || (base == baseDecimal)) {
-		if ( ! isX) {
-			asLong = asLong & mask;
-		}
-		formatted = toUpper(convertWithBase(asLong, bn));
-	}
-	else {
-		intmax_t absolute = asLong;
-		if (absolute < 0) {
-			absolute = - absolute;
-		}
-		intmax_t twoscomp = (~ absolute) + 1;
-		if ( ! isX) {
-			twoscomp = twoscomp & mask;
+	AI asInt(value);
+	int width = st.getBitWidth();
+
+	if ( ! isX) {
+		if ((width == 0) && asInt.isNegative() && (base != baseDecimal)) {
+			// No bit count, so show the two's complement in whole
+			// bytes with room for the sign bit
+			width = (int) ((asInt.bitLength() + 8) / 8) * 8;
 		}
-		formatted = toUpper(convertWithBase(twoscomp, bn));
+		asInt = asInt.wrapped(width);
 	}
+	formatted = toUpper(asInt.toString(bn));
 	if (base == baseBinary) {
 		while ((formatted.length() % 4) != 0) {
 			formatted = "0" + formatted;
@@ -1154,7 +1275,7 @@ std::string CommandHandler::formatBase(AF value, DisplayBase base, bool isX)
 	return prefix + formatted;
 }
 
-ValueAndExp CommandHandler::getValueAndExponent(AF value, bool isX)
+ValueAndExp CommandHandler::getValueAndExponent(const AF & value, bool isX)
 {
 	ValueAndExp result = {AF("0.0"), 0};
 	intmax_t exponent = 0;
@@ -1174,7 +1295,7 @@ ValueAndExp CommandHandler::getValueAndExponent(AF value, bool isX)
 				exponent = dspState.forcedEngFactor;
 			}
 			else {
-				AF exp = absolute.log() / AF("2").log();
+				AF exp = absolute.log() / AF::ln2();
 				exp = exp.floor();
 				exp = exp.round();
 				exp = exp / 10.0;
@@ -1206,10 +1327,10 @@ ValueAndExp CommandHandler::getValueAndExponent(AF value, bool isX)
 			}
 		}
 	}
-	else if (absolute != AF("0")) { // but not binary prefixes
+	else if (absolute.isFinite() && ( ! absolute.isZero())) { // but not binary prefixes
 		if ((isX && dspState.forcedEngDisplay)
-				|| ((absolute < AF(10.0).pow(AF(dspOptions.expNegMinDisplay)))
-					|| ((absolute >= AF(10.0).pow(AF(dspOptions.expPosMaxDisplay)))))) {
+				|| ((absolute < AF::powerOfTen(dspOptions.expNegMinDisplay))
+					|| ((absolute >= AF::powerOfTen(dspOptions.expPosMaxDisplay))))) {
 			if (isX && dspState.forcedEngDisplay) {
 				exponent = dspState.forcedEngFactor;
 			}
@@ -1264,7 +1385,7 @@ std::string CommandHandler::formatEnteredText(std::string value)
 	return formatted;
 }
 
-std::string CommandHandler::formatDecimal(AF value, bool isX, bool constHelpMode)
+std::string CommandHandler::formatDecimal(const AF & value, bool isX, bool constHelpMode)
 {
 	ValueAndExp v = getValueAndExponent(value, isX);
 	AF realnumber = v.value;
@@ -1283,7 +1404,7 @@ std::string CommandHandler::formatDecimal(AF value, bool isX, bool constHelpMode
 		snprintf(buffer, sizeof(buffer), "%.10f", realnumber.toDouble());
 		formatted = buffer;
 	}
-	else if ((realnumber != AF("0")) && dspState.forcedEngDisplay) {
+	else if (( ! realnumber.isZero()) && dspState.forcedEngDisplay) {
 		snprintf(buffer, sizeof(buffer), "%d", places);
 		
 		std::string fmt = "%.";
@@ -1510,11 +1631,11 @@ void CommandHandler::engRotate(int direction)
 
 AF CommandHandler::RoundToDecimalPlaces(AF d, int c)
 {
-	AF ten = AF(10);
-	AF temp = d * ten.pow(AF(c));
+	const AF & scale = AF::powerOfTen(c);
+	AF temp = d * scale;
 	temp = temp.round();
 
-	return temp / ten.pow(AF(c));
+	return temp / scale;
 }
 
 std::string CommandHandler::processCurrencyData(std::map<std::string, double> wrtEuro, std::string date)
@@ -1555,6 +1676,7 @@ void CommandHandler::setDefaultOptions()
 	setSizeName("Medium");
 
 	setPlaces(7);
+	setPrecision(AF::DEFAULT_DIGITS);
 
 	setOption(ReplicateStack, false);
 	setOption(Radians, false);
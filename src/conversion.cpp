@@ -19,53 +19,54 @@
 #include <iostream>
 #include <random>
 #include <chrono>
+#include <charconv> // std::to_chars
 
 #include "stack.h"
 
+// Conversion factors are exact decimal ratios, so they're held as
+// rationals rather than as the nearest double
+static AF ratio(const char *num, const char *den = "1")
+{
+	return AF(num) / AF(den);
+}
+
 ErrorCode Stack::convertKelvinToCelsius()
 {
-	push(pop() - 273.15);
+	setX(peek() - ratio("273.15"));
 	return NoError;
 }
 
 ErrorCode Stack::convertCelsiusToKelvin()
 {
-	push(pop() + 273.15);
+	setX(peek() + ratio("273.15"));
 	return NoError;
 }
 
 ErrorCode Stack::convertFahrenheitToCelsius()
 {
-	push((pop()-32.0)*5.0/9.0);
+	setX((peek() - AF(32)) * AF(5) / AF(9));
 	return NoError;
 }
 
 ErrorCode Stack::convertCelsiusToFahrenheit()
 {
-	push((pop()*9.0/5.0)+32.0);
+	setX(peek() * AF(9) / AF(5) + AF(32));
 	return NoError;
 }
 
 ErrorCode Stack::convertPintsToLitres(bool reverse, bool american)
 {
-	double multiplier;
-	if (american) {
-		multiplier = 0.47317648;
-	}
-	else {
-		multiplier = 0.568261485;
-	}
-
+	AF multiplier = american ? ratio("0.47317648") : ratio("0.568261485");
 	if (reverse) {
-		multiplier = 1.0/multiplier;
+		multiplier = AF(1) / multiplier;
 	}
-	push(pop()*multiplier);
+	setX(takeX()*multiplier);
 	return NoError;
 }
 
 ErrorCode Stack::convertGallonsToPints()
 {
-	return convertMultiplier(8.0);
+	return convertMultiplier(AF(8));
 }
 
 ErrorCode Stack::convertLitresToPints(bool american)
@@ -81,7 +82,7 @@ ErrorCode Stack::convertGallonsToLitres()
 
 ErrorCode Stack::convertPintsToGallons()
 {
-	return convertMultiplier(1.0/8.0);
+	return convertMultiplier(ratio("1", "8"));
 }
 
 ErrorCode Stack::convertLitresToGallons()
@@ -92,77 +93,77 @@ ErrorCode Stack::convertLitresToGallons()
 
 ErrorCode Stack::convertInchToMM()
 {
-	return convertMultiplier(25.4);
+	return convertMultiplier(ratio("25.4"));
 }
 
 ErrorCode Stack::convertMMToInch()
 {
-	return convertMultiplier(1.0/25.4);
+	return convertMultiplier(ratio("1", "25.4"));
 }
 
 ErrorCode Stack::convertRadiansToDegrees()
 {
-	return convertMultiplier(AF(180)/AF::pi());
+	return convertMultiplier(AF::radiansToDegrees());
 }
 
 ErrorCode Stack::convertDegreesToRadians()
 {
-	return convertMultiplier(AF::pi()/180);
+	return convertMultiplier(AF::degreesToRadians());
 }
 
 ErrorCode Stack::convertMilesToKilometres()
 {
-	return convertMultiplier(1.609344);
+	return convertMultiplier(ratio("1.609344"));
 }
 
 ErrorCode Stack::convertKilometresToMiles()
 {
-	return convertMultiplier(1.0/1.609344);
+	return convertMultiplier(ratio("1", "1.609344"));
 }
 
 ErrorCode Stack::convertRPMToHertz()
 {
-	return convertMultiplier(1.0/60.0);
+	return convertMultiplier(ratio("1", "60"));
 }
 
 ErrorCode Stack::convertHertzToRPM()
 {
-	return convertMultiplier(60.0);
+	return convertMultiplier(AF(60));
 }
 
 ErrorCode Stack::convertOuncesToGrams()
 {
-	return convertMultiplier(28.3495231);
+	return convertMultiplier(ratio("28.3495231"));
 }
 
 ErrorCode Stack::convertGramsToOunces()
 {
-	return convertMultiplier(1.0/28.3495231);
+	return convertMultiplier(ratio("1", "28.3495231"));
 }
 
 ErrorCode Stack::convertNewtonMetresToPoundsFeet() {
-	return convertMultiplier(0.737562149277);
+	return convertMultiplier(ratio("0.737562149277"));
 }
 ErrorCode Stack::convertPoundsFeetToNewtonMetres() {
-	return convertMultiplier(1.0/0.737562149277);
+	return convertMultiplier(ratio("1", "0.737562149277"));
 }
 ErrorCode Stack::convertKilogramsToPounds() {
-	return convertMultiplier(1/0.45359237);
+	return convertMultiplier(ratio("1", "0.45359237"));
 }
 ErrorCode Stack::convertPoundsToKilograms() {
-	return convertMultiplier(0.45359237);
+	return convertMultiplier(ratio("0.45359237"));
 }
 ErrorCode Stack::convertKilogramsToStone() {
-	return convertMultiplier(2.2046228/14.0);
+	return convertMultiplier(ratio("2.2046228", "14"));
 }
 ErrorCode Stack::convertStoneToKilograms() {
-	return convertMultiplier(14.0/2.2046228);
+	return convertMultiplier(ratio("14", "2.2046228"));
 }
 ErrorCode Stack::convertGramsToKilograms() {
-	return convertMultiplier(1.0/1000.0);
+	return convertMultiplier(ratio("1", "1000"));
 }
 ErrorCode Stack::convertKilogramsToGrams() {
-	return convertMultiplier(1000.0);
+	return convertMultiplier(AF(1000));
 }
 ErrorCode Stack::convertRadPerSecToHertz() {
 	return convertMultiplier(AF(1.0)/(AF(2.0)*AF::pi()));
@@ -172,33 +173,26 @@ ErrorCode Stack::convertHertzToRadPerSec() {
 }
 
 ErrorCode Stack::convertKilometresPerLitreToLitresPer100KM() {
-	AF kmpl = pop();
-	if (kmpl == AF(0.0)) {
-		push(kmpl);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
-	AF lpkm = AF(1.0) / kmpl;
-	AF lp100km = AF(100.0) * lpkm;
-	push(lp100km);
+	AF lpkm = AF(1.0) / peek();
+	setX(AF(100.0) * std::move(lpkm));
 	return NoError;
 }
 
 ErrorCode Stack::convertLitresPer100KMToKilometresPerLitre() {
-	AF lp100km = pop();
-	if (lp100km == AF(0.0)) {
-		push(lp100km);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
-	AF lpkm = lp100km / AF(100.0);
-	AF kmpl = AF(1.0) / lpkm;
-	push(kmpl);
+	AF lpkm = takeX() / AF(100.0);
+	setX(AF(1.0) / std::move(lpkm));
 	return NoError;
 }
 
 ErrorCode Stack::convertDayOfYearToDateInCurrentYear() {
-	AF dayofyear = pop();
+	const AF & dayofyear = peek();
 	if ((dayofyear < 0) || (dayofyear > 366)) {
-		push(dayofyear);
 		return InvalidConversion;
 	}
 
@@ -233,7 +227,7 @@ ErrorCode Stack::convertDayOfYearToDateInCurrentYear() {
 			result = result + AF(m + 1);
 			result = result / AF("100");
 			result = result + AF(num);
-			push(result);
+			setX(std::move(result));
 			return NoError;
 		} else {
 			num -= dm;
@@ -241,14 +235,11 @@ ErrorCode Stack::convertDayOfYearToDateInCurrentYear() {
 	}
 
 	// Shouldn't ever get here, but if we did, then something's gone wrong
-	push(dayofyear);
 	return InvalidConversion;
 }
 
 ErrorCode Stack::convertDateInCurrentYearToDayOfYear() {
-	AF xval = pop();
-
-	AF date_form = xval;
+	AF date_form = takeX();
 
 	int dom = date_form.floor().toInt();
 	date_form = date_form - date_form.floor();
@@ -282,19 +273,14 @@ ErrorCode Stack::convertDateInCurrentYearToDayOfYear() {
 	AF result(dayofyear);
 	result = result + (AF(year_i) / AF("10000"));
 
-	push(result);
+	setX(std::move(result));
 
 	return NoError;
 }
 
 
-ErrorCode Stack::convertMultiplier(double mult) {
-	push(pop()*mult);
-	return NoError;
-}
-
-ErrorCode Stack::convertMultiplier(AF mult) {
-	push(pop()*mult);
+ErrorCode Stack::convertMultiplier(const AF & mult) {
+	setX(takeX()*mult);
 	return NoError;
 }
 
@@ -523,9 +509,9 @@ void Stack::populateConversionTable()
 	/* Fluid volume conversions */
 	std::vector<Conversion> volumeTable = {
 		{"Pints",              "Fluid Ounces",       NULL,                            20.0},
-		{"Fluid Ounces",       "Pints",              NULL,                            1.0/20.0},
+		{"Fluid Ounces",       "Pints",              NULL,                            ratio("1", "20")},
 		{"US Fluid Ounces",    "Cubic Inches",       NULL,                            1.8046875},
-		{"Cubic Inches",       "US Fluid Ounces",    NULL,                            1.0/1.8046875},
+		{"Cubic Inches",       "US Fluid Ounces",    NULL,                            ratio("1", "1.8046875")},
 		{"US Pints",           "US Fluid Ounces",    NULL,                            16.0},
 		{"US Fluid Ounces",    "US Pints",           NULL,                            1.0/16.0},
 		{"Pints",              "Gallons",            &Stack::convertPintsToGallons,   0.0},
@@ -536,21 +522,21 @@ void Stack::populateConversionTable()
 		{"Litres",             "Pints",              &Stack::convertLitresToUKPints,  0.0},
 		{"US Pints",           "Litres",             &Stack::convertUSPintsToLitres,  0.0},
 		{"Litres",             "US Pints",           &Stack::convertLitresToUSPints,  0.0},
-		{"Millilitres",        "Litres",             NULL,                            1.0/1000.0},
+		{"Millilitres",        "Litres",             NULL,                            ratio("1", "1000")},
 		{"Litres",             "Millilitres",        NULL,                            1000.0},
 		{"Millilitres",        "Cubic Centimetres",  &Stack::returnNoError,           0.0},
 		{"Cubic Centimetres",  "Millilitres",        &Stack::returnNoError,           0.0},
-		{"Litres",             "Cubic Metres",       NULL,                            1.0/1000.0},
+		{"Litres",             "Cubic Metres",       NULL,                            ratio("1", "1000")},
 		{"Cubic Metres",       "Litres",             NULL,                            1000.0},
-		{"Cubic Millimetres",  "Cubic Metres",       NULL,                            1.0e-9},
+		{"Cubic Millimetres",  "Cubic Metres",       NULL,                            ratio("1", "1000000000")},
 		{"Cubic Metres",       "Cubic Millimetres",  NULL,                            1.0e9},
-		{"Cubic Decimetres",   "Cubic Metres",       NULL,                            1.0/1000.0},
+		{"Cubic Decimetres",   "Cubic Metres",       NULL,                            ratio("1", "1000")},
 		{"Cubic Metres",       "Cubic Decimetres",   NULL,                            1000.0},
-		{"Millilitres",        "Cubic Inches",       NULL,                            1.0/(2.54*2.54*2.54)},
-		{"Cubic Inches",       "Millilitres",        NULL,                            2.54*2.54*2.54},
-		{"Cubic Inches",       "Cubic Feet",         NULL,                            1.0/1728.0},
+		{"Millilitres",        "Cubic Inches",       NULL,                            ratio("1", "16.387064")},
+		{"Cubic Inches",       "Millilitres",        NULL,                            ratio("16.387064")},
+		{"Cubic Inches",       "Cubic Feet",         NULL,                            ratio("1", "1728")},
 		{"Cubic Feet",         "Cubic Inches",       NULL,                            1728.0},
-		{"Cubic Feet",         "Cubic Yards",        NULL,                            1.0/27.0},
+		{"Cubic Feet",         "Cubic Yards",        NULL,                            ratio("1", "27")},
 		{"Cubic Yards",        "Cubic Feet",         NULL,                            27.0}
 	};
 	conversionTable["Volume"] = volumeTable;
@@ -565,18 +551,18 @@ void Stack::populateConversionTable()
 		{"Kilograms",         "Stone",             &Stack::convertKilogramsToStone,   0.0},
 		{"Stone",             "Kilograms",         &Stack::convertStoneToKilograms,   0.0},
 		{"Grams",             "Microgram",         NULL,                              1e6},
-		{"Microgram",         "Grams",             NULL,                              1.0/(1e6)},
+		{"Microgram",         "Grams",             NULL,                              ratio("1", "1000000")},
 		{"Grams",             "Milligrams",        NULL,                              1000.0},
-		{"Milligrams",        "Grams",             NULL,                              1.0/1000.0},
+		{"Milligrams",        "Grams",             NULL,                              ratio("1", "1000")},
 		{"Tonnes",            "Kilograms",         NULL,                              1000.0},
-		{"Kilograms",         "Tonnes",            NULL,                              1.0/1000.0},
+		{"Kilograms",         "Tonnes",            NULL,                              ratio("1", "1000")},
 		{"Stone",             "Hundredweight",     NULL,                              1.0/8.0},
 		{"Hundredweight",     "Stone",             NULL,                              8.0},
-		{"Pounds",            "US Hundredweight",  NULL,                              1.0/100.0},
+		{"Pounds",            "US Hundredweight",  NULL,                              ratio("1", "100")},
 		{"US Hundredweight",  "Pounds",            NULL,                              100.0},
-		{"Hundredweight",     "Tons",              NULL,                              1.0/20.0},
+		{"Hundredweight",     "Tons",              NULL,                              ratio("1", "20")},
 		{"Tons",              "Hundredweight",     NULL,                              20.0},
-		{"Pounds",            "US Tons",           NULL,                              1.0/2000.0},
+		{"Pounds",            "US Tons",           NULL,                              ratio("1", "2000")},
 		{"US Tons",           "Pounds",            NULL,                              2000.0}
 	};
 	conversionTable["Mass"] = massTable;
@@ -585,23 +571,23 @@ void Stack::populateConversionTable()
 		{"Pound-Force Feet",            "Newton Metres",               &Stack::convertPoundsFeetToNewtonMetres,  0.0},
 		{"Newton Metres",               "Pound-Force Feet",            &Stack::convertNewtonMetresToPoundsFeet,  0.0},
 		{"Newton Metres",               "Newton Centimetres",          NULL,                                     100.0},
-		{"Newton Centimetres",          "Newton Metres",               NULL,                                     1.0/100.0},
+		{"Newton Centimetres",          "Newton Metres",               NULL,                                     ratio("1", "100")},
 		{"Newton Metres",               "Newton Millimetres",          NULL,                                     1000.0},
-		{"Newton Millimetres",          "Newton Metres",               NULL,                                     1.0/1000.0},
-		{"Newton Metres",               "Kilogram-Force Metres",       NULL,                                     1.0/9.80665},
-		{"Kilogram-Force Metres",       "Newton Metres",               NULL,                                     9.80665},
+		{"Newton Millimetres",          "Newton Metres",               NULL,                                     ratio("1", "1000")},
+		{"Newton Metres",               "Kilogram-Force Metres",       NULL,                                     ratio("1", "9.80665")},
+		{"Kilogram-Force Metres",       "Newton Metres",               NULL,                                     ratio("9.80665")},
 		{"Kilogram-Force Metres",       "Kilogram-Force Centimetres",  NULL,                                     100.0},
-		{"Kilogram-Force Centimetres",  "Kilogram-Force Metres",       NULL,                                     1.0/100.0},
+		{"Kilogram-Force Centimetres",  "Kilogram-Force Metres",       NULL,                                     ratio("1", "100")},
 		{"Kilogram-Force Metres",       "Kilogram-Force Millimetres",  NULL,                                     1000.0},
-		{"Kilogram-Force Millimetres",  "Kilogram-Force Metres",       NULL,                                     1.0/1000.0},
+		{"Kilogram-Force Millimetres",  "Kilogram-Force Metres",       NULL,                                     ratio("1", "1000")},
 		{"Kilogram-Force Metres",       "Gram-Force Metres",           NULL,                                     1000.0},
-		{"Gram-Force Metres",           "Kilogram-Force Metres",       NULL,                                     1.0/1000.0},
+		{"Gram-Force Metres",           "Kilogram-Force Metres",       NULL,                                     ratio("1", "1000")},
 		{"Gram-Force Metres",           "Gram-Force Millimetres",      NULL,                                     1000.0},
-		{"Gram-Force Millimetres",      "Gram-Force Metres",           NULL,                                     1.0/1000.0},
+		{"Gram-Force Millimetres",      "Gram-Force Metres",           NULL,                                     ratio("1", "1000")},
 		{"Gram-Force Metres",           "Gram-Force Centimetres",      NULL,                                     100.0},
-		{"Gram-Force Centimetres",      "Gram-Force Metres",           NULL,                                     1.0/100.0},
+		{"Gram-Force Centimetres",      "Gram-Force Metres",           NULL,                                     ratio("1", "100")},
 		{"Pound-Force Feet",            "Pound-Force Inches",          NULL,                                     12.0},
-		{"Pound-Force Inches",          "Pound-Force Feet",            NULL,                                     1.0/12.0},
+		{"Pound-Force Inches",          "Pound-Force Feet",            NULL,                                     ratio("1", "12")},
 		{"Pound-Force Feet",            "Ounce-Force Feet",            NULL,                                     16.0},
 		{"Ounce-Force Feet",            "Pound-Force Feet",            NULL,                                     1.0/16.0},
 		{"Pound-Force Inches",          "Ounce-Force Inches",          NULL,                                     16.0},
@@ -609,33 +595,33 @@ void Stack::populateConversionTable()
 	};
 	conversionTable["Torque"] = torqueTable;
 	std::vector<Conversion> speedTable = {
-		{"Metres Per Second",    "Kilometres Per Hour",  NULL,                     3.6},
-		{"Kilometres Per Hour",  "Metres Per Second",    NULL,                     1.0/3.6},
+		{"Metres Per Second",    "Kilometres Per Hour",  NULL,                     ratio("3.6")},
+		{"Kilometres Per Hour",  "Metres Per Second",    NULL,                     ratio("1", "3.6")},
 		{"Kilometres Per Hour",  "Metres Per Hour",      NULL,                     1000.0},
-		{"Metres Per Hour",      "Kilometres Per Hour",  NULL,                     1.0/1000.0},
-		{"Miles Per Hour",       "Feet Per Second",      NULL,                     1760.0 * 3.0 / (3600.0)},
-		{"Feet Per Second",      "Miles Per Hour",       NULL,                     1.0/(1760.0 * 3.0 / (3600.0))},
+		{"Metres Per Hour",      "Kilometres Per Hour",  NULL,                     ratio("1", "1000")},
+		{"Miles Per Hour",       "Feet Per Second",      NULL,                     ratio("5280", "3600")},
+		{"Feet Per Second",      "Miles Per Hour",       NULL,                     ratio("3600", "5280")},
 		{"Miles Per Hour",       "Kilometres Per Hour",  &Stack::convertMPHToKMH,  0.0},
 		{"Kilometres Per Hour",  "Miles Per Hour",       &Stack::convertKMHToMPH,  0.0},
 		{"Knots",                "Metres Per Hour",      NULL,                     1852.0},
-		{"Metres Per Hour",      "Knots",                NULL,                     1.0/1852.0}
+		{"Metres Per Hour",      "Knots",                NULL,                     ratio("1", "1852")}
 	};
 	conversionTable["Speed"] = speedTable;
 	std::vector<Conversion> timeTable = {
 		{"Seconds",                "Nanoseconds",            NULL,                       1e9},
-		{"Nanoseconds",            "Seconds",                NULL,                       1.0/(1e9)},
+		{"Nanoseconds",            "Seconds",                NULL,                       ratio("1", "1000000000")},
 		{"Seconds",                "Microseconds",           NULL,                       1e6},
-		{"Microseconds",           "Seconds",                NULL,                       1.0/(1e6)},
+		{"Microseconds",           "Seconds",                NULL,                       ratio("1", "1000000")},
 		{"Seconds",                "Milliseconds",           NULL,                       1e3},
-		{"Milliseconds",           "Seconds",                NULL,                       1.0/(1e3)},
+		{"Milliseconds",           "Seconds",                NULL,                       ratio("1", "1000")},
 		{"Minutes",                "Seconds",                NULL,                       60.0},
-		{"Seconds",                "Minutes",                NULL,                       1.0/60.0},
+		{"Seconds",                "Minutes",                NULL,                       ratio("1", "60")},
 		{"Hours",                  "Minutes",                NULL,                       60.0},
-		{"Minutes",                "Hours",                  NULL,                       1.0/60.0},
+		{"Minutes",                "Hours",                  NULL,                       ratio("1", "60")},
 		{"Days",                   "Hours",                  NULL,                       24.0},
-		{"Hours",                  "Days",                   NULL,                       1.0/24.0},
+		{"Hours",                  "Days",                   NULL,                       ratio("1", "24")},
 		{"Weeks",                  "Days",                   NULL,                       7.0},
-		{"Days",                   "Weeks",                  NULL,                       1.0/7.0},
+		{"Days",                   "Weeks",                  NULL,                       ratio("1", "7")},
 		{"Hours",                  "Hours.Minutes-Seconds",  &Stack::convertHoursToHms,  0.0},
 		{"Hours.Minutes-Seconds",  "Hours",                  &Stack::convertHmsToHours,  0.0}
 		// "Years (Julian)":Days / 365.25
@@ -651,56 +637,56 @@ void Stack::populateConversionTable()
 	conversionTable["Date"] = dateTable;
 	std::vector<Conversion> forceTable = {
 		{"Newtons",         "Micronewtons",    NULL,  1e6},
-		{"Micronewtons",    "Newtons",         NULL,  1.0/1e6},
+		{"Micronewtons",    "Newtons",         NULL,  ratio("1", "1000000")},
 		{"Newtons",         "Millinewtons",    NULL,  1e3},
-		{"Millinewtons",    "Newtons",         NULL,  1.0/1e3},
+		{"Millinewtons",    "Newtons",         NULL,  ratio("1", "1000")},
 		{"Kilonewtons",     "Newtons",         NULL,  1e3},
-		{"Newtons",         "Kilonewtons",     NULL,  1.0/1e3},
-		{"Kilogram-Force",  "Newtons",         NULL,  9.80665},
-		{"Newtons",         "Kilogram-Force",  NULL,  1.0/9.80665},
+		{"Newtons",         "Kilonewtons",     NULL,  ratio("1", "1000")},
+		{"Kilogram-Force",  "Newtons",         NULL,  ratio("9.80665")},
+		{"Newtons",         "Kilogram-Force",  NULL,  ratio("1", "9.80665")},
 		{"Kilogram-Force",  "Gram-Force",      NULL,  1000.0},
-		{"Gram-Force",      "Kilogram-Force",  NULL,  1.0/1000.0},
-		{"Pound-Force",     "Newtons",         NULL,  4.4482216152605},
-		{"Newtons",         "Pound-Force",     NULL,  1.0/4.4482216152605},
+		{"Gram-Force",      "Kilogram-Force",  NULL,  ratio("1", "1000")},
+		{"Pound-Force",     "Newtons",         NULL,  ratio("4.4482216152605")},
+		{"Newtons",         "Pound-Force",     NULL,  ratio("1", "4.4482216152605")},
 		{"Pound-Force",     "Ounce-Force",     NULL,  16.0},
 		{"Ounce-Force",     "Pound-Force",     NULL,  1.0/16.0}
 	};
 	conversionTable["Force"] = forceTable;
 	std::vector<Conversion> pressureTable = {
-		{"Pascal",                "Hectopascal",           NULL,  1.0/100.0},
+		{"Pascal",                "Hectopascal",           NULL,  ratio("1", "100")},
 		{"Hectopascal",           "Pascal",                NULL,  100.0},
-		{"Pascal",                "Kilopascal",            NULL,  1.0/1e3},
+		{"Pascal",                "Kilopascal",            NULL,  ratio("1", "1000")},
 		{"Kilopascal",            "Pascal",                NULL,  1e3},
-		{"Pascal",                "Megapascal",            NULL,  1.0/1e6},
+		{"Pascal",                "Megapascal",            NULL,  ratio("1", "1000000")},
 		{"Megapascal",            "Pascal",                NULL,  1e6},
 		{"Millibar",              "Pascal",                NULL,  100.0},
-		{"Pascal",                "Millibar",              NULL,  1.0/100.0},
-		{"Millibar",              "Bar",                   NULL,  1.0/1000.0},
+		{"Pascal",                "Millibar",              NULL,  ratio("1", "100")},
+		{"Millibar",              "Bar",                   NULL,  ratio("1", "1000")},
 		{"Bar",                   "Millibar",              NULL,  1000.0},
-		{"Pascal",                "Atmosphere",            NULL,  1.0/101325.0},
+		{"Pascal",                "Atmosphere",            NULL,  ratio("1", "101325")},
 		{"Atmosphere",            "Pascal",                NULL,  101325.0},
-		{"Kilopascal",            "Kilograms Per Sq. cm",  NULL,  1.0/98.0665},
-		{"Kilograms Per Sq. cm",  "Kilopascal",            NULL,  98.0665},
-		{"Pascal",                "Pounds Per Sq. Inch",   NULL,  1.0/6894.780176784},
-		{"Pounds Per Sq. Inch",   "Pascal",                NULL,  6894.780176784},
-		{"Pascal",                "Inches of Mercury",     NULL,  1.0/3386.389},
-		{"Inches of Mercury",     "Pascal",                NULL,  3386.389},
-		{"Torr",                  "Atmosphere",            NULL,  1.0/760.0},
+		{"Kilopascal",            "Kilograms Per Sq. cm",  NULL,  ratio("1", "98.0665")},
+		{"Kilograms Per Sq. cm",  "Kilopascal",            NULL,  ratio("98.0665")},
+		{"Pascal",                "Pounds Per Sq. Inch",   NULL,  ratio("1", "6894.780176784")},
+		{"Pounds Per Sq. Inch",   "Pascal",                NULL,  ratio("6894.780176784")},
+		{"Pascal",                "Inches of Mercury",     NULL,  ratio("1", "3386.389")},
+		{"Inches of Mercury",     "Pascal",                NULL,  ratio("3386.389")},
+		{"Torr",                  "Atmosphere",            NULL,  ratio("1", "760")},
 		{"Atmosphere",            "Torr",                  NULL,  760.0}
 	};
 	conversionTable["Pressure"] = pressureTable;
 	// TODO Review got here
 	std::vector<Conversion> energyTable = {
 		{"Kilojoules",      "Joules",          NULL,  1000.0},
-		{"Joules",          "Kilojoules",      NULL,  1.0/1000.0},
+		{"Joules",          "Kilojoules",      NULL,  ratio("1", "1000")},
 		{"Megajoules",      "Kilojoules",      NULL,  1000.0},
-		{"Kilojoules",      "Megajoules",      NULL,  1.0/1000.0},
-		{"Joules",          "Kilowatt-Hours",  NULL,  1.0/3.6e6},
+		{"Kilojoules",      "Megajoules",      NULL,  ratio("1", "1000")},
+		{"Joules",          "Kilowatt-Hours",  NULL,  ratio("1", "3600000")},
 		{"Kilowatt-Hours",  "Joules",          NULL,  3.6e6},
-		{"Joules",          "Kilocalories",    NULL,  1.0/4184.0},
+		{"Joules",          "Kilocalories",    NULL,  ratio("1", "4184")},
 		{"Kilocalories",    "Joules",          NULL,  4184.0},
 		{"Kilocalories",    "Calories",        NULL,  1000.0},
-		{"Calories",        "Kilocalories",    NULL,  1.0/1000.0}
+		{"Calories",        "Kilocalories",    NULL,  ratio("1", "1000")}
 		// "British Thermal Units", "BTU"
 	};
 	conversionTable["Energy"] = energyTable;
@@ -713,23 +699,23 @@ void Stack::populateConversionTable()
 	};
 	conversionTable["Temperature"] = temperatureTable;
 	std::vector<Conversion> areaTable = {
-		{"Sq. Millimetres",  "Sq. Metres",       NULL,  1.0/1e6},
+		{"Sq. Millimetres",  "Sq. Metres",       NULL,  ratio("1", "1000000")},
 		{"Sq. Metres",       "Sq. Millimetres",  NULL,  1e6},
-		{"Sq. Centimetres",  "Sq. Metres",       NULL,  1.0/10000.0},
+		{"Sq. Centimetres",  "Sq. Metres",       NULL,  ratio("1", "10000")},
 		{"Sq. Metres",       "Sq. Centimetres",  NULL,  10000.0},
-		{"Sq. Metres",       "Sq. Kilometres",   NULL,  1.0/1e6},
+		{"Sq. Metres",       "Sq. Kilometres",   NULL,  ratio("1", "1000000")},
 		{"Sq. Kilometres",   "Sq. Metres",       NULL,  1e6},
-		{"Sq. Metres",       "Hectares",         NULL,  1.0/10000.0},
+		{"Sq. Metres",       "Hectares",         NULL,  ratio("1", "10000")},
 		{"Hectares",         "Sq. Metres",       NULL,  10000.0},
-		{"Sq. Millimetres",  "Sq. Inches",       NULL,  1.0/(25.4*25.4)},
-		{"Sq. Inches",       "Sq. Millimetres",  NULL,  25.4*25.4},
-		{"Sq. Inches",       "Sq. Feet",         NULL,  1.0/(12.0*12.0)},
+		{"Sq. Millimetres",  "Sq. Inches",       NULL,  ratio("1", "645.16")},
+		{"Sq. Inches",       "Sq. Millimetres",  NULL,  ratio("645.16")},
+		{"Sq. Inches",       "Sq. Feet",         NULL,  ratio("1", "144")},
 		{"Sq. Feet",         "Sq. Inches",       NULL,  12.0*12.0},
-		{"Sq. Feet",         "Sq. Yards",        NULL,  1.0/9.0},
+		{"Sq. Feet",         "Sq. Yards",        NULL,  ratio("1", "9")},
 		{"Sq. Yards",        "Sq. Feet",         NULL,  9.0},
-		{"Sq. Yards",        "Acres",            NULL,  1.0/4840.0},
+		{"Sq. Yards",        "Acres",            NULL,  ratio("1", "4840")},
 		{"Acres",            "Sq. Yards",        NULL,  4840.0},
-		{"Sq. Yards",        "Sq. Miles",        NULL,  1.0/(1760.0*1760.0)},
+		{"Sq. Yards",        "Sq. Miles",        NULL,  ratio("1", "3097600")},
 		{"Sq. Miles",        "Sq. Yards",        NULL,  1760.0*1760.0}
 	};
 	conversionTable["Area"] = areaTable;
@@ -743,13 +729,13 @@ void Stack::populateConversionTable()
 		{"Tebibytes",  "Gibibytes",  NULL,  1024.0},
 		{"Gibibytes",  "Tebibytes",  NULL,  1.0/1024.0},
 		{"Kilobytes",  "Bytes",      NULL,  1000.0},
-		{"Bytes",      "Kilobytes",  NULL,  1.0/1000.0},
+		{"Bytes",      "Kilobytes",  NULL,  ratio("1", "1000")},
 		{"Megabytes",  "Kilobytes",  NULL,  1000.0},
-		{"Kilobytes",  "Megabytes",  NULL,  1.0/1000.0},
+		{"Kilobytes",  "Megabytes",  NULL,  ratio("1", "1000")},
 		{"Gigabytes",  "Megabytes",  NULL,  1000.0},
-		{"Megabytes",  "Gigabytes",  NULL,  1.0/1000.0},
+		{"Megabytes",  "Gigabytes",  NULL,  ratio("1", "1000")},
 		{"Terabytes",  "Gigabytes",  NULL,  1000.0},
-		{"Gigabytes",  "Terabytes",  NULL,  1.0/1000.0}
+		{"Gigabytes",  "Terabytes",  NULL,  ratio("1", "1000")}
 	};
 	conversionTable["Data Size"] = dataSizeTable;
 	/* Distance conversions */
@@ -757,43 +743,43 @@ void Stack::populateConversionTable()
 		{"Inches",          "Millimetres",     &Stack::convertInchToMM,  0.0},
 		{"Millimetres",     "Inches",          &Stack::convertMMToInch,  0.0},
 		{"Metres",          "Millimetres",     NULL,                     1000.0},
-		{"Millimetres",     "Metres",          NULL,                     1.0/1000.0},
+		{"Millimetres",     "Metres",          NULL,                     ratio("1", "1000")},
 		{"Millimetres",     "Microns",         NULL,                     1000.0},
-		{"Microns",         "Millimetres",     NULL,                     1.0/1000.0},
-		{"Nanometres",      "Microns",         NULL,                     1.0/1000.0},
+		{"Microns",         "Millimetres",     NULL,                     ratio("1", "1000")},
+		{"Nanometres",      "Microns",         NULL,                     ratio("1", "1000")},
 		{"Microns",         "Nanometres",      NULL,                     1000.0},
 		{"Micrometres",     "Microns",         &Stack::returnNoError,    0.0},
 		{"Microns",         "Micrometres",     &Stack::returnNoError,    0.0},
 		{"Nanometres",      "Angstroms",       NULL,                     10.0},
-		{"Angstroms",       "Nanometres",      NULL,                     0.1},
+		{"Angstroms",       "Nanometres",      NULL,                     ratio("0.1")},
 		{"Metres",          "Centimetres",     NULL,                     100.0},
-		{"Centimetres",     "Metres",          NULL,                     1.0/100.0},
+		{"Centimetres",     "Metres",          NULL,                     ratio("1", "100")},
 		{"Kilometres",      "Metres",          NULL,                     1000.0},
-		{"Metres",          "Kilometres",      NULL,                     1.0/1000.0},
+		{"Metres",          "Kilometres",      NULL,                     ratio("1", "1000")},
 		{"Inches",          "Thou",            NULL,                     1000.0},
-		{"Thou",            "Inches",          NULL,                     1.0/1000.0},
+		{"Thou",            "Inches",          NULL,                     ratio("1", "1000")},
 		{"Inches",          "Points",          NULL,                     72.0},
-		{"Points",          "Inches",          NULL,                     1.0/72.0},
-		{"Inches",          "Feet",            NULL,                     1.0/12.0},
+		{"Points",          "Inches",          NULL,                     ratio("1", "72")},
+		{"Inches",          "Feet",            NULL,                     ratio("1", "12")},
 		{"Feet",            "Inches",          NULL,                     12.0},
 		{"Yards",           "Feet",            NULL,                     3.0},
-		{"Feet",            "Yards",           NULL,                     1.0/3.0},
-		{"Yards",           "Miles",           NULL,                     1.0/1760.0},
+		{"Feet",            "Yards",           NULL,                     ratio("1", "3")},
+		{"Yards",           "Miles",           NULL,                     ratio("1", "1760")},
 		{"Miles",           "Yards",           NULL,                     1760.0},
-		{"Yards",           "Furlongs",        NULL,                     1.0/220.0},
+		{"Yards",           "Furlongs",        NULL,                     ratio("1", "220")},
 		{"Furlongs",        "Yards",           NULL,                     220.0},
 		{"Metres",          "Microns",         NULL,                     1e6},
-		{"Microns",         "Metres",          NULL,                     1.0/1e6},
+		{"Microns",         "Metres",          NULL,                     ratio("1", "1000000")},
 		{"Mils",            "Thou",            &Stack::returnNoError,    0.0},
 		{"Thou",            "Mils",            &Stack::returnNoError,    0.0},
 		{"Nautical Miles",  "Metres",          NULL,                     1852.0},
-		{"Metres",          "Nautical Miles",  NULL,                     1.0/1852.0},
+		{"Metres",          "Nautical Miles",  NULL,                     ratio("1", "1852")},
 		{"Fathoms",         "Feet",            NULL,                     6.0},
-		{"Feet",            "Fathoms",         NULL,                     1.0/6.0},
+		{"Feet",            "Fathoms",         NULL,                     ratio("1", "6")},
 		{"Chains",          "Yards",           NULL,                     22.0},
-		{"Yards",           "Chains",          NULL,                     1.0/22.0},
+		{"Yards",           "Chains",          NULL,                     ratio("1", "22")},
 		{"Light Years",     "Metres",          NULL,                     9460730472580800.0},
-		{"Metres",          "Light Years",     NULL,                     1.0/9460730472580800.0}
+		{"Metres",          "Light Years",     NULL,                     ratio("1", "9460730472580800")}
 	};
 	conversionTable["Distance"] = distanceTable;
 	/* Angular conversions */
@@ -808,16 +794,16 @@ void Stack::populateConversionTable()
 	conversionTable["Angle"] = angleTable;
 	/* Power conversions */
 	std::vector<Conversion> powerTable = {
-		{"Watts",                "Kilowatts",            NULL,  1.0/1000.0},
+		{"Watts",                "Kilowatts",            NULL,  ratio("1", "1000")},
 		{"Kilowatts",            "Watts",                NULL,  1000.0},
-		{"Watts",                "Horsepower (Mech)",    NULL,  1.0/745.69987158227022},
-		{"Horsepower (Mech)",    "Watts",                NULL,  745.69987158227022},
-		{"Horsepower (Metric)",  "Watts",                NULL,  735.49875},
-		{"Watts",                "Horsepower (Metric)",  NULL,  1.0/735.49875},
+		{"Watts",                "Horsepower (Mech)",    NULL,  ratio("1", "745.69987158227022")},
+		{"Horsepower (Mech)",    "Watts",                NULL,  ratio("745.69987158227022")},
+		{"Horsepower (Metric)",  "Watts",                NULL,  ratio("735.49875")},
+		{"Watts",                "Horsepower (Metric)",  NULL,  ratio("1", "735.49875")},
 		{"Megawatts",            "Watts",                NULL,  1e6},
-		{"Watts",                "Megawatts",            NULL,  1.0/1e6},
-		{"Calories Per Second",  "Watts",                NULL,  4.184},
-		{"Watts",                "Calories Per Second",  NULL,  1.0/4.184}
+		{"Watts",                "Megawatts",            NULL,  ratio("1", "1000000")},
+		{"Calories Per Second",  "Watts",                NULL,  ratio("4.184")},
+		{"Watts",                "Calories Per Second",  NULL,  ratio("1", "4.184")}
 		// "BTUs Per Hour", "BTU/h"
 	};
 	conversionTable["Power"] = powerTable;
@@ -849,8 +835,13 @@ void Stack::registerCurrencies(std::map<std::string, double> wrtEuro)
 	for (auto const& [name, euros] : wrtEuro) {
 		if (currencyMap.contains(name)) {
 			std::string currencyName = currencyMap[name];
-			Conversion convFrom = {"Euros", currencyName, NULL, euros};
-			Conversion convTo = {currencyName, "Euros", NULL, 1.0/euros};
+			// Rates are published as decimals, so use the decimal
+			// that the double was read from
+			char digits[32];
+			*std::to_chars(digits, digits + sizeof(digits) - 1, euros).ptr = '\0';
+			AF rate(digits);
+			Conversion convFrom = {"Euros", currencyName, NULL, rate};
+			Conversion convTo = {currencyName, "Euros", NULL, AF(1) / rate};
 			conversions.push_back(convFrom);
 			conversions.push_back(convTo);
 		}
@@ -882,9 +873,9 @@ bool Stack::seenConv(std::vector<Conversion> path, std::string to)
 std::vector<Conversion> Stack::getConvPathsFrom(std::string type, std::string from, std::vector<Conversion> pathSoFar)
 {
 	std::vector<Conversion> result;
-	std::vector<Conversion> conversionList = conversionTable[type];
+	const std::vector<Conversion> & conversionList = conversionTable[type];
 
-	for (Conversion conversion: conversionList) {
+	for (const Conversion & conversion: conversionList) {
 		if ((conversion.from == from) && ( ! seenConv(pathSoFar, conversion.to))) {
 			result.push_back(conversion);
 		}
@@ -937,9 +928,9 @@ ErrorCode Stack::convert(std::string type, std::string from,  std::string to)
 	if ( ! conversionTable.contains(type)) {
 		return UnknownConversion;
 	}
-	std::vector<Conversion> conversionList = conversionTable[type];
+	const std::vector<Conversion> & conversionList = conversionTable[type];
 
-	for (Conversion conversion : conversionList) {
+	for (const Conversion & conversion : conversionList) {
 		if (conversion.from == from) {
 			foundFrom = true;
 		}
@@ -960,7 +951,13 @@ ErrorCode Stack::convert(std::string type, std::string from,  std::string to)
 		return UnknownConversion;
 	}
 
-	std::vector<AF> stackCopy = stack;
+	// A step that fails leaves the stack as it was, so this is only
+	// needed to undo the earlier steps (and copies nothing unless one
+	// does fail)
+	StackSnapshot before;
+	if (conversionPath.size() > 1) {
+		before = snapshot();
+	}
 	ErrorCode result;
 #ifdef CONVERT_DEBUG
 	std::cerr
@@ -968,12 +965,12 @@ ErrorCode Stack::convert(std::string type, std::string from,  std::string to)
 		<< " to " << to << std::endl;
 	int step = 0;
 #endif
-	for (Conversion conv : conversionPath) {
+	for (const Conversion & conv : conversionPath) {
 #ifdef CONVERT_DEBUG
 		std::cerr << " Path " << step++ << ": "
 			<< conv.from << " to " << conv.to;
 		if (conv.ConvFunc == NULL) {
-			std::cerr << " with multiplier " << conv.multiplier << std::endl;
+			std::cerr << " with multiplier " << conv.multiplier.toString() << std::endl;
 		}
 		else {
 			std::cerr << " with function" << std::endl;
@@ -986,7 +983,7 @@ ErrorCode Stack::convert(std::string type, std::string from,  std::string to)
 			result = (this->*(conv.ConvFunc))();
 		}
 		if (result != NoError) {
-			stack = stackCopy;
+			restore(before);
 			return result;
 		}
 	}
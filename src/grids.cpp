@@ -63,6 +63,10 @@ std::string CommandHandler::getBitCountIcon()
 		default:
 		case bc32: return "num_32";
 		case bc64: return "num_64";
+		case bc128: return "num_128";
+		case bc256: return "num_256";
+		case bc512: return "num_512";
+		case bcArbitrary: return "num_any";
 	}
 }
 
@@ -243,7 +247,7 @@ std::map<std::string, Option> CommandHandler::getOptions()
 
 std::string CommandHandler::getStoreHelpText(std::string register_)
 {
-	std::string storeHelpText = "Store/Recall X in the selected register";
+	std::string storeHelpText = "Store/Recall X in the selected register (Ctrl: the whole stack)";
 	if (varStore.contains(register_)) {
 		AF currentValue = varStore[register_];
 		std::string formattedValue = formatDecimal(currentValue, false);
@@ -407,6 +411,16 @@ std::vector< std::vector<BI> > CommandHandler::getGrid(std::string grid)
 			result[5][2] = BI{"sinh", "sinh(x)", "Calculate the hyperbolic sine of X."};
 			result[5][3] = BI{"cosh", "cosh(x)", "Calculate the hyperbolic cosine of X."};
 			result[5][4] = BI{"tanh", "tanh(x)", "Calculate the hyperbolic tangent of X."};
+			result[4][0] = BI{"shiftleft", "y &lt;&lt; x", "Shift the integer part of Y left by X bits."};
+			result[4][1] = BI{"shiftright", "y &gt;&gt; x", "Shift the integer part of Y right by X bits."};
+			result[5][0] = BI{"rotateleft", "ROL", "Rotate the integer part of Y left by X bits (within the bit count)."};
+			result[5][1] = BI{"rotateright", "ROR", "Rotate the integer part of Y right by X bits (within the bit count)."};
+			// The function pad's full, so these take the place of roll up,
+			// roll down and square root (still on the function and number
+			// pads)
+			result[0][0] = BI{"rollDN", "ROLLD n", "Move Y to the level given by X."};
+			result[1][0] = BI{"rollN", "ROLL n", "Move the level given by X to the top of the stack."};
+			result[2][0] = BI{"pickN", "PICK n", "Copy the level given by X to the top of the stack."};
 
 			// TODO: Check operation:
 			result[2][3] = BI{"percentchange", "&Delta;%", "Calculate the percentage change of X vs Y."};
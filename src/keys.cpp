@@ -26,9 +26,9 @@ void CommandHandler::populateKeyMaps()
 	std::initializer_list<std::pair<const std::string, KeyMap> > keyMapInit = {
 		{"Esc", { .plainCmd = "EXT-Quit" }},
 		{"Left", { .plainCmd = "EngL" }},
-		{"Up", { .plainCmd = "rollUp", .shiftCmd = "ceiling" }},
+		{"Up", { .plainCmd = "rollUp", .shiftCmd = "ceiling", .ctrlCmd = "rollDN" }},
 		{"Right", { .plainCmd = "EngR" }},
-		{"Down", { .plainCmd = "rollDown", .shiftCmd = "floor" }},
+		{"Down", { .plainCmd = "rollDown", .shiftCmd = "floor", .ctrlCmd = "rollN" }},
 		{"0", { .plainCmd = "0", .shiftCmd = "tentox", .ctrlCmd = "log10" }},
 		{")", { .plainCmd = "tentox", .shiftCmd = "tentox" }},
 		{"1", { .plainCmd = "1" }},
@@ -51,11 +51,13 @@ void CommandHandler::populateKeyMaps()
 		{"9", { .plainCmd = "9" }},
 		{"\\", { .shiftCmd = "bitwiseor" }},
 		{"|", { .plainCmd = "bitwiseor", .shiftCmd = "bitwiseor" }},
-		{"Backspace", { .plainCmd = "backspace" }},
+		{"<", { .plainCmd = "shiftleft", .shiftCmd = "shiftleft", .ctrlShiftCmd = "rotateleft" }},
+		{">", { .plainCmd = "shiftright", .shiftCmd = "shiftright", .ctrlShiftCmd = "rotateright" }},
+		{"Backspace", { .plainCmd = "backspace", .ctrlCmd = "dropN" }},
 		{".", { .plainCmd = "." }},
 		{"`", { .plainCmd = "clear" }}, // Backtick
-		{"Enter", { .plainCmd = "enter" }},
-		{"Return", { .plainCmd = "enter" }},
+		{"Enter", { .plainCmd = "enter", .ctrlCmd = "dupN" }},
+		{"Return", { .plainCmd = "enter", .ctrlCmd = "dupN" }},
 		{"Tab", { .plainCmd = "EXT-NextTab" }},
 		{"/", { .plainCmd = "divide", .shiftCmd = "integerdivide" }},
 		{"-", { .plainCmd = "minus" }},
@@ -65,7 +67,7 @@ void CommandHandler::populateKeyMaps()
 		{"A", { .plainHandler = [](CommandHandler *c) { c->hex_key("a"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("a"); } }},
 		{"B", { .plainHandler = [](CommandHandler *c) { c->hex_key("b"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("b"); }, .ctrlCmd = "base" }},
 		{"C", { .plainHandler = [](CommandHandler *c) { c->hex_key("c"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("c"); }, .ctrlCmd = "EXT-CopyToClipboard", .altCmd = "cos", .altShiftCmd = "inversecos"  }},
-		{"D", { .plainHandler = [](CommandHandler *c) { c->hex_key("d"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("d"); } }},
+		{"D", { .plainHandler = [](CommandHandler *c) { c->hex_key("d"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("d"); }, .ctrlCmd = "depth" }},
 		{"E", { .plainHandler = [](CommandHandler *c) { c->hex_key("e"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("e"); } }},
 		{"F", { .plainHandler = [](CommandHandler *c) { c->hex_key("f"); }, .shiftHandler = [](CommandHandler *c) { c->shift_hex_key("f"); } }},
 		{"H", { .ctrlShiftCmd = "debugHistory" }},
@@ -74,16 +76,21 @@ void CommandHandler::populateKeyMaps()
 		{"L", { .shiftCmd = "loge" }},
 		{"M", { .plainCmd = "Convert_Distance_Inches_Millimetres", .shiftCmd = "Convert_Distance_Millimetres_Inches", .ctrlCmd = "EXT-MoreConversions" }},
 		{"N", { .plainCmd = "invert" }},
-		{"P", { .plainCmd = "pi" }},
+		{"P", { .plainCmd = "pi", .ctrlCmd = "pickN" }},
 		{"Q", { .plainCmd = "sqrt", .shiftCmd = "square" }},
 		{"R", { .plainCmd = "EXT-Recall", .shiftCmd = "random", .ctrlCmd = "round" }},
 		{"S", { .plainCmd = "EXT-Store", .shiftCmd = "EXT-SI", .ctrlCmd = "ShowAll", .altCmd = "sin", .altShiftCmd = "inversesin" }},
 		{"T", { .shiftCmd = "EXT-NextTab", .altCmd = "tan", .altShiftCmd = "inversetan" }},
 		{"U", { .plainCmd = "undo" }},
 		{"V", { .ctrlCmd = "EXT-PasteFromClipboard" }},
-		{"W", { .plainCmd = "swap" }},
+		{"W", { .plainCmd = "swap", .ctrlCmd = "reverseN" }},
 		{"X", { .plainCmd = "xrooty" }},
-		{"Y", { .plainCmd = "power" }}
+		{"Y", { .plainCmd = "power" }},
+		// Ctrl starts or stops recording a macro on the key
+		{"F1", { .plainCmd = "PlayMacro-1", .ctrlCmd = "RecordMacro-1" }},
+		{"F2", { .plainCmd = "PlayMacro-2", .ctrlCmd = "RecordMacro-2" }},
+		{"F3", { .plainCmd = "PlayMacro-3", .ctrlCmd = "RecordMacro-3" }},
+		{"F4", { .plainCmd = "PlayMacro-4", .ctrlCmd = "RecordMacro-4" }}
 	};
 	keyMap = keyMapInit;
 
@@ -117,10 +124,12 @@ keyHandlerResult CommandHandler::handleKey(std::string key, std::string modifier
 				|| ((key == "T") && (modifiers == "shift"))) {
 			return Key_NextTab;
 		}
-		else if (modifiers != "plain") {
+		else if ((modifiers != "plain") && (modifiers != "ctrl")) {
 			return Key_NotHandled;
 		}
 		else {
+			// Ctrl stores or recalls the whole stack instead of X
+			bool wholeStack = (modifiers == "ctrl");
 			std::string prefix = "StoreRomanUpper";
 			bool is_greek = false;
 			if (startsWith(tab, "greek")) {
@@ -137,7 +146,13 @@ keyHandlerResult CommandHandler::handleKey(std::string key, std::string modifier
 					command = roman_to_greek.at(command);
 				}
 
-				if (last_store_mode) {
+				if (wholeStack && last_store_mode) {
+					storeStack(prefix + command);
+				}
+				else if (wholeStack) {
+					recallStack(prefix + command);
+				}
+				else if (last_store_mode) {
 					store(prefix + command);
 				}
 				else {
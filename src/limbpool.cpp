@@ -0,0 +1,167 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <gmp.h>
+
+#include "limbpool.h"
+
+/* Size classes are exact multiples of the limb size: GMP tells us the
+ * size of a block when it is freed, so a block can only be reused for a
+ * request of exactly the same size.  That also means that blocks that
+ * were malloc'd before the pool was installed can safely join it.
+ */
+static const size_t LIMB_BYTES = sizeof(mp_limb_t);
+static const size_t MAX_CLASS_LIMBS = 128;
+static const uint32_t MAX_BLOCKS_PER_CLASS = 256;
+
+typedef struct _FreeBlock {
+	struct _FreeBlock *next;
+} FreeBlock;
+
+typedef struct _SizeClass {
+	FreeBlock *head;
+	uint32_t count;
+} SizeClass;
+
+/* These are all trivially destructible so that they remain usable for
+ * the whole life of the thread.  The closer below empties the pool at
+ * thread exit and from then on frees go straight to free().
+ */
+static thread_local SizeClass sizeClasses[MAX_CLASS_LIMBS + 1];
+static thread_local LimbPoolStats stats;
+static thread_local bool poolClosed = false;
+
+class PoolCloser
+{
+	public:
+		~PoolCloser()
+		{
+			limbPoolTrim(0);
+			poolClosed = true;
+		}
+};
+static thread_local PoolCloser poolCloser;
+
+static int sizeClassFor(size_t size)
+{
+	if ((size == 0) || ((size % LIMB_BYTES) != 0)) {
+		return -1;
+	}
+	size_t limbs = size / LIMB_BYTES;
+	if (limbs > MAX_CLASS_LIMBS) {
+		return -1;
+	}
+	return (int) limbs;
+}
+
+static void *poolAllocate(size_t size)
+{
+	// Touch the closer so that it is constructed (and hence destroyed) on
+	// every thread that uses the pool.
+	(void) &poolCloser;
+
+	stats.allocations++;
+	int sc = sizeClassFor(size);
+	if ((sc >= 0) && ( ! poolClosed) && (sizeClasses[sc].head != NULL)) {
+		FreeBlock *block = sizeClasses[sc].head;
+		sizeClasses[sc].head = block->next;
+		sizeClasses[sc].count--;
+		stats.poolHits++;
+		stats.cachedBlocks--;
+		stats.cachedBytes -= size;
+		return block;
+	}
+
+	stats.poolMisses++;
+	void *result = std::malloc(size);
+	if (result == NULL) {
+		// Same behaviour as GMP's default allocator
+		std::abort();
+	}
+	return result;
+}
+
+static void poolFree(void *ptr, size_t size)
+{
+	if (ptr == NULL) {
+		return;
+	}
+	stats.frees++;
+	int sc = sizeClassFor(size);
+	if ((sc >= 0) && ( ! poolClosed) && (sizeClasses[sc].count < MAX_BLOCKS_PER_CLASS)) {
+		FreeBlock *block = (FreeBlock *) ptr;
+		block->next = sizeClasses[sc].head;
+		sizeClasses[sc].head = block;
+		sizeClasses[sc].count++;
+		stats.cachedBlocks++;
+		stats.cachedBytes += size;
+		return;
+	}
+
+	stats.released++;
+	std::free(ptr);
+}
+
+static void *poolReallocate(void *ptr, size_t oldSize, size_t newSize)
+{
+	if ((sizeClassFor(oldSize) < 0) && (sizeClassFor(newSize) < 0)) {
+		void *result = std::realloc(ptr, newSize);
+		if (result == NULL) {
+			std::abort();
+		}
+		return result;
+	}
+
+	void *result = poolAllocate(newSize);
+	if (ptr != NULL) {
+		std::memcpy(result, ptr, (oldSize < newSize) ? oldSize : newSize);
+		poolFree(ptr, oldSize);
+	}
+	return result;
+}
+
+void limbPoolInstall()
+{
+	static std::once_flag installed;
+	std::call_once(installed, []() {
+		mp_set_memory_functions(poolAllocate, poolReallocate, poolFree);
+	});
+}
+
+void limbPoolTrim(size_t keepBytes)
+{
+	for (size_t sc = MAX_CLASS_LIMBS; sc > 0; sc--) {
+		size_t blockBytes = sc * LIMB_BYTES;
+		while ((sizeClasses[sc].head != NULL) && (stats.cachedBytes > keepBytes)) {
+			FreeBlock *block = sizeClasses[sc].head;
+			sizeClasses[sc].head = block->next;
+			sizeClasses[sc].count--;
+			stats.cachedBlocks--;
+			stats.cachedBytes -= blockBytes;
+			stats.released++;
+			std::free(block);
+		}
+	}
+}
+
+LimbPoolStats limbPoolGetStats()
+{
+	return stats;
+}
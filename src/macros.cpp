@@ -0,0 +1,528 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "commands.h"
+#include "strutils.h"
+
+// How many entries an operation takes if it depends on nothing else
+// (so can be worked out while compiling), or 0 if it can't be
+static size_t foldableOperands(OpCode op)
+{
+	switch (op) {
+		case opAbsolute: case opCeiling: case opCos: case opCosh:
+		case opCube: case opCubeRoot: case opDrop: case opEToX:
+		case opFloatingPart: case opFloor: case opIntegerPart:
+		case opInverseCos: case opInverseSin: case opInverseTan:
+		case opInverseCosh: case opInverseSinh: case opInverseTanh:
+		case opLog10: case opLog2: case opLogE: case opReciprocal:
+		case opRound: case opSin: case opSinh: case opSquare:
+		case opSquareRoot: case opTan: case opTanh: case opTenToX:
+		case opTwoToX:
+			return 1;
+		case opDivide: case opIntegerDivide: case opInverseTan2:
+		case opInverseTanh2: case opMinus: case opPlus: case opPower:
+		case opRemainder: case opSwap: case opTimes: case opXRootY:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+/* Follows the entry state through a macro's keys (as the CommandHandler
+ * functions of the same names would change it) and adds what they do
+ * to the stack to the plan.  Values that are known while compiling are
+ * held back until something needs them on the stack, so that anything
+ * done to them alone can be done here instead.
+ */
+class MacroCompiler
+{
+	public:
+		MacroCompiler(Program & plan, DisplayState & d, Stack & scratch, bool binaryPrefixes)
+			: plan(plan), d(d), scratch(scratch), binaryPrefixes(binaryPrefixes) {}
+
+		// False if the key can't be compiled
+		bool key(const MacroKey & k, const OpEntry & e, size_t position);
+		void finish();
+
+	private:
+		bool startEntering();
+		void completeEntering(bool needValue);
+		void updateValueFromText();
+		bool numInput(char digit);
+		bool dotInput();
+		bool exponent();
+		bool backspace();
+		bool clearButton();
+		void plusMinus();
+		void enter();
+
+		void push(const AF & v);
+		bool pop();
+		void duplicate();
+		void stackOp(StackOp op, size_t operands);
+		void flush();
+
+		Program & plan;
+		DisplayState & d;
+		Stack & scratch;
+		bool binaryPrefixes;
+		size_t position = 0;
+
+		// Known values above everything else on the stack, in order
+		std::vector<AF> known;
+		// X (which isn't known) is to be duplicated
+		bool pendingDuplicate = false;
+};
+
+bool MacroCompiler::key(const MacroKey & k, const OpEntry & e, size_t position)
+{
+	this->position = position;
+	if (k.op == opNone) {
+		if (startsWith(k.key, "Const-")) {
+			completeEntering(false);
+			flush();
+			plan.constant(k.key.substr(6), position);
+			return true;
+		}
+		std::vector<std::string> parts = split(k.key, '_');
+		if (startsWith(k.key, "Convert_") && (parts.size() == 4)) {
+			completeEntering(true);
+			flush();
+			plan.convert(parts[1], parts[2], parts[3], position);
+			return true;
+		}
+		return false;
+	}
+
+	switch (k.op) {
+		case opDigit0: case opDigit1: case opDigit2: case opDigit3: case opDigit4:
+		case opDigit5: case opDigit6: case opDigit7: case opDigit8: case opDigit9:
+			return numInput('0' + (k.op - opDigit0));
+		case opHexA: case opHexB: case opHexC: case opHexD: case opHexF:
+			// Ignored in decimal
+			return true;
+		case opHexE:
+		case opExponent:
+			return exponent();
+		case opDot:
+			return dotInput();
+		case opBackspace:
+			return backspace();
+		case opPlusMinus:
+			plusMinus();
+			return true;
+		case opClear:
+			return clearButton();
+		case opEnter:
+			enter();
+			return true;
+		case opPi:
+			completeEntering(false);
+			flush();
+			plan.constant("Pi", position);
+			return true;
+		case opMinus:
+			if (d.entering && endsWith(d.enteredText, "e0")) {
+				plusMinus();
+				return true;
+			}
+			break;
+		default:
+			if (e.handler != NULL) {
+				return false;
+			}
+			break;
+	}
+	completeEntering(e.takesValue);
+	stackOp(e.stackOp, foldableOperands(k.op));
+	return true;
+}
+
+void MacroCompiler::finish()
+{
+	flush();
+}
+
+bool MacroCompiler::startEntering()
+{
+	if (d.justPressedEnter) {
+		if ( ! d.entering) {
+			if ( ! pop()) {
+				return false;
+			}
+		}
+		d.justPressedEnter = false;
+		d.entering = false;
+	}
+	if (d.entering) {
+		if (d.enteredText.length() > 0) {
+			return true;
+		}
+	}
+	d.enteredText = "";
+	d.entering = true;
+	return true;
+}
+
+void MacroCompiler::completeEntering(bool needValue)
+{
+	d.justPressedEnter = false;
+	if ( ! d.entering) {
+		return;
+	}
+	if (needValue || (d.enteredText.length() > 0)) {
+		push(d.enteredValue);
+	}
+	d.entering = false;
+	d.enteredText = "";
+}
+
+void MacroCompiler::updateValueFromText()
+{
+	if (d.enteredText.length() == 0) {
+		d.enteredValue = AF("0.0");
+	}
+	else if (binaryPrefixes && (contains(d.enteredText, "e"))) {
+		std::vector<std::string> parts = split(d.enteredText, 'e');
+		d.enteredValue = AF(parts[0]) * (AF("2.0").pow(AF(parts[1])));
+	}
+	else {
+		d.enteredValue = AF(d.enteredText);
+	}
+}
+
+bool MacroCompiler::numInput(char digit)
+{
+	if ( ! startEntering()) {
+		return false;
+	}
+	if (endsWith(d.enteredText, "e0")) {
+		d.enteredText.pop_back();
+	}
+	if ((d.enteredText != "") || (digit != '0')) {
+		d.enteredText += digit;
+	}
+	updateValueFromText();
+	return true;
+}
+
+bool MacroCompiler::dotInput()
+{
+	if (contains(d.enteredText, "e") || contains(d.enteredText, ".")) {
+		return true;
+	}
+	if ( ! startEntering()) {
+		return false;
+	}
+	if (d.enteredText.length() == 0) {
+		d.enteredText = "0";
+	}
+	d.enteredText += ".";
+	updateValueFromText();
+	return true;
+}
+
+bool MacroCompiler::exponent()
+{
+	if (contains(d.enteredText, "e")) {
+		return true;
+	}
+	if ( ! startEntering()) {
+		return false;
+	}
+	if (d.enteredText.length() == 0) {
+		d.enteredText = "1";
+	}
+	d.enteredText += "e0";
+	updateValueFromText();
+	return true;
+}
+
+bool MacroCompiler::backspace()
+{
+	if ( ! (d.entering && ( ! d.justPressedEnter))) {
+		return clearButton();
+	}
+	int l = d.enteredText.length();
+	if (l <= 1) {
+		return clearButton();
+	}
+	if (d.enteredText[l-2] == 'e') {
+		d.enteredText.resize(l - 2);
+	}
+	else if ((l > 2) && (d.enteredText[l-3] == 'e') && (d.enteredText[l-2] == '-')) {
+		d.enteredText.resize(l - 3);
+	}
+	else {
+		d.enteredText.pop_back();
+	}
+	updateValueFromText();
+	return true;
+}
+
+bool MacroCompiler::clearButton()
+{
+	if (d.justPressedEnter) {
+		d.enteredText = "";
+		d.enteredValue = AF("0.0");
+		d.justPressedEnter = false;
+	}
+	else if ( ! d.entering) {
+		// Drops or clears, depending on X
+		return false;
+	}
+	else if ((d.enteredText.length() == 0) || (d.enteredValue.isZero())) {
+		return false;
+	}
+	d.entering = true;
+	d.enteredText = "";
+	updateValueFromText();
+	return true;
+}
+
+void MacroCompiler::plusMinus()
+{
+	if ( ! (d.entering && ( ! d.justPressedEnter))) {
+		completeEntering(true);
+		stackOp(&Stack::invert, 1);
+		return;
+	}
+	if (d.enteredText.length() == 0) {
+		return;
+	}
+	if (contains(d.enteredText, "e")) {
+		std::vector<std::string> parts = split(d.enteredText, 'e');
+		if (startsWith(parts[1], "-")) {
+			d.enteredText = parts[0] + "e" + parts[1].substr(1);
+		}
+		else {
+			d.enteredText = parts[0] + "e-" + parts[1];
+		}
+	}
+	else if (startsWith(d.enteredText, "-")) {
+		d.enteredText = d.enteredText.substr(1);
+	}
+	else {
+		d.enteredText = "-" + d.enteredText;
+	}
+	updateValueFromText();
+}
+
+void MacroCompiler::enter()
+{
+	if (d.entering) {
+		push(d.enteredValue);
+		d.enteredText = "";
+	}
+	else {
+		duplicate();
+	}
+	d.justPressedEnter = true;
+}
+
+void MacroCompiler::push(const AF & v)
+{
+	if (pendingDuplicate) {
+		plan.duplicate(position);
+		pendingDuplicate = false;
+	}
+	known.push_back(v);
+}
+
+bool MacroCompiler::pop()
+{
+	// Only ever undoes the duplicate from pressing enter
+	if (pendingDuplicate) {
+		pendingDuplicate = false;
+		return true;
+	}
+	if (known.empty()) {
+		return false;
+	}
+	known.pop_back();
+	return true;
+}
+
+void MacroCompiler::duplicate()
+{
+	if ( ! known.empty()) {
+		known.push_back(known.back());
+		return;
+	}
+	if (pendingDuplicate) {
+		plan.duplicate(position);
+	}
+	pendingDuplicate = true;
+}
+
+void MacroCompiler::stackOp(StackOp op, size_t operands)
+{
+	if ((operands > 0) && (known.size() >= operands)) {
+		scratch.clear();
+		for (size_t i = known.size() - operands; i < known.size(); i++) {
+			scratch.push(known[i]);
+		}
+		if ((scratch.*op)() == NoError) {
+			known.resize(known.size() - operands);
+			known.insert(known.end(), scratch.stack.begin(), scratch.stack.end());
+			return;
+		}
+		// Left for the error to happen when it's played
+	}
+	flush();
+	plan.stackOp(op, position);
+}
+
+void MacroCompiler::flush()
+{
+	if (pendingDuplicate) {
+		plan.duplicate(position);
+		pendingDuplicate = false;
+	}
+	for (const AF & v : known) {
+		plan.push(v, position);
+	}
+	known.clear();
+}
+
+void CommandHandler::startRecording(std::string name)
+{
+	recording = true;
+	recordingName = name;
+	recordedKeys.clear();
+}
+
+void CommandHandler::stopRecording()
+{
+	if ( ! recording) {
+		return;
+	}
+	recording = false;
+	Macro & m = macros[recordingName];
+	m = Macro();
+	m.keys = std::move(recordedKeys);
+	recordedKeys.clear();
+}
+
+bool CommandHandler::isRecording()
+{
+	return recording;
+}
+
+bool CommandHandler::macroPlanIsCurrent(const Macro & m)
+{
+	if (( ! m.compiled)
+			|| (m.digits != st.getPrecision())
+			|| (m.radians != st.getOption(Radians))
+			|| (m.binaryPrefixes != getOption(BinaryPrefixes))
+			|| (m.base != dspBase)
+			|| (m.replicate != st.getOption(ReplicateStack))
+			|| (m.start.entering != dspState.entering)
+			|| (m.start.justPressedEnter != dspState.justPressedEnter)) {
+		return false;
+	}
+	// The value only matters while entering
+	return ( ! dspState.entering)
+		|| ((m.start.enteredText == dspState.enteredText)
+				&& (m.start.enteredValue == dspState.enteredValue));
+}
+
+bool CommandHandler::compileMacro(Macro & m)
+{
+	m.compiled = true;
+	m.digits = st.getPrecision();
+	m.radians = st.getOption(Radians);
+	m.binaryPrefixes = getOption(BinaryPrefixes);
+	m.base = dspBase;
+	m.replicate = st.getOption(ReplicateStack);
+	m.start = dspState;
+	m.end = dspState;
+	m.plan.clear();
+
+	// A replicating stack loses entries as values are pushed, so the
+	// values can't be held back
+	m.playKeys = (m.base != baseDecimal) || m.replicate;
+	if (m.playKeys) {
+		return false;
+	}
+
+	Stack scratch;
+	scratch.setOption(SaveHistory, false);
+	scratch.setOption(Radians, m.radians);
+	scratch.setPrecision(m.digits);
+
+	MacroCompiler compiler(m.plan, m.end, scratch, m.binaryPrefixes);
+	for (size_t i = 0; i < m.keys.size(); i++) {
+		const MacroKey & k = m.keys[i];
+		OpCode op = ((k.op > opNone) && (k.op < opCount)) ? k.op : opNone;
+		if ( ! compiler.key(k, opTable[op], i)) {
+			m.playKeys = true;
+			m.plan.clear();
+			return false;
+		}
+	}
+	compiler.finish();
+	return true;
+}
+
+ErrorCode CommandHandler::playMacro(std::string name)
+{
+	auto it = macros.find(name);
+	if (it == macros.end()) {
+		return UnknownMacro;
+	}
+	Macro & m = it->second;
+	if (recording && ( ! playingMacro)) {
+		// Record what it does rather than the macro itself, so that
+		// it doesn't matter if it's recorded again
+		recordedKeys.insert(recordedKeys.end(), m.keys.begin(), m.keys.end());
+	}
+
+	AFWorkingDigits wd(st.getPrecision());
+	if ( ! macroPlanIsCurrent(m)) {
+		compileMacro(m);
+	}
+
+	ErrorCode ec = NoError;
+	playingMacro = true;
+	if (m.playKeys) {
+		for (const MacroKey & k : m.keys) {
+			ec = (k.op != opNone) ? keypress(k.op) : keypress(k.key);
+			if (ec != NoError) {
+				break;
+			}
+		}
+	}
+	else {
+		size_t position;
+		ec = m.plan.run(st, position, true);
+		if (ec == NoError) {
+			dspState.enteredText = m.end.enteredText;
+			dspState.enteredValue = m.end.enteredValue;
+			dspState.entering = m.end.entering;
+			dspState.justPressedEnter = m.end.justPressedEnter;
+		}
+		else {
+			// Stopped at an operation, which finished the entry
+			dspState.enteredText = "";
+			dspState.entering = false;
+			dspState.justPressedEnter = false;
+		}
+	}
+	playingMacro = false;
+	return ec;
+}
@@ -19,8 +19,11 @@
 #include <iostream>
 #include <random>
 #include <chrono>
+#include <utility>
 
 #include "stack.h"
+#include "afexpr.h"
+#include "arpint.h"
 
 ErrorCode Stack::random()
 {
@@ -31,77 +34,63 @@ ErrorCode Stack::random()
 
 ErrorCode Stack::plus()
 {
-	push(pop() + pop());
+	setXY(takeY() + peek());
 	return NoError;
 }
 
 ErrorCode Stack::minus()
 {
-	AF x = pop();
-	AF y = pop();
-	push(y - x);
+	setXY(takeY() - peek());
 	return NoError;
 }
 
 ErrorCode Stack::times()
 {
-	push(pop()*pop());
+	setXY(takeY() * peek());
 	return NoError;
 }
 
 ErrorCode Stack::divide()
 {
-	AF x = pop();
-	if (x == AF(0.0)) {
-		push(x);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
-	else {
-		AF y = pop();
-		push(y/x);
-	}
+	setXY(takeY() / peek());
 	return NoError;
 }
 
 ErrorCode Stack::xrooty()
 {
-	AF x = pop();
-	AF y = pop();
-	if ((x == AF(0.0)) || (y < 0.0)) {
-		push(y);
-		push(x);
+	if ((peek().isZero()) || (peekAt(1) < 0.0)) {
 		return InvalidRoot;
 	}
-	else {
-		push(y.root(x));
-	}
+	setXY(takeY().root(peek()));
 	return NoError;
 }
 
 ErrorCode Stack::invert()
 {
-	push(AF(0.0) - pop());
+	setX(AF(0.0) - takeX());
 	return NoError;
 }
 
 ErrorCode Stack::etox()
 {
-	AF e = AF::e();
-	push(e.pow(pop()));
+	setX(AF::e().pow(takeX()));
 	return NoError;
 }
 
 ErrorCode Stack::tentox()
 {
 	AF ten = AF(10.0);
-	push(ten.pow(pop()));
+	setX(ten.pow(takeX()));
 	return NoError;
 }
 
 ErrorCode Stack::twotox()
 {
 	AF two = AF(2.0);
-	push(two.pow(pop()));
+	setX(two.pow(takeX()));
 	return NoError;
 }
 
@@ -112,12 +101,13 @@ ErrorCode Stack::percent()
 	 * is (35/100)*70.  By default PercentLeavesY is set and
 	 * hence y stays as 70 and x becomes 24.5.
 	 */
-	AF x = pop();
-	AF y = pop();
-	if (options.contains(PercentLeavesY)) {
-		push(y);
+	AF result = afx(peek()) / 100 * peekAt(1);
+	if (options.test(PercentLeavesY)) {
+		setX(std::move(result));
+	}
+	else {
+		setXY(std::move(result));
 	}
-	push((x/100.0)*y);
 	return NoError;
 }
 
@@ -128,297 +118,285 @@ ErrorCode Stack::percentchange()
 	 * This is calculated as ((x-y)/y)*100
 	 * By default PercentLeavesY is set.
 	 */
-	AF x = pop();
-	AF y = pop();
-	if (options.contains(PercentLeavesY)) {
-		push(y);
+	AF result = (afx(peek()) - peekAt(1)) / peekAt(1) * 100;
+	if (options.test(PercentLeavesY)) {
+		setX(std::move(result));
+	}
+	else {
+		setXY(std::move(result));
 	}
-	push(((x-y)/y)*100.0);
 	return NoError;
 }
 
 ErrorCode Stack::square()
 {
-	AF x = pop();
-	push(x*x);
+	const AF & x = peek();
+	setX(x*x);
 	return NoError;
 }
 
 ErrorCode Stack::cube()
 {
-	AF x = pop();
-	push(x*x*x);
+	const AF & x = peek();
+	setX(x*x*x);
 	return NoError;
 }
 
 ErrorCode Stack::reciprocal()
 {
-	AF x = pop();
-	if (x == AF(0.0)) {
-		push(x);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
-	else {
-		AF one(1.0);
-		push(one/x);
-	}
+	setX(AF(1.0)/takeX());
 	return NoError;
 }
 
 ErrorCode Stack::integerpart()
 {
-	AF x = pop();
+	AF x = takeX();
 	if (x > 0.0) {
-		push(x.floor());
+		setX(std::move(x).floor());
 	}
 	else {
-		push(x.ceil());
+		setX(std::move(x).ceil());
 	}
 	return NoError;
 }
 
 ErrorCode Stack::floatingpart()
 {
-	AF x = pop();
+	const AF & x = peek();
 	if (x > 0.0) {
-		push(x - x.floor());
+		setX(x - x.floor());
 	}
 	else {
-		push(x - x.ceil());
+		setX(x - x.ceil());
 	}
 	return NoError;
 }
 
 ErrorCode Stack::integerdivide()
 {
-	AF x = pop();
-	if (x == AF(0.0)) {
-		push(x);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
+	AF v = takeY() / peek();
+	if (v >= 0.0) {
+		setXY(std::move(v).floor());
+	}
 	else {
-		AF y = pop();
-		AF v = y / x;
-		if (v >= 0.0) {
-			push(v.floor());
-		}
-		else {
-			push(v.ceil());
-		}
+		setXY(std::move(v).ceil());
 	}
 	return NoError;
 }
 
 ErrorCode Stack::bitwiseand()
 {
-	intmax_t xl = pop().round().toLong();
-	intmax_t yl = pop().round().toLong();
-	intmax_t mask = getBitMask();
-	xl &= mask;
-	yl &= mask;
-	intmax_t v = xl & yl;
-	v &= mask;
-	push(AF(v));
+	int width = getBitWidth();
+	AI x = AI(peek().round()).wrapped(width);
+	AI y = AI(peekAt(1).round()).wrapped(width);
+	setXY((x & y).toAF());
 	return NoError;
 }
 
 ErrorCode Stack::bitwiseor()
 {
-	intmax_t xl = pop().round().toLong();
-	intmax_t yl = pop().round().toLong();
-	intmax_t mask = getBitMask();
-	xl &= mask;
-	yl &= mask;
-	intmax_t v = xl | yl;
-	v &= mask;
-	push(AF(v));
+	int width = getBitWidth();
+	AI x = AI(peek().round()).wrapped(width);
+	AI y = AI(peekAt(1).round()).wrapped(width);
+	setXY((x | y).toAF());
 	return NoError;
 }
 
 ErrorCode Stack::bitwisexor()
 {
-	intmax_t xl = pop().round().toLong();
-	intmax_t yl = pop().round().toLong();
-	intmax_t mask = getBitMask();
-	xl &= mask;
-	yl &= mask;
-	intmax_t v = xl ^ yl;
-	v &= mask;
-	push(AF(v));
+	int width = getBitWidth();
+	AI x = AI(peek().round()).wrapped(width);
+	AI y = AI(peekAt(1).round()).wrapped(width);
+	setXY((x ^ y).toAF());
 	return NoError;
 }
 
 ErrorCode Stack::bitwisenot()
 {
-	intmax_t xl = pop().round().toLong();
-	intmax_t mask = getBitMask();
-	xl &= mask;
-	xl = ~xl;
-	xl &= mask;
-	push(AF(xl));
+	setX(AI(peek().round()).complement(getBitWidth()).toAF());
 	return NoError;
 }
 
 ErrorCode Stack::twoscomplement()
 {
-	intmax_t xl = pop().round().toLong();
-	intmax_t mask = getBitMask();
-	xl &= mask;
-	xl = ~xl;
-	xl += 1;
-	xl &= mask;
-	push(AF(xl));
+	setX(AI(peek().round()).twosComplement(getBitWidth()).toAF());
+	return NoError;
+}
+
+// Shift and rotate Y by X bits
+static const int MAX_SHIFT = 65536;
+
+static bool validShift(const AF & x)
+{
+	return (x >= 0) && (x <= MAX_SHIFT) && (x == x.round());
+}
+
+ErrorCode Stack::shiftleft()
+{
+	const AF & x = peek();
+	if ( ! validShift(x)) {
+		return InvalidShift;
+	}
+	setXY(AI(peekAt(1).round()).shiftLeft(x.toLong(), getBitWidth()).toAF());
+	return NoError;
+}
+
+ErrorCode Stack::shiftright()
+{
+	const AF & x = peek();
+	if ( ! validShift(x)) {
+		return InvalidShift;
+	}
+	setXY(AI(peekAt(1).round()).shiftRight(x.toLong(), getBitWidth()).toAF());
+	return NoError;
+}
+
+ErrorCode Stack::rotateleft()
+{
+	const AF & x = peek();
+	if (( ! validShift(x)) || (getBitWidth() == 0)) {
+		return InvalidShift;
+	}
+	setXY(AI(peekAt(1).round()).rotateLeft(x.toLong(), getBitWidth()).toAF());
+	return NoError;
+}
+
+ErrorCode Stack::rotateright()
+{
+	const AF & x = peek();
+	if (( ! validShift(x)) || (getBitWidth() == 0)) {
+		return InvalidShift;
+	}
+	setXY(AI(peekAt(1).round()).rotateRight(x.toLong(), getBitWidth()).toAF());
 	return NoError;
 }
 
 ErrorCode Stack::absolute()
 {
-	push(pop().abs());
+	setX(takeX().abs());
 	return NoError;
 }
 
 ErrorCode Stack::log10()
 {
-	AF x = pop();
-	if (x <= 0.0) {
-		push(x);
+	if (peek() <= 0.0) {
 		return InvalidLog;
 	}
-	else {
-		push(x.log10());
-	}
+	setX(takeX().log10());
 	return NoError;
 }
 
 ErrorCode Stack::loge()
 {
-	AF x = pop();
-	if (x <= 0.0) {
-		push(x);
+	if (peek() <= 0.0) {
 		return InvalidLog;
 	}
-	else {
-		push(x.log());
-	}
+	setX(takeX().log());
 	return NoError;
 }
 
 ErrorCode Stack::log2()
 {
-	AF x = pop();
-	if (x <= 0.0) {
-		push(x);
+	if (peek() <= 0.0) {
 		return InvalidLog;
 	}
-	else {
-		AF two = AF(2.0);
-		push(x.log() / two.log());
-	}
+	setX(takeX().log() / AF::ln2());
 	return NoError;
 }
 
 ErrorCode Stack::ceiling()
 {
-	push(pop().ceil());
+	setX(takeX().ceil());
 	return NoError;
 }
 
 ErrorCode Stack::floor()
 {
-	push(pop().floor());
+	setX(takeX().floor());
 	return NoError;
 }
 
 ErrorCode Stack::cos()
 {
-	AF x = pop();
-	if ( ! options.contains(Radians)) {
-		x = x * AF::pi() / AF(180);
+	AF x = takeX();
+	if ( ! options.test(Radians)) {
+		x = std::move(x) * AF::pi() / 180;
 	}
-	push(x.cos());
+	setX(std::move(x).cos());
 	return NoError;
 }
 
 ErrorCode Stack::sin()
 {
-	AF x = pop();
-	if ( ! options.contains(Radians)) {
-		x = x * AF::pi() / AF(180);
+	AF x = takeX();
+	if ( ! options.test(Radians)) {
+		x = std::move(x) * AF::pi() / 180;
 	}
-	push(x.sin());
+	setX(std::move(x).sin());
 	return NoError;
 }
 
 ErrorCode Stack::tan()
 {
-	AF x = pop();
-	AF xr = x;
-	if ( ! options.contains(Radians)) {
-		xr = xr * AF::pi() / AF(180);
-	}
-	if ((xr.remainder(AF::pi()/2.0) == AF(0.0)) && ((xr/(AF::pi()/2.0)).remainder(2.0) == AF(1.0))) {
-		push(x);
+	AF xr = options.test(Radians) ? peek() : peek() * AF::pi() / 180;
+	const AF halfPi = AF::pi()/2.0;
+	if ((xr.remainder(halfPi).isZero()) && ((xr/halfPi).remainder(2.0) == 1)) {
 		return InvalidTan;
 	}
-	else {
-		push(xr.tan());
-	}
+	setX(std::move(xr).tan());
 	return NoError;
 }
 
 ErrorCode Stack::inversecos()
 {
-	AF x = pop();
+	const AF & x = peek();
 	if ((x < -1.0) || (x > 1.0)) {
-		push(x);
 		return InvalidInverseTrig;
 	}
-	else {
-		AF v = x.acos();
-		if ( ! options.contains(Radians)) {
-			v = v * AF(180)/AF::pi();
-		}
-		push(v);
+	AF v = x.acos();
+	if ( ! options.test(Radians)) {
+		v = std::move(v) * 180 / AF::pi();
 	}
+	setX(std::move(v));
 	return NoError;
 }
 
 ErrorCode Stack::inversesin()
 {
-	AF x = pop();
+	const AF & x = peek();
 	if ((x < -1.0) || (x > 1.0)) {
-		push(x);
 		return InvalidInverseTrig;
 	}
-	else {
-		AF v = x.asin();
-		if ( ! options.contains(Radians)) {
-			v = v * AF(180)/AF::pi();
-		}
-		push(v);
+	AF v = x.asin();
+	if ( ! options.test(Radians)) {
+		v = std::move(v) * 180 / AF::pi();
 	}
+	setX(std::move(v));
 	return NoError;
 }
 
 ErrorCode Stack::inversetan()
 {
-	AF x = pop();
-	AF v = x.atan();
-	if ( ! options.contains(Radians)) {
-		v = v * AF(180)/AF::pi();
+	AF v = takeX().atan();
+	if ( ! options.test(Radians)) {
+		v = std::move(v) * 180 / AF::pi();
 	}
-	push(v);
+	setX(std::move(v));
 	return NoError;
 }
 
 ErrorCode Stack::inversetan2()
 {
-	AF x = pop();
-	AF y = pop();
+	const AF & x = peek();
+	const AF & y = peekAt(1);
 
-	if ((x == AF(0)) && (y == AF(0))) {
-		push(y);
-		push(x);
+	if ((x.isZero()) && (y.isZero())) {
 		return DivideByZero;
 	}
 	else {
@@ -435,45 +413,40 @@ ErrorCode Stack::inversetan2()
 			v = y / x;
 			v = v.atan() - AF::pi();
 		}
-		else if ((x == AF(0)) && (y > 0.0)) {
+		else if ((x.isZero()) && (y > 0.0)) {
 			v = AF::pi()/2.0;
 		}
-		else if ((x == AF(0)) && (y < 0.0)) {
+		else if ((x.isZero()) && (y < 0.0)) {
 			v = AF(0.0)-AF::pi()/2.0;
 		}
 		else {
 			// Shouldn't get here, but just in case:
-			push(y);
-			push(x);
 			return DivideByZero;
 		}
 
-		if ( ! options.contains(Radians)) {
-			v = v * AF(180)/AF::pi();
+		if ( ! options.test(Radians)) {
+			v = v * 180 / AF::pi();
 		}
-		push(v);
+		setXY(std::move(v));
 	}
 	return NoError;
 }
 
 ErrorCode Stack::cosh()
 {
-	AF x = pop();
-	push(x.cosh());
+	setX(takeX().cosh());
 	return NoError;
 }
 
 ErrorCode Stack::sinh()
 {
-	AF x = pop();
-	push(x.sinh());
+	setX(takeX().sinh());
 	return NoError;
 }
 
 ErrorCode Stack::tanh()
 {
-	AF x = pop();
-	push(x.tanh());
+	setX(takeX().tanh());
 	return NoError;
 }
 
@@ -493,8 +466,7 @@ ErrorCode Stack::inversecosh()
 	}
 	push(v1.log());
 	*/
-	AF x = pop();
-	push(x.acosh());
+	setX(takeX().acosh());
 	return NoError;
 }
 
@@ -510,8 +482,7 @@ ErrorCode Stack::inversesinh()
 	}
 	push(v1.log());
 	*/
-	AF x = pop();
-	push(x.asinh());
+	setX(takeX().asinh());
 	return NoError;
 }
 
@@ -519,7 +490,7 @@ ErrorCode Stack::inversetanh()
 {
 	/* Implementation from kotlin:
 	AF x = pop();
-	if (x == AF(1.0)) {
+	if (x == 1) {
 		push(x);
 		return DivideByZero;
 	}
@@ -531,67 +502,58 @@ ErrorCode Stack::inversetanh()
 	push(0.5*v1.log());
 	*/
 
-	AF x = pop();
-	push(x.atanh());
+	setX(takeX().atanh());
 	return NoError;
 }
 
 ErrorCode Stack::inversetanh2()
 {
-	AF x = pop();
-	if (x == AF(0.0)) {
-		push(x);
+	const AF & x = peek();
+	if (x.isZero()) {
 		return DivideByZero;
 	}
-	AF y = pop();
-	AF v1 = y / x;
-	if (v1 == AF(1.0)) {
-		push(y);
-		push(x);
+	AF v1 = peekAt(1) / x;
+	if (v1 == 1) {
 		return DivideByZero;
 	}
 	v1 = (AF(1.0) + v1) / (AF(1.0) - v1);
 	if (v1 <= 0.0) {
-		push(y);
-		push(x);
 		return InvalidInverseHypTrig;
 	}
-	push(AF(0.5)*v1.log());
+	setXY(AF(0.5)*std::move(v1).log());
 	return NoError;
 }
 
 ErrorCode Stack::round()
 {
-	push(pop().round());
+	setX(takeX().round());
 	return NoError;
 }
 
 ErrorCode Stack::squareroot()
 {
-	push(pop().sqrt());
+	setX(takeX().sqrt());
 	return NoError;
 }
 
 ErrorCode Stack::cuberoot()
 {
-	push(pop().cbrt());
+	setX(takeX().cbrt());
 	return NoError;
 }
 
 ErrorCode Stack::power()
 {
-	AF x = pop();
-	AF y = pop();
-	push(y.pow(x));
-	return NoError;;
+	setXY(takeY().pow(takeX()));
+	return NoError;
 }
 
 ErrorCode Stack::swap()
 {
 	AF x = pop();
 	AF y = pop();
-	push(x);
-	push(y);
+	push(std::move(x));
+	push(std::move(y));
 	return NoError;
 }
 
@@ -603,21 +565,16 @@ ErrorCode Stack::duplicate()
 
 ErrorCode Stack::remainder()
 {
-	AF x = pop();
-	if (x == AF(0.0)) {
-		push(x);
+	if (peek().isZero()) {
 		return DivideByZero;
 	}
-	else {
-		AF y = pop();
-		push(y.remainder(x));
-	}
+	setXY(takeY().remainder(peek()));
 	return NoError;
 }
 
 ErrorCode Stack::drop()
 {
-	pop();
+	dropX();
 	return NoError;
 }
 
@@ -625,7 +582,7 @@ ErrorCode Stack::convertHmsToHours()
 {
 	AF hours, minutes, seconds;
 	int sign;
-	AF x = pop();
+	AF x = takeX();
 	if (x >= 0.0) {
 		hours = x.floor();
 		x.reduce_precision();
@@ -645,7 +602,7 @@ ErrorCode Stack::convertHmsToHours()
 	minutes = minutes.floor();
 	seconds = seconds * 100;
 	seconds.reduce_precision();
-	push(hours + (AF(sign)*((minutes+(seconds/60.0))/60.0)));
+	setX(hours + (AF(sign)*((minutes+(seconds/60.0))/60.0)));
 	return NoError;
 }
 
@@ -653,8 +610,8 @@ ErrorCode Stack::convertHmToHours()
 {
 	AF hours, minutes;
 	int sign;
-	AF x = pop();
-	if (x >= AF("0.0")) {
+	AF x = takeX();
+	if (x >= 0) {
 		hours = x.floor();
 		x.reduce_precision();
 		minutes = x - hours;
@@ -667,7 +624,7 @@ ErrorCode Stack::convertHmToHours()
 		sign = -1;
 	}
 	minutes = minutes * AF("100.0");
-	push(hours + (AF(sign)*(minutes / AF("60.0"))));
+	setX(hours + (AF(sign)*(minutes / AF("60.0"))));
 	return NoError;
 }
 
@@ -675,8 +632,8 @@ ErrorCode Stack::convertHoursToHms()
 {
 	AF parthours, hours, minutes, seconds;
 	int sign;
-	AF x = pop();
-	if (x >= AF("0.0")) {
+	AF x = takeX();
+	if (x >= 0) {
 		hours = x.floor();
 		x.reduce_precision();
 		parthours = x - hours;
@@ -692,15 +649,15 @@ ErrorCode Stack::convertHoursToHms()
 	seconds = minutes - minutes.floor();
 	seconds = seconds * AF("60.0");
 	minutes = minutes.floor();
-	while (seconds >= AF("60.0")) {
-		seconds = seconds - AF("60.0");
-		minutes = minutes + AF("1.0");
+	while (seconds >= 60) {
+		seconds = seconds - 60;
+		minutes = minutes + 1;
 	}
-	while (minutes >= AF("60.0")) {
-		minutes = minutes - AF("60.0");
+	while (minutes >= 60) {
+		minutes = minutes - 60;
 		hours = hours + AF(sign);
 	}
-	push(hours + (AF(sign)*((minutes + (seconds / AF("100.0")))/AF("100.0"))));
+	setX(hours + (AF(sign)*((minutes + (seconds / AF("100.0")))/AF("100.0"))));
 	return NoError;
 }
 
@@ -708,7 +665,7 @@ ErrorCode Stack::convertHoursToHm()
 {
 	AF parthours, hours, minutes;
 	int sign;
-	AF x = pop();
+	AF x = takeX();
 	if (x >= 0.0) {
 		hours = x.floor();
 		x.reduce_precision();
@@ -726,7 +683,7 @@ ErrorCode Stack::convertHoursToHm()
 		minutes = minutes - 60.0;
 		hours = hours + AF(sign);
 	}
-	push(hours + (AF(sign)*(minutes / 100.0)));
+	setX(hours + (AF(sign)*(minutes / 100.0)));
 	return NoError;
 }
 
@@ -0,0 +1,152 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cctype>
+
+#include "commands.h"
+#include "program.h"
+#include "strutils.h"
+
+ErrorCode Program::compile(const std::string & source, size_t & errorPosition)
+{
+	clear();
+
+	size_t i = 0;
+	while (i < source.length()) {
+		if (isspace((unsigned char) source[i])) {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		while ((i < source.length()) && ( ! isspace((unsigned char) source[i]))) {
+			i++;
+		}
+		std::string word = source.substr(start, i - start);
+
+		OpCode op = CommandHandler::lookupOpCode(word);
+		StackOp s = CommandHandler::getStackOp(op);
+		if (AF::isValidString(word)) {
+			push(AF(word), start);
+		}
+		else if (s != NULL) {
+			stackOp(s, start);
+		}
+		else if ((op == opEnter) || (word == "dup")) {
+			duplicate(start);
+		}
+		else if ((op == opPi) || startsWith(word, "Const-")) {
+			constant((op == opPi) ? "Pi" : word.substr(6), start);
+		}
+		else if (startsWith(word, "Convert_") && (split(word, '_').size() == 4)) {
+			std::vector<std::string> parts = split(word, '_');
+			convert(parts[1], parts[2], parts[3], start);
+		}
+		else {
+			errorPosition = start;
+			clear();
+			return NoFunction;
+		}
+	}
+	return NoError;
+}
+
+void Program::clear()
+{
+	instructions.clear();
+	constants.clear();
+	stackOps.clear();
+	names.clear();
+}
+
+void Program::add(Code code, size_t arg, size_t position)
+{
+	instructions.push_back({code, (uint32_t) arg, (uint32_t) position});
+}
+
+void Program::push(const AF & v, size_t position)
+{
+	add(codePush, constants.size(), position);
+	constants.push_back(v);
+}
+
+void Program::stackOp(StackOp op, size_t position)
+{
+	auto existing = std::find(stackOps.begin(), stackOps.end(), op);
+	add(codeStackOp, existing - stackOps.begin(), position);
+	if (existing == stackOps.end()) {
+		stackOps.push_back(op);
+	}
+}
+
+void Program::duplicate(size_t position)
+{
+	add(codeDuplicate, 0, position);
+}
+
+void Program::constant(const std::string & name, size_t position)
+{
+	add(codeConstant, names.size(), position);
+	names.push_back(name);
+}
+
+void Program::convert(const std::string & category, const std::string & from, const std::string & to, size_t position)
+{
+	add(codeConvert, names.size(), position);
+	names.push_back(category);
+	names.push_back(from);
+	names.push_back(to);
+}
+
+ErrorCode Program::run(Stack & st, size_t & errorPosition, bool checkpoint) const
+{
+	// Other stacks may share this thread, so use the stack's precision
+	AFWorkingDigits wd(st.getPrecision());
+	ErrorCode ec = NoError;
+	for (const Instruction & ins : instructions) {
+		switch (ins.code) {
+			case codePush:
+				st.push(constants[ins.arg]);
+				break;
+			case codeStackOp:
+				ec = (st.*stackOps[ins.arg])();
+				break;
+			case codeDuplicate:
+				ec = st.duplicate();
+				break;
+			case codeConstant:
+				ec = st.constant(names[ins.arg]);
+				break;
+			case codeConvert:
+				ec = st.convert(names[ins.arg], names[ins.arg + 1], names[ins.arg + 2]);
+				break;
+		}
+		if (ec != NoError) {
+			errorPosition = ins.position;
+			break;
+		}
+	}
+	if (checkpoint) {
+		st.saveHistory();
+	}
+	return ec;
+}
+
+size_t Program::size() const
+{
+	return instructions.size();
+}
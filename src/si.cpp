@@ -91,11 +91,11 @@ ErrorCode CommandHandler::SI(std::string name)
 	AF power;
 	if (SIDecimalPrefixes.contains(name)) {
 		power = SIDecimalPrefixes[name];
-		mult = AF(10.0).pow(power);
+		mult = AF::powerOfTen(power.toInt());
 	}
 	else if (SIBinaryPrefixes.contains(name)) {
 		power = SIBinaryPrefixes[name];
-		mult = AF(2.0).pow(power);
+		mult = AF::powerOfTwo(power.toInt());
 	}
 	else {
 		bool found = false;
@@ -103,11 +103,11 @@ ErrorCode CommandHandler::SI(std::string name)
 			if (short_name == name) {
 				if (SIDecimalPrefixes.contains(long_name)) {
 					power = SIDecimalPrefixes[long_name];
-					mult = AF(10.0).pow(power);
+					mult = AF::powerOfTen(power.toInt());
 				}
 				else if (SIBinaryPrefixes.contains(long_name)) {
 					power = SIBinaryPrefixes[long_name];
-					mult = AF(2.0).pow(power);
+					mult = AF::powerOfTwo(power.toInt());
 				}
 				else {
 				}
@@ -121,7 +121,7 @@ ErrorCode CommandHandler::SI(std::string name)
 		}
 	}
 
-	st.push(st.pop() * mult);
+	st.convertMultiplier(mult);
 	return NoError;
 }
 
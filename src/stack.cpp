@@ -19,6 +19,9 @@
 #include <iostream>
 #include <random>
 #include <chrono>
+#include <utility>
+#include <iterator>
+#include <algorithm>
 
 #include "stack.h"
 
@@ -35,17 +38,9 @@ Stack::Stack()
 	rng.seed(seed_val);
 }
 
-std::vector<AF> Stack::getStackForDisplay()
+StackView Stack::view(const AF * pending) const
 {
-	std::vector<AF> result;
-	/* Use indices to get the right range, but use peek
-	 * to ensure the correct order regardless of actual
-	 * implementation.
-	 */
-	for (unsigned int i=0;i<(unsigned int)stack.size();i++) {
-		result.push_back(peekAt(i));
-	}
-	return result;
+	return StackView(stack, pending);
 }
 
 void Stack::debugStackPrint()
@@ -57,17 +52,29 @@ void Stack::debugStackPrint()
 
 void Stack::setOption(CalcOpt o, bool v)
 {
-	if (v) {
-		options.insert(o);
+	options.set(o, v);
+	if (o == ReplicateStack) {
+		if (v) {
+			pushFn = &Stack::pushAs<ReplicatingStack>;
+			popFn = &Stack::popAs<ReplicatingStack>;
+			dropXFn = &Stack::dropXAs<ReplicatingStack>;
+		}
+		else {
+			pushFn = &Stack::pushAs<UnboundedStack>;
+			popFn = &Stack::popAs<UnboundedStack>;
+			dropXFn = &Stack::dropXAs<UnboundedStack>;
+		}
 	}
-	else {
-		options.erase(o);
+	if ((o == SaveHistory) && ( ! v)) {
+		// The journal can't be picked up again later once it has
+		// stopped following the stack
+		clearHistory();
 	}
 }
 
 bool Stack::getOption(CalcOpt o)
 {
-	return options.contains(o);
+	return options.test(o);
 }
 
 const std::map<std::string, CalcOpt> Stack::getOptionNameMap()
@@ -75,18 +82,26 @@ const std::map<std::string, CalcOpt> Stack::getOptionNameMap()
 	return CalcOptNames;
 }
 
-intmax_t Stack::getBitMask()
+int Stack::getBitWidth()
 {
 	switch (bitCount) {
 		case bc8:
-			return 0xFFL;
+			return 8;
 		case bc16:
-			return 0xFFFFL;
+			return 16;
 		case bc32:
-			return 0xFFFFFFFFL;
+			return 32;
 		default:
 		case bc64:
-			return 0x7FFFFFFFFFFFFFFFL;
+			return 64;
+		case bc128:
+			return 128;
+		case bc256:
+			return 256;
+		case bc512:
+			return 512;
+		case bcArbitrary:
+			return 0;
 	}
 }
 
@@ -98,99 +113,628 @@ BitCount Stack::getBitCount() {
 	return bitCount;
 }
 
+static size_t changeMemory(const StackChange & c)
+{
+	size_t bytes = sizeof(c) + c.value.memoryUsed();
+	for (auto & v : c.contents) {
+		bytes += v.memoryUsed();
+	}
+	return bytes;
+}
+
+static size_t changesMemory(const std::vector<StackChange> & changes)
+{
+	size_t bytes = 0;
+	for (auto & c : changes) {
+		bytes += changeMemory(c);
+	}
+	return bytes;
+}
+
+void Stack::setPrecision(int digits)
+{
+	// The constants are worked out at the working precision, but that
+	// belongs to the thread rather than this stack, so put it back after
+	AFWorkingDigits wd(digits);
+	precisionDigits = AF::getWorkingDigits();
+
+	// Bring everything already stored to the new precision so that
+	// lowering it actually speeds things up
+	for (auto & v : stack) {
+		v.setDigits(precisionDigits);
+	}
+	// The history takes a different amount of memory afterwards
+	historyMemory = 0;
+	for (auto & changes : history) {
+		for (auto & c : changes) {
+			c.value.setDigits(precisionDigits);
+			for (auto & v : c.contents) {
+				v.setDigits(precisionDigits);
+			}
+		}
+		historyMemory += changesMemory(changes);
+	}
+	for (auto & c : snapshotLog) {
+		c.value.setDigits(precisionDigits);
+		for (auto & v : c.contents) {
+			v.setDigits(precisionDigits);
+		}
+	}
+	for (auto & [name, slot] : stackSlots) {
+		for (auto & v : slot.checkpoint->contents) {
+			v.setDigits(precisionDigits);
+		}
+	}
+	populateConstants();
+	populateDensities();
+}
+
+int Stack::getPrecision()
+{
+	return precisionDigits;
+}
+
 void Stack::saveHistory()
 {
-	if (options.contains(SaveHistory)) {
-		std::vector<AF> stackCopy(stack);
-		history.push_back(stackCopy);
-		if (history.size() > MAX_HIST) {
+	// Start a new list of changes: undo reverses everything after
+	// the most recent call
+	if (options.test(SaveHistory)) {
+		history.emplace_back();
+		trimHistory();
+	}
+}
+
+void Stack::setHistoryDepth(size_t depth)
+{
+	maxHistory = depth;
+	trimHistory();
+}
+
+void Stack::setHistoryMemory(size_t bytes)
+{
+	maxHistoryMemory = bytes;
+	trimHistory();
+}
+
+bool Stack::setHistoryFile(std::string path)
+{
+	// Anything already spilled is in the old file
+	spilledHistory.clear();
+	historyFile.reset(path.empty() ? NULL : fopen(path.c_str(), "w+b"));
+	return path.empty() || historyFile;
+}
+
+void Stack::trimHistory()
+{
+	while (history.size() + spilledHistory.size() > maxHistory) {
+		if (spilledHistory.empty()) {
+			historyMemory -= changesMemory(history.front());
 			history.pop_front();
 		}
+		else {
+			spilledHistory.pop_front();
+		}
+	}
+	// Always keep the list that's being added to
+	while ((historyMemory > maxHistoryMemory) && (history.size() > 1)) {
+		spillHistory();
+	}
+}
+
+void Stack::clearHistory()
+{
+	history.clear();
+	historyMemory = 0;
+	spilledHistory.clear();
+}
+
+// Changes that hold the value they removed
+static bool keepsValue(StackChangeType type)
+{
+	return (type == changePop) || (type == changePopFront) || (type == changeSetX);
+}
+
+// Changes that only apply to the top few entries
+static bool hasDepth(StackChangeType type)
+{
+	return (type == changeRollUp) || (type == changeRollDown) || (type == changeReverse);
+}
+
+/* The history file holds one record per list of changes: the number of
+ * changes, then for each one its type, followed by the value (for pops
+ * and set X), the depth (for rolls and reverse) or the number of values
+ * and the values (for replace).  It is only
+ * ever read back by this process, so it's in the native byte order.
+ */
+static bool writeChanges(FILE *f, const std::vector<StackChange> & changes)
+{
+	uint32_t count = changes.size();
+	if (fwrite(&count, sizeof(count), 1, f) != 1) {
+		return false;
+	}
+	for (auto & c : changes) {
+		uint8_t type = c.type;
+		if (fwrite(&type, sizeof(type), 1, f) != 1) {
+			return false;
+		}
+		if (keepsValue(c.type)) {
+			if ( ! c.value.write(f)) {
+				return false;
+			}
+		}
+		else if (hasDepth(c.type)) {
+			uint64_t depth = c.depth;
+			if (fwrite(&depth, sizeof(depth), 1, f) != 1) {
+				return false;
+			}
+		}
+		else if (c.type == changeReplace) {
+			uint64_t size = c.contents.size();
+			if (fwrite(&size, sizeof(size), 1, f) != 1) {
+				return false;
+			}
+			for (auto & v : c.contents) {
+				if ( ! v.write(f)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static bool readChanges(FILE *f, std::vector<StackChange> & changes)
+{
+	uint32_t count;
+	if (fread(&count, sizeof(count), 1, f) != 1) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t type;
+		if ((fread(&type, sizeof(type), 1, f) != 1) || (type > changeReplace)) {
+			return false;
+		}
+		StackChange c{(StackChangeType) type, AF(), {}};
+		if (keepsValue(c.type)) {
+			if ( ! AF::read(f, c.value)) {
+				return false;
+			}
+		}
+		else if (hasDepth(c.type)) {
+			uint64_t depth;
+			if (fread(&depth, sizeof(depth), 1, f) != 1) {
+				return false;
+			}
+			c.depth = depth;
+		}
+		else if (c.type == changeReplace) {
+			uint64_t size;
+			if (fread(&size, sizeof(size), 1, f) != 1) {
+				return false;
+			}
+			for (uint64_t j = 0; j < size; j++) {
+				AF v;
+				if ( ! AF::read(f, v)) {
+					return false;
+				}
+				c.contents.push_back(std::move(v));
+			}
+		}
+		changes.push_back(std::move(c));
+	}
+	return true;
+}
+
+void Stack::spillHistory()
+{
+	// Move the oldest list in memory to the end of the file, or just
+	// drop it if there's no file (or it can't be written).  The file is
+	// only ever appended to, apart from reusing the space of records
+	// that have been read back.
+	FILE *f = historyFile.get();
+	if (spilledHistory.empty()) {
+		historyFileEnd = 0;
+	}
+	if ((f != NULL) && (fseek(f, historyFileEnd, SEEK_SET) == 0) && writeChanges(f, history.front())) {
+		spilledHistory.push_back(historyFileEnd);
+		historyFileEnd = ftell(f);
+	}
+	else {
+		// Older entries can't be undone without this one
+		spilledHistory.clear();
+	}
+	historyMemory -= changesMemory(history.front());
+	history.pop_front();
+}
+
+bool Stack::unspillHistory()
+{
+	// Read the newest list back from the file
+	FILE *f = historyFile.get();
+	long offset = spilledHistory.back();
+	spilledHistory.pop_back();
+	std::vector<StackChange> changes;
+	if ((fseek(f, offset, SEEK_SET) != 0) || ( ! readChanges(f, changes))) {
+		spilledHistory.clear();
+		return false;
+	}
+	for (auto & c : changes) {
+		c.value.setDigits(precisionDigits);
+		for (auto & v : c.contents) {
+			v.setDigits(precisionDigits);
+		}
+	}
+	// The next one to be written replaces it
+	historyFileEnd = offset;
+	historyMemory += changesMemory(changes);
+	history.push_front(std::move(changes));
+	return true;
+}
+
+bool Stack::journaling()
+{
+	// Nothing to record until there's something to undo back to (or a
+	// snapshot to restore)
+	pruneSnapshots();
+	return (( ! history.empty()) && options.test(SaveHistory)) || ( ! snapshots.empty());
+}
+
+void Stack::journal(StackChangeType type, AF value, std::vector<AF> contents, size_t depth)
+{
+	StackChange c{type, std::move(value), std::move(contents), depth};
+	if (( ! history.empty()) && options.test(SaveHistory)) {
+		if ( ! snapshots.empty()) {
+			logChange(c);
+		}
+		historyMemory += changeMemory(c);
+		history.back().push_back(std::move(c));
+	}
+	else {
+		logChange(std::move(c));
+	}
+}
+
+// Move X up to depth entries from the top (the bottom if depth is 0)
+static void rollEntriesUp(std::deque<AF> & s, size_t depth)
+{
+	if (depth == 0) {
+		AF v = std::move(s.back());
+		s.pop_back();
+		s.push_front(std::move(v));
+	}
+	else {
+		std::rotate(s.end() - depth, s.end() - 1, s.end());
+	}
+}
+
+// Move the entry depth from the top (the bottom if depth is 0) to X
+static void rollEntriesDown(std::deque<AF> & s, size_t depth)
+{
+	if (depth == 0) {
+		AF v = std::move(s.front());
+		s.pop_front();
+		s.push_back(std::move(v));
+	}
+	else {
+		std::rotate(s.end() - depth, s.end() - depth + 1, s.end());
+	}
+}
+
+// Reverse c on s, moving any values out of c.  Returns the change that
+// would reverse it again.
+static StackChange revertChange(std::deque<AF> & s, StackChange & c)
+{
+	StackChange r{changePush, AF(), {}};
+	switch (c.type) {
+		case changePush:
+			r = {changePop, std::move(s.back()), {}};
+			s.pop_back();
+			break;
+		case changePop:
+			s.push_back(std::move(c.value));
+			break;
+		case changePushFront:
+			r = {changePopFront, std::move(s.front()), {}};
+			s.pop_front();
+			break;
+		case changePopFront:
+			s.push_front(std::move(c.value));
+			r.type = changePushFront;
+			break;
+		case changeRollUp:
+			rollEntriesDown(s, c.depth);
+			r = {changeRollDown, AF(), {}, c.depth};
+			break;
+		case changeRollDown:
+			rollEntriesUp(s, c.depth);
+			r = {changeRollUp, AF(), {}, c.depth};
+			break;
+		case changeReverse:
+			std::reverse(s.end() - c.depth, s.end());
+			r = {changeReverse, AF(), {}, c.depth};
+			break;
+		case changeSetX:
+			std::swap(s.back(), c.value);
+			r = {changeSetX, std::move(c.value), {}};
+			break;
+		case changeReplace:
+			r = {changeReplace, AF(), std::vector<AF>(
+					std::make_move_iterator(s.begin()), std::make_move_iterator(s.end()))};
+			s.assign(std::make_move_iterator(c.contents.begin()), std::make_move_iterator(c.contents.end()));
+			break;
+	}
+	return r;
+}
+
+StackSnapshot Stack::snapshot()
+{
+	pruneSnapshots();
+	auto cp = std::make_shared<StackCheckpoint>();
+	cp->owner = this;
+	cp->mark = snapshotLogStart + snapshotLog.size();
+	cp->copied = false;
+	snapshots.push_back(cp);
+	return StackSnapshot(cp);
+}
+
+void Stack::restore(const StackSnapshot & s)
+{
+	StackCheckpoint *cp = s.checkpoint.get();
+	if ((cp == NULL) || (cp->owner != this)) {
+		return;
+	}
+	if (cp->copied) {
+		replaceStack(cp->contents);
+	}
+	else {
+		replaceStack(stackAt(cp->mark));
+	}
+}
+
+void Stack::storeStack(std::string name)
+{
+	stackSlots[name] = snapshot();
+}
+
+void Stack::recallStack(std::string name)
+{
+	auto slot = stackSlots.find(name);
+	if (slot != stackSlots.end()) {
+		restore(slot->second);
+	}
+	else {
+		clear();
+	}
+}
+
+void Stack::logChange(StackChange c)
+{
+	snapshotLogSize += 1 + c.contents.size();
+	snapshotLog.push_back(std::move(c));
+	// Once the log costs more than copying the stack, copy it instead
+	// (changes are always logged after they're made, so the two agree)
+	if (snapshotLogSize > std::max(stack.size(), (size_t) 32) * 2) {
+		copySnapshots();
+	}
+}
+
+void Stack::pruneSnapshots()
+{
+	// Snapshots only referred to from here have been discarded
+	while (( ! snapshots.empty()) && (snapshots.front().use_count() == 1)) {
+		snapshots.pop_front();
+	}
+	size_t end = snapshots.empty() ? (snapshotLogStart + snapshotLog.size()) : snapshots.front()->mark;
+	while (snapshotLogStart < end) {
+		snapshotLogSize -= 1 + snapshotLog.front().contents.size();
+		snapshotLog.pop_front();
+		snapshotLogStart++;
+	}
+}
+
+void Stack::copySnapshots()
+{
+	// Work back from the current stack, newest snapshot first
+	std::deque<AF> s = stack;
+	size_t mark = snapshotLogStart + snapshotLog.size();
+	for (auto cp = snapshots.rbegin(); cp != snapshots.rend(); cp++) {
+		for (; mark > (*cp)->mark; mark--) {
+			StackChange c = snapshotLog[mark - (1+snapshotLogStart)];
+			revertChange(s, c);
+		}
+		(*cp)->contents = s;
+		(*cp)->copied = true;
+	}
+	snapshots.clear();
+	pruneSnapshots();
+}
+
+std::deque<AF> Stack::stackAt(size_t mark)
+{
+	std::deque<AF> s = stack;
+	for (size_t i = snapshotLogStart + snapshotLog.size(); i > mark; i--) {
+		StackChange c = snapshotLog[i - (1+snapshotLogStart)];
+		revertChange(s, c);
+	}
+	return s;
+}
+
+void Stack::replaceStack(std::deque<AF> s)
+{
+	std::deque<AF> old = std::move(stack);
+	stack = std::move(s);
+	if (journaling()) {
+		journal(changeReplace, AF(), std::vector<AF>(
+					std::make_move_iterator(old.begin()), std::make_move_iterator(old.end())));
 	}
 }
 
 
 void Stack::clear()
 {
-	stack.clear();
+	replaceStack(std::deque<AF>());
 }
 
 
-void Stack::push(AF v)
+template <class P>
+void Stack::pushAs(AF v)
 {
-	stack.push_back(v);
-	if (options.contains(ReplicateStack)) {
-		while (stack.size() > 4) {
+	stack.push_back(std::move(v));
+	if (journaling()) {
+		journal(changePush);
+	}
+	if constexpr (P::depth > 0) {
+		while (stack.size() > P::depth) {
 			// Remove first element
-			stack.erase(stack.begin());
+			AF v = std::move(stack.front());
+			stack.pop_front();
+			if (journaling()) {
+				journal(changePopFront, std::move(v));
+			}
 		}
 	}
 }
 
 
+void Stack::push(AF v)
+{
+	(this->*pushFn)(std::move(v));
+}
+
+
 void Stack::push(std::vector<AF> vs)
 {
-	for (AF n: vs) {
-		stack.push_back(n);
+	for (AF & n: vs) {
+		push(std::move(n));
 	}
-	if (options.contains(ReplicateStack)) {
-		while (stack.size() < 4) {
-			// Remove first element
-			stack.erase(stack.begin());
+}
+
+
+template <class P>
+AF Stack::popAs()
+{
+	if (stack.empty()) {
+		return AF(0.0);
+	}
+	if constexpr (P::depth > 0) {
+		if (stack.size() == P::depth) {
+			stack.push_front(stack.front());
+			if (journaling()) {
+				journal(changePushFront);
+			}
 		}
 	}
+	// Move rather than copy: the element is about to be removed anyway
+	AF result = std::move(stack.back());
+	stack.pop_back();
+	if (journaling()) {
+		journal(changePop, result);
+	}
+	return result;
 }
 
-
 AF Stack::pop()
 {
-	AF result;
+	return (this->*popFn)();
+}
+
+template <class P>
+void Stack::dropXAs()
+{
+	// As pop(), but the value goes straight to the journal
 	if (stack.empty()) {
-		result = AF(0.0);
+		return;
 	}
-	else {
-		if (options.contains(ReplicateStack)) {
-			if (stack.size() == 4) {
-				stack.insert(stack.begin(), stack.front());
+	if constexpr (P::depth > 0) {
+		if (stack.size() == P::depth) {
+			stack.push_front(stack.front());
+			if (journaling()) {
+				journal(changePushFront);
 			}
 		}
-		result = stack.back();
-		stack.pop_back();
 	}
-	return result;
+	AF v = std::move(stack.back());
+	stack.pop_back();
+	if (journaling()) {
+		journal(changePop, std::move(v));
+	}
 }
 
-AF Stack::peek()
+void Stack::dropX()
+{
+	(this->*dropXFn)();
+}
+
+AF Stack::takeX()
 {
-	AF result;
 	if (stack.empty()) {
-		result = AF(0.0);
+		return AF(0.0);
 	}
-	else {
-		result = stack.back();
+	if (journaling()) {
+		return stack.back();
 	}
-	return result;
+	return std::move(stack.back());
 }
 
-AF Stack::peekAt(int index)
+AF Stack::takeY()
 {
-	AF result;
-	if (index < (int) stack.size()) {
-		result = stack.at(stack.size() - (1+index));
+	if (stack.size() < 2) {
+		return AF(0.0);
 	}
-	else {
-		result = AF(0.0);
+	if (journaling()) {
+		return stack[stack.size() - 2];
 	}
-	return result;
+	return std::move(stack[stack.size() - 2]);
+}
+
+void Stack::setX(AF v)
+{
+	if (stack.empty()) {
+		push(std::move(v));
+		return;
+	}
+	std::swap(stack.back(), v);
+	if (journaling()) {
+		journal(changeSetX, std::move(v));
+	}
+}
+
+void Stack::setXY(AF v)
+{
+	dropX();
+	setX(std::move(v));
+}
+
+static const AF & zero()
+{
+	static const AF z(0.0);
+	return z;
+}
+
+const AF & Stack::peek() const
+{
+	if (stack.empty()) {
+		return zero();
+	}
+	return stack.back();
+}
+
+const AF & Stack::peekAt(int index) const
+{
+	if ((index >= 0) && (index < (int) stack.size())) {
+		return stack[stack.size() - (1+index)];
+	}
+	return zero();
 }
 
 
 ErrorCode Stack::rollUp()
 {
 	if (stack.size() > 0) {
-		AF v = stack.back();
-		stack.pop_back();
-		stack.insert(stack.begin(), v);
+		rollEntriesUp(stack, 0);
+		if (journaling()) {
+			journal(changeRollUp);
+		}
 	}
 	return NoError;
 }
@@ -198,30 +742,145 @@ ErrorCode Stack::rollUp()
 ErrorCode Stack::rollDown()
 {
 	if (stack.size() > 0) {
-		stack.push_back(stack.front());
-		// Remove first element
-		stack.erase(stack.begin());
+		rollEntriesDown(stack, 0);
+		if (journaling()) {
+			journal(changeRollDown);
+		}
+	}
+	return NoError;
+}
+
+bool Stack::validCount(bool allowZero)
+{
+	// X has to be a whole number of the entries below it (NaN compares
+	// equal to everything, so check for it first)
+	const AF & n = peek();
+	return n.isFinite() && (n >= (allowZero ? 0 : 1)) && (n == n.round()) && (n <= (intmax_t) stack.size() - 1);
+}
+
+ErrorCode Stack::pickN()
+{
+	if ( ! validCount(false)) {
+		return InvalidStackCount;
 	}
+	size_t n = peek().toLong();
+	dropX();
+	push(stack[stack.size() - n]);
+	return NoError;
+}
+
+ErrorCode Stack::rollN()
+{
+	if ( ! validCount()) {
+		return InvalidStackCount;
+	}
+	size_t n = peek().toLong();
+	dropX();
+	if (n > 1) {
+		rollEntriesDown(stack, n);
+		if (journaling()) {
+			journal(changeRollDown, AF(), {}, n);
+		}
+	}
+	return NoError;
+}
+
+ErrorCode Stack::rollDN()
+{
+	if ( ! validCount()) {
+		return InvalidStackCount;
+	}
+	size_t n = peek().toLong();
+	dropX();
+	if (n > 1) {
+		rollEntriesUp(stack, n);
+		if (journaling()) {
+			journal(changeRollUp, AF(), {}, n);
+		}
+	}
+	return NoError;
+}
+
+ErrorCode Stack::dropN()
+{
+	if ( ! validCount()) {
+		return InvalidStackCount;
+	}
+	size_t n = peek().toLong();
+	for (size_t i = 0; i <= n; i++) {
+		dropX();
+	}
+	return NoError;
+}
+
+ErrorCode Stack::dupN()
+{
+	if ( ! validCount()) {
+		return InvalidStackCount;
+	}
+	size_t n = peek().toLong();
+	dropX();
+	push(std::vector<AF>(stack.end() - n, stack.end()));
+	return NoError;
+}
+
+ErrorCode Stack::reverseN()
+{
+	if ( ! validCount()) {
+		return InvalidStackCount;
+	}
+	size_t n = peek().toLong();
+	dropX();
+	if (n > 1) {
+		std::reverse(stack.end() - n, stack.end());
+		if (journaling()) {
+			journal(changeReverse, AF(), {}, n);
+		}
+	}
+	return NoError;
+}
+
+ErrorCode Stack::depth()
+{
+	push(AF((intmax_t) stack.size()));
 	return NoError;
 }
 
 
 ErrorCode Stack::undo()
 {
-	if ( ! options.contains(SaveHistory)) {
+	if ( ! options.test(SaveHistory)) {
 		return NoHistorySaved;
 	}
 	if (history.size() > 0) {
-		stack = history.back();
+		// Reverse the changes since the last saveHistory
+		std::vector<StackChange> & changes = history.back();
+		historyMemory -= changesMemory(changes);
+		for (auto c = changes.rbegin(); c != changes.rend(); c++) {
+			StackChange r = revertChange(stack, *c);
+			if ( ! snapshots.empty()) {
+				logChange(std::move(r));
+			}
+		}
 		history.pop_back();
+		if (history.empty() && ( ! spilledHistory.empty())) {
+			// Keep the changes from here on following on from the
+			// newest entry in the file
+			unspillHistory();
+		}
 	}
 	else {
+		std::deque<AF> old = std::move(stack);
 		stack.clear();
+		if ( ! snapshots.empty()) {
+			logChange({changeReplace, AF(), std::vector<AF>(
+						std::make_move_iterator(old.begin()), std::make_move_iterator(old.end()))});
+		}
 	}
 	return NoError;
 }
 
-void Stack::printThisStack(std::vector<AF> s) {
+void Stack::printThisStack(const std::deque<AF> & s) {
 	for (int i=0;i<(int)s.size();i++) {
 		std::cerr << "-> " << i << ": " << s.at(i).toString() << std::endl;
 	}
@@ -229,18 +888,37 @@ void Stack::printThisStack(std::vector<AF> s) {
 
 void Stack::printHistory()
 {
-	if ( ! options.contains(SaveHistory)) {
+	if ( ! options.test(SaveHistory)) {
 		std::cerr << "No history saved" << std::endl;
 	}
 
 	std::cerr << "Current stack:" << std::endl;
 	printThisStack(stack);
 
+	if ( ! spilledHistory.empty()) {
+		std::cerr << spilledHistory.size() << " older history entries in file" << std::endl;
+	}
+
+	static const char *changeNames[] = {
+		"push", "pop", "push front", "pop front", "roll up", "roll down", "reverse", "set X", "replace"
+	};
 	int index = 0;
-	for (auto & l : history) {
+	for (auto & changes : history) {
 		std::cerr << "History entry " << index << std::endl;
 
-		printThisStack(l);
+		for (auto & c : changes) {
+			std::cerr << "-> " << changeNames[c.type];
+			if (keepsValue(c.type)) {
+				std::cerr << ": " << c.value.toString();
+			}
+			else if (hasDepth(c.type) && (c.depth > 0)) {
+				std::cerr << ": " << c.depth << " entries";
+			}
+			else if (c.type == changeReplace) {
+				std::cerr << ": " << c.contents.size() << " entries";
+			}
+			std::cerr << std::endl;
+		}
 
 		index += 1;
 	}
@@ -0,0 +1,277 @@
+/*
+ * ARPCalc - Al's Reverse Polish Calculator (C++ Version)
+ * Copyright (C) 2022 A. S. Budden
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "stack.h"
+
+// Fewer values than this per thread aren't worth starting a thread for
+static const size_t MIN_VALUES_PER_THREAD = 16384;
+
+static size_t threadsFor(size_t count)
+{
+#if defined(__EMSCRIPTEN__) && ! defined(__EMSCRIPTEN_PTHREADS__)
+	(void) count;
+	return 1;
+#else
+	size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	return std::clamp(count / MIN_VALUES_PER_THREAD, (size_t) 1, cores);
+#endif
+}
+
+/* Split 0..count into chunks and call f(first, last, chunk) for each
+ * one, all at the same time.  The first chunk is done on this thread
+ * and the others each get their own, working to the same precision
+ * and rounding.
+ */
+template <class F>
+static void forEachChunk(size_t count, size_t chunks, F f)
+{
+	int digits = AF::getWorkingDigits();
+	mpfr_rnd_t rounding = AF::getWorkingRounding();
+	std::vector<std::thread> threads;
+	for (size_t c = 1; c < chunks; c++) {
+		threads.emplace_back([=, &f]() {
+			AFWorkingDigits wd(digits);
+			AFWorkingRounding wr(rounding);
+			f(count * c / chunks, count * (c + 1) / chunks, c);
+		});
+	}
+	f(0, count / chunks, 0);
+	for (auto & t : threads) {
+		t.join();
+	}
+}
+
+static AF parallelSum(const std::vector<const AF *> & values)
+{
+	// Each thread finds the exact sum of its share, so there's still
+	// only one rounding at the end
+	size_t chunks = threadsFor(values.size());
+	std::vector<AF> partials(chunks);
+	std::vector<char> exact(chunks, 1);
+	if (chunks > 1) {
+		forEachChunk(values.size(), chunks, [&](size_t first, size_t last, size_t c) {
+			exact[c] = AF::exactSum(values.data() + first, last - first, partials[c]);
+		});
+	}
+	if ((chunks == 1) || (std::find(exact.begin(), exact.end(), 0) != exact.end())) {
+		return AF::sum(values.data(), values.size());
+	}
+	std::vector<const AF *> ptrs;
+	for (auto & v : partials) {
+		ptrs.push_back(&v);
+	}
+	return AF::sum(ptrs.data(), ptrs.size());
+}
+
+static std::vector<const AF *> pointersTo(const std::deque<AF> & s, size_t count)
+{
+	std::vector<const AF *> ptrs;
+	ptrs.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		ptrs.push_back(&s[i]);
+	}
+	return ptrs;
+}
+
+ErrorCode Stack::sum()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	replaceStack({parallelSum(pointersTo(stack, stack.size()))});
+	return NoError;
+}
+
+ErrorCode Stack::product()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	size_t chunks = threadsFor(stack.size());
+	std::vector<AF> partials(chunks);
+	forEachChunk(stack.size(), chunks, [&](size_t first, size_t last, size_t c) {
+		AF p = stack[first];
+		for (size_t i = first + 1; i < last; i++) {
+			p *= stack[i];
+		}
+		partials[c] = std::move(p);
+	});
+	AF result = std::move(partials[0]);
+	for (size_t c = 1; c < chunks; c++) {
+		result *= partials[c];
+	}
+	replaceStack({std::move(result)});
+	return NoError;
+}
+
+ErrorCode Stack::mean()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	AF total = parallelSum(pointersTo(stack, stack.size()));
+	replaceStack({std::move(total) / AF((intmax_t) stack.size())});
+	return NoError;
+}
+
+ErrorCode Stack::varianceOf(AF & result)
+{
+	size_t n = stack.size();
+	if (n < 2) {
+		return InvalidStackCount;
+	}
+	// Measured from one of the values rather than from zero, so that
+	// values that are close together don't lose digits to cancellation
+	// (and small values stay small enough to be summed exactly)
+	const AF & origin = stack[0];
+	std::vector<AF> deviations(n);
+	std::vector<AF> squares(n);
+	forEachChunk(n, threadsFor(n), [&](size_t first, size_t last, size_t) {
+		for (size_t i = first; i < last; i++) {
+			deviations[i] = stack[i] - origin;
+			squares[i] = deviations[i] * deviations[i];
+		}
+	});
+	std::vector<const AF *> ptrs;
+	ptrs.reserve(n);
+	for (auto & v : deviations) {
+		ptrs.push_back(&v);
+	}
+	AF total = parallelSum(ptrs);
+	for (size_t i = 0; i < n; i++) {
+		ptrs[i] = &squares[i];
+	}
+	AF totalSquares = parallelSum(ptrs);
+	result = (std::move(totalSquares) - total * total / AF((intmax_t) n)) / AF((intmax_t) (n - 1));
+	return NoError;
+}
+
+ErrorCode Stack::variance()
+{
+	AF v;
+	ErrorCode ec = varianceOf(v);
+	if (ec == NoError) {
+		replaceStack({std::move(v)});
+	}
+	return ec;
+}
+
+ErrorCode Stack::stddev()
+{
+	AF v;
+	ErrorCode ec = varianceOf(v);
+	if (ec == NoError) {
+		replaceStack({std::move(v).sqrt()});
+	}
+	return ec;
+}
+
+ErrorCode Stack::minimum()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	size_t chunks = threadsFor(stack.size());
+	std::vector<size_t> least(chunks);
+	forEachChunk(stack.size(), chunks, [&](size_t first, size_t last, size_t c) {
+		least[c] = std::min_element(stack.begin() + first, stack.begin() + last) - stack.begin();
+	});
+	size_t result = least[0];
+	for (size_t i : least) {
+		if (stack[i] < stack[result]) {
+			result = i;
+		}
+	}
+	replaceStack({stack[result]});
+	return NoError;
+}
+
+ErrorCode Stack::maximum()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	size_t chunks = threadsFor(stack.size());
+	std::vector<size_t> greatest(chunks);
+	forEachChunk(stack.size(), chunks, [&](size_t first, size_t last, size_t c) {
+		greatest[c] = std::max_element(stack.begin() + first, stack.begin() + last) - stack.begin();
+	});
+	size_t result = greatest[0];
+	for (size_t i : greatest) {
+		if (stack[i] > stack[result]) {
+			result = i;
+		}
+	}
+	replaceStack({stack[result]});
+	return NoError;
+}
+
+ErrorCode Stack::percentileOf(size_t count, const AF & p)
+{
+	// Interpolates between the closest ranks (as a spreadsheet's
+	// PERCENTILE would), finding them by selection rather than sorting
+	if ( ! p.isFinite()) {
+		return InvalidPercentile;
+	}
+	std::vector<const AF *> ptrs = pointersTo(stack, count);
+	for (const AF * v : ptrs) {
+		if (std::isnan(v->toDouble())) {
+			// It wouldn't be ordered
+			replaceStack({*v});
+			return NoError;
+		}
+	}
+	AF rank = AF((intmax_t) (count - 1)) * p / 100;
+	AF lowerRank = rank.floor();
+	AF fraction = std::move(rank) - lowerRank;
+	auto less = [](const AF * a, const AF * b) { return *a < *b; };
+	auto lower = ptrs.begin() + lowerRank.toLong();
+	std::nth_element(ptrs.begin(), lower, ptrs.end(), less);
+	AF result = **lower;
+	if (( ! fraction.isZero()) && (lower + 1 != ptrs.end())) {
+		const AF & upper = **std::min_element(lower + 1, ptrs.end(), less);
+		result += std::move(fraction) * (upper - result);
+	}
+	replaceStack({std::move(result)});
+	return NoError;
+}
+
+ErrorCode Stack::median()
+{
+	if (stack.empty()) {
+		return InvalidStackCount;
+	}
+	return percentileOf(stack.size(), AF(50));
+}
+
+ErrorCode Stack::percentile()
+{
+	const AF & p = peek();
+	// NaN would pass the range check
+	if (( ! p.isFinite()) || ( ! ((p >= 0) && (p <= 100)))) {
+		return InvalidPercentile;
+	}
+	if (stack.size() < 2) {
+		return InvalidStackCount;
+	}
+	return percentileOf(stack.size() - 1, AF(p));
+}
@@ -63,32 +63,3 @@ std::string toLower(std::string original) {
 	std::transform(original.begin(), original.end(), std::back_inserter(output), (int (*)(int)) std::tolower);
 	return output;
 }
-
-std::string convertWithBase(intmax_t value, int base)
-{
-	std::string buf;
-
-	// check that the base if valid
-	if (base < 2 || base > 16) {
-		return buf;
-	}
-
-	enum { kMaxDigits = 100 };
-	buf.reserve( kMaxDigits ); // Pre-allocate enough space.
-
-	intmax_t quotient = value;
-
-	// Translating number to string with base:
-	do {
-		buf += "0123456789abcdef"[ std::abs( quotient % base ) ];
-		quotient /= base;
-	} while ( quotient );
-
-	// Append the negative sign
-	if ( value < 0) {
-		buf += '-';
-	}
-
-	std::reverse( buf.begin(), buf.end() );
-	return buf;
-}
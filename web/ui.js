@@ -763,6 +763,10 @@ function handleErrorCode(ec) {
 		case "UnknownConversion"  : showToast("Unknown conversion error"); break;
 		case "InvalidConversion"  : showToast("Conversion error"); break;
 		case "UnknownSI"          : showToast("Unknown SI unit"); break;
+		case "InvalidShift"       : showToast("Invalid shift or rotate"); break;
+		case "InvalidStackCount"  : showToast("Not enough stack entries"); break;
+		case "InvalidPercentile"  : showToast("Percentile must be from 0 to 100"); break;
+		case "UnknownMacro"       : showToast("No macro recorded on that key"); break;
 			// no default - do nothing if no error
 	}
 }